@@ -12,7 +12,6 @@
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
-int sim=1, sig, lsp =0;
 /* Converts the PC(4000 series) into array index for code memory
  *
  * Note: You are not supposed to edit this function
@@ -35,20 +34,20 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_OR:
         case OPCODE_XOR:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
+            printf("%s,R%d,R%d,R%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->rs2);
             break;
         }
 
         case OPCODE_MOVC:
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
+            printf("%s,R%d,#%d ", get_opcode_str(stage->opcode), stage->rd, stage->imm);
             break;
         }
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+            printf("%s,R%d,R%d,#%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->imm);
             break;
         }
@@ -56,7 +55,7 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_STORE:
         case OPCODE_STOREP:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
+            printf("%s,R%d,R%d,#%d ", get_opcode_str(stage->opcode), stage->rs1, stage->rs2,
                    stage->imm);
             break;
         }
@@ -64,21 +63,21 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_LOAD:
         case OPCODE_LOADP:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+            printf("%s,R%d,R%d,#%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->imm);
             break;
         }
 
         /*case OPCODE_LOADP:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
+            printf("%s,R%d,R%d,R%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->rs2);
             break;
         }
 
         case OPCODE_STOREP:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rs3, stage->rs1,
+            printf("%s,R%d,R%d,R%d ", get_opcode_str(stage->opcode), stage->rs3, stage->rs1,
                    stage->rs2);
             break;
         }*/
@@ -90,25 +89,25 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_BN:
         case OPCODE_BNN:
         {
-            printf("%s,#%d ", stage->opcode_str, stage->imm);
+            printf("%s,#%d ", get_opcode_str(stage->opcode), stage->imm);
             break;
         }
 
 		case OPCODE_CMP:
         {
-            printf("%s,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2);
+            printf("%s,R%d,R%d ", get_opcode_str(stage->opcode), stage->rs1, stage->rs2);
             break;
         }
         case OPCODE_CML:
         case OPCODE_JUMP:
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rs1, stage->imm);
+            printf("%s,R%d,#%d ", get_opcode_str(stage->opcode), stage->rs1, stage->imm);
             break;
         }
 
         case OPCODE_JALR:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1, stage->imm);
+            printf("%s,R%d,R%d,#%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1, stage->imm);
             break;
         }
         
@@ -119,7 +118,7 @@ print_instruction(const CPU_Stage *stage)
 
         case OPCODE_HALT:
         {
-            printf("%s", stage->opcode_str);
+            printf("%s", get_opcode_str(stage->opcode));
             break;
         }
     }
@@ -130,9 +129,9 @@ print_instruction(const CPU_Stage *stage)
  * Note: You can edit this function to print in more detail
  */
 static void
-print_stage_content(const char *name, const CPU_Stage *stage)
+print_stage_content(const APEX_CPU *cpu, const char *name, const CPU_Stage *stage)
 {
-    if(!sim){
+    if(!cpu->sim){
     printf("%-15s: pc(%d) ", name, stage->pc);
     print_instruction(stage);
     printf("\n");
@@ -239,7 +238,6 @@ APEX_fetch(APEX_CPU *cpu)
         /* Index into code memory using this pc and copy all instruction fields
          * into fetch latch  */
         current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
         cpu->fetch.opcode = current_ins->opcode;
         cpu->fetch.rd = current_ins->rd;
         cpu->fetch.rs1 = current_ins->rs1;
@@ -254,7 +252,7 @@ APEX_fetch(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Fetch", &cpu->fetch);
+            print_stage_content(cpu, "Fetch", &cpu->fetch);
         }
 
         /* Stop fetching new instructions if HALT is fetched */
@@ -460,7 +458,7 @@ APEX_decode(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Decode/RF", &cpu->decode);
+            print_stage_content(cpu, "Decode/RF", &cpu->decode);
         }
      
     }
@@ -756,7 +754,7 @@ APEX_execute(APEX_CPU *cpu)
             {
                 cpu->execute.memory_address
                     = cpu->execute.rs1_value + cpu->execute.imm;
-                lsp = cpu->execute.rs1_value + 4;
+                cpu->lsp = cpu->execute.rs1_value + 4;
                 break;
             }
 
@@ -891,7 +889,7 @@ APEX_execute(APEX_CPU *cpu)
             {
                 cpu->execute.memory_address
                     = cpu->execute.rs2_value + cpu->execute.imm;
-                lsp = cpu->execute.rs2_value + 4;
+                cpu->lsp = cpu->execute.rs2_value + 4;
                break;
             }
 
@@ -964,7 +962,7 @@ APEX_execute(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Execute", &cpu->execute);
+            print_stage_content(cpu, "Execute", &cpu->execute);
         }
     }
 }
@@ -1046,7 +1044,7 @@ APEX_memory(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Memory", &cpu->memory);
+            print_stage_content(cpu, "Memory", &cpu->memory);
         }
     }
 }
@@ -1090,14 +1088,14 @@ APEX_writeback(APEX_CPU *cpu)
                 cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
                 cpu->arr[cpu->writeback.rd] = 0;
 
-                cpu->regs[cpu->writeback.rs1] = lsp;
+                cpu->regs[cpu->writeback.rs1] = cpu->lsp;
                 cpu->arr[cpu->writeback.rs1] = 0;
                 break;
             }
 
             case OPCODE_STOREP:
             {
-                cpu->regs[cpu->writeback.rs2] = lsp;
+                cpu->regs[cpu->writeback.rs2] = cpu->lsp;
                 cpu->arr[cpu->writeback.rs2] = 0;
                 break;
             }
@@ -1129,7 +1127,7 @@ APEX_writeback(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Writeback", &cpu->writeback);
+            print_stage_content(cpu, "Writeback", &cpu->writeback);
         }
 
         if (cpu->writeback.opcode == OPCODE_HALT)
@@ -1145,6 +1143,25 @@ APEX_writeback(APEX_CPU *cpu)
     return 0;
 }
 
+/*
+ * Runs every pipeline stage once, in reverse order. Returns TRUE when HALT
+ * retires in writeback.
+ */
+static int
+APEX_cpu_cycle(APEX_CPU *cpu)
+{
+    if (APEX_writeback(cpu))
+    {
+        return TRUE;
+    }
+
+    APEX_memory(cpu);
+    APEX_execute(cpu);
+    APEX_decode(cpu);
+    APEX_fetch(cpu);
+    return FALSE;
+}
+
 /*
  * This function creates and initializes APEX cpu.
  *
@@ -1171,6 +1188,7 @@ APEX_cpu_init(const char *filename, const int num, const int cycles)
 
     /* Initialize PC, Registers and all pipeline stages */
     cpu->pc = 4000;
+    cpu->sim = 1;
     memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
     memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
     cpu->single_step = ENABLE_SINGLE_STEP;
@@ -1195,7 +1213,7 @@ APEX_cpu_init(const char *filename, const int num, const int cycles)
 
         for (i = 0; i < cpu->code_memory_size; ++i)
         {
-            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
+            printf("%-9s %-9d %-9d %-9d %-9d\n", get_opcode_str(cpu->code_memory[i].opcode),
                    cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
                    cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
         }
@@ -1215,10 +1233,10 @@ APEX_cpu_init(const char *filename, const int num, const int cycles)
     }
     else if(num == 4){
         cpu->single = 4;
-        sim = 0;
+        cpu->sim = 0;
     }
     else{
-        sig = 1;
+        cpu->sig = 1;
     }
 
     /* To start fetch stage */
@@ -1227,6 +1245,23 @@ APEX_cpu_init(const char *filename, const int num, const int cycles)
     return cpu;
 }
 
+/*
+ * Advances the CPU by one clock cycle without any terminal I/O. Returns TRUE
+ * once HALT has retired, FALSE otherwise. All simulation state lives in the
+ * APEX_CPU, so independent instances can be stepped from different threads.
+ */
+int
+APEX_cpu_step(APEX_CPU *cpu)
+{
+    if (APEX_cpu_cycle(cpu))
+    {
+        return TRUE;
+    }
+
+    cpu->clock++;
+    return FALSE;
+}
+
 /*
  * APEX CPU simulation loop
  *
@@ -1240,7 +1275,7 @@ APEX_cpu_run(APEX_CPU *cpu)
     while (TRUE)
     {
         //printf("sim = %d", sim);
-        if(!sim){
+        if(!cpu->sim){
          if (ENABLE_DEBUG_MESSAGES)
          {
             printf("--------------------------------------------\n");
@@ -1249,18 +1284,13 @@ APEX_cpu_run(APEX_CPU *cpu)
          }
         }
 
-        if (APEX_writeback(cpu))
+        if (APEX_cpu_cycle(cpu))
         {
             /* Halt in writeback stage */
             printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
             break;
         }
 
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
-
         
         if(cpu->simulate == 1){
             //sim = 0;
@@ -1278,7 +1308,7 @@ APEX_cpu_run(APEX_CPU *cpu)
             }
         }
         if(cpu->display == 2){
-            sim = 0;
+            cpu->sim = 0;
           
            if(cpu->cycles == cpu->clock){
             //print_reg_file(cpu);
@@ -1294,7 +1324,7 @@ APEX_cpu_run(APEX_CPU *cpu)
            }
         }
         if(cpu->single == 4){
-            sim = 0;
+            cpu->sim = 0;
             //print_reg_file(cpu);
             printf("Press any key to advance CPU Clock or <q> to quit:\n");
             scanf("%c", &user_prompt_val);
@@ -1306,8 +1336,8 @@ APEX_cpu_run(APEX_CPU *cpu)
             }
         }
 
-        if(sig == 1){
-            sim = 0;
+        if(cpu->sig == 1){
+            cpu->sim = 0;
             print_reg_file(cpu);
             printf("Press any key to advance CPU Clock or <q> to quit:\n");
             scanf("%c", &user_prompt_val);
@@ -1329,12 +1359,12 @@ APEX_cpu_run(APEX_CPU *cpu)
     }
 
     if(cpu->single == 4){
-        sim = 0;
+        cpu->sim = 0;
         simulate(cpu);
     }
 
      if(cpu->display == 2){
-            sim = 0;
+            cpu->sim = 0;
           
         if(cpu->cycles > cpu->clock){
             print_reg_file(cpu);
@@ -1346,7 +1376,7 @@ APEX_cpu_run(APEX_CPU *cpu)
 
     if(cpu->simulate == 1)
     {
-        sim = 1;
+        cpu->sim = 1;
         if(cpu->cycles > cpu->clock){
             simulate(cpu);
             printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
@@ -11,10 +11,10 @@
 
 #include "apex_macros.h"
 
-/* Format of an APEX instruction  */
+/* Format of an APEX instruction. The mnemonic is not stored; use
+ * get_opcode_str() when displaying. */
 typedef struct APEX_Instruction
 {
-    char opcode_str[128];
     int opcode;
     int rd;
     int rs1;
@@ -27,7 +27,6 @@ typedef struct APEX_Instruction
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
     int opcode;
     int rs1;
     int rs2;
@@ -65,6 +64,9 @@ typedef struct APEX_CPU
     int n_flag;
     int fetch_from_next_cycle;
     int arr[32];
+    int sim;                       /* Suppress per-stage output when set */
+    int sig;                       /* Default single-step mode */
+    int lsp;                       /* Updated pointer register of LOADP/STOREP */
 
     /* Pipeline stages */
     CPU_Stage fetch;
@@ -75,7 +77,9 @@ typedef struct APEX_CPU
 } APEX_CPU;
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
+const char *get_opcode_str(const int opcode);
 APEX_CPU *APEX_cpu_init(const char *filename,const int num, const int cycles);
+int APEX_cpu_step(APEX_CPU *cpu);
 void APEX_cpu_run(APEX_CPU *cpu);
 void APEX_cpu_stop(APEX_CPU *cpu);
 #endif
@@ -0,0 +1,255 @@
+/*
+ * apex_bp.c
+ * Branch prediction for the fetch stage of the in-order pipeline
+ *
+ * Fetch looks every control transfer up in a direct-mapped branch target
+ * buffer and follows the stored target when the direction predictor says
+ * taken; a BTB miss falls through. Direction predictors, selected at run
+ * time:
+ *
+ *   static      backward (loop) branches taken, forward not taken
+ *   bimodal     2-bit counter per PC
+ *   gshare      2-bit counter per PC xor global history
+ *   tournament  bimodal and gshare, a per-PC 2-bit chooser picks one
+ *
+ * JUMP and JALR are always taken. A JALR pushes its return address, tagged
+ * with its link register, on the return address stack; a JUMP #0 through
+ * the link register on top of the stack pops it as the predicted target.
+ *
+ * Execute resolves each transfer against the PC fetch went on with. On a
+ * misprediction it flushes decode and redirects fetch, restoring the return
+ * stack to its state after the branch was fetched. Counters, history and
+ * the BTB are trained at resolve time, in program order.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+static const char *bp_names[] = {
+    [BP_NONE] = "none",
+    [BP_STATIC] = "static",
+    [BP_BIMODAL] = "bimodal",
+    [BP_GSHARE] = "gshare",
+    [BP_TOURNAMENT] = "tournament",
+};
+
+/* Returns the BP_* predictor called name, or -1 */
+int
+APEX_bp_parse(const char *name)
+{
+    int i;
+
+    for (i = BP_NONE; i <= BP_TOURNAMENT; ++i)
+    {
+        if (strcmp(name, bp_names[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Selects the predictor and BTB size and resets all prediction state.
+ * Returns -1 if the BTB size is outside 1..BTB_SIZE_MAX.
+ */
+int
+APEX_bp_configure(APEX_CPU *cpu, int kind, int btb_size)
+{
+    if (kind < BP_NONE || kind > BP_TOURNAMENT || btb_size < 1
+        || btb_size > BTB_SIZE_MAX)
+    {
+        return -1;
+    }
+
+    cpu->bp = kind;
+    cpu->btb_size = btb_size;
+    memset(cpu->btb, 0, sizeof(cpu->btb));
+
+    /* Counters start weakly not taken, the chooser weakly bimodal */
+    memset(cpu->bimodal, 1, sizeof(cpu->bimodal));
+    memset(cpu->gshare, 1, sizeof(cpu->gshare));
+    memset(cpu->chooser, 1, sizeof(cpu->chooser));
+    cpu->ghr = 0;
+    cpu->ras_top = cpu->ras_count = 0;
+    memset(&cpu->bp_stats, 0, sizeof(cpu->bp_stats));
+    return 0;
+}
+
+static int
+pc_index(int pc)
+{
+    return (pc / 4) & (BP_TABLE_SIZE - 1);
+}
+
+static int
+gshare_index(int pc, int history)
+{
+    return ((pc / 4) ^ history) & (BP_TABLE_SIZE - 1);
+}
+
+/* Moves a 2-bit counter towards the outcome */
+static void
+train(unsigned char *counter, int taken)
+{
+    if (taken && *counter < 3)
+    {
+        (*counter)++;
+    }
+    else if (!taken && *counter > 0)
+    {
+        (*counter)--;
+    }
+}
+
+static int
+predict_taken(const APEX_CPU *cpu, const CPU_Stage *stage, int target)
+{
+    int gshare = cpu->gshare[gshare_index(stage->pc, stage->bp_history)] >= 2;
+    int bimodal = cpu->bimodal[pc_index(stage->pc)] >= 2;
+
+    if (get_opcode_info(stage)->cond == COND_ALWAYS)
+    {
+        return TRUE;
+    }
+
+    switch (cpu->bp)
+    {
+        case BP_STATIC: return target < stage->pc;
+        case BP_BIMODAL: return bimodal;
+        case BP_GSHARE: return gshare;
+        case BP_TOURNAMENT:
+            return cpu->chooser[pc_index(stage->pc)] >= 2 ? gshare : bimodal;
+        default: return FALSE;
+    }
+}
+
+static int
+ras_peek(const APEX_CPU *cpu)
+{
+    return (cpu->ras_top + RAS_SIZE - 1) % RAS_SIZE;
+}
+
+/*
+ * Predicts the PC following the instruction just fetched into stage and
+ * records the prediction in the latch. Returns the predicted next PC.
+ */
+int
+APEX_bp_predict(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    const APEX_BTB_Entry *btb;
+    int next = stage->pc + 4;
+
+    stage->bp_history = cpu->ghr;
+    if (cpu->bp != BP_NONE && get_opcode_info(stage)->fu == FU_BRANCH)
+    {
+        btb = &cpu->btb[(stage->pc / 4) % cpu->btb_size];
+
+        if (stage->opcode == OPCODE_JUMP && stage->imm == 0 && cpu->ras_count
+            && cpu->ras_link[ras_peek(cpu)] == stage->rs1)
+        {
+            cpu->ras_top = ras_peek(cpu);
+            cpu->ras_count--;
+            next = cpu->ras[cpu->ras_top];
+            cpu->bp_stats.ras_returns++;
+        }
+        else if (btb->valid && btb->pc == stage->pc)
+        {
+            if (predict_taken(cpu, stage, btb->target))
+            {
+                next = btb->target;
+            }
+        }
+        else
+        {
+            cpu->bp_stats.btb_misses++;
+        }
+
+        if (stage->opcode == OPCODE_JALR)
+        {
+            cpu->ras[cpu->ras_top] = stage->pc + 4;
+            cpu->ras_link[cpu->ras_top] = stage->rd;
+            cpu->ras_top = (cpu->ras_top + 1) % RAS_SIZE;
+            if (cpu->ras_count < RAS_SIZE)
+            {
+                cpu->ras_count++;
+            }
+        }
+    }
+
+    stage->pred_pc = next;
+    stage->ras_top = cpu->ras_top;
+    stage->ras_count = cpu->ras_count;
+    return next;
+}
+
+/*
+ * Trains the predictor with the outcome of the transfer in stage. Returns
+ * TRUE if fetch went down the wrong path and has to be redirected; without
+ * a predictor that is every taken branch.
+ */
+int
+APEX_bp_resolve(APEX_CPU *cpu, const CPU_Stage *stage, int taken, int target)
+{
+    APEX_BTB_Entry *btb;
+    int mispredict, idx = pc_index(stage->pc);
+    int gidx = gshare_index(stage->pc, stage->bp_history);
+
+    cpu->bp_stats.branches++;
+    if (taken)
+    {
+        cpu->bp_stats.taken++;
+    }
+
+    if (cpu->bp == BP_NONE)
+    {
+        mispredict = taken;
+    }
+    else
+    {
+        if (get_opcode_info(stage)->cond != COND_ALWAYS)
+        {
+            if ((cpu->bimodal[idx] >= 2) != (cpu->gshare[gidx] >= 2))
+            {
+                train(&cpu->chooser[idx], (cpu->gshare[gidx] >= 2) == taken);
+            }
+            train(&cpu->bimodal[idx], taken);
+            train(&cpu->gshare[gidx], taken);
+            cpu->ghr = ((cpu->ghr << 1) | taken) & (BP_TABLE_SIZE - 1);
+        }
+
+        if (taken)
+        {
+            btb = &cpu->btb[(stage->pc / 4) % cpu->btb_size];
+            btb->valid = TRUE;
+            btb->pc = stage->pc;
+            btb->target = target;
+        }
+
+        mispredict = (taken ? target : stage->pc + 4) != stage->pred_pc;
+    }
+
+    if (mispredict)
+    {
+        cpu->bp_stats.mispredicts++;
+        cpu->ras_top = stage->ras_top;
+        cpu->ras_count = stage->ras_count;
+    }
+    return mispredict;
+}
+
+void
+APEX_bp_print_stats(const APEX_CPU *cpu)
+{
+    const APEX_BP_Stats *s = &cpu->bp_stats;
+
+    printf("APEX_CPU: Branch predictor = %s btb = %d\n", bp_names[cpu->bp],
+           cpu->btb_size);
+    printf("APEX_CPU: Branches = %d taken = %d mispredicts = %d "
+           "btb_misses = %d ras_returns = %d\n",
+           s->branches, s->taken, s->mispredicts, s->btb_misses,
+           s->ras_returns);
+}
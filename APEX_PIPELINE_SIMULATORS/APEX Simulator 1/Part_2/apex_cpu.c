@@ -12,9 +12,6 @@
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
-int sim=1, sig;
-int lsp = 0;
-int flag = 1;
 
 /* Converts the PC(4000 series) into array index for code memory
  *
@@ -38,20 +35,20 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_OR:
         case OPCODE_XOR:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
+            printf("%s,R%d,R%d,R%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->rs2);
             break;
         }
 
         case OPCODE_MOVC:
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
+            printf("%s,R%d,#%d ", get_opcode_str(stage->opcode), stage->rd, stage->imm);
             break;
         }
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+            printf("%s,R%d,R%d,#%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->imm);
             break;
         }
@@ -59,7 +56,7 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_STORE:
         case OPCODE_STOREP:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
+            printf("%s,R%d,R%d,#%d ", get_opcode_str(stage->opcode), stage->rs1, stage->rs2,
                    stage->imm);
             break;
         }
@@ -67,21 +64,21 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_LOAD:
         case OPCODE_LOADP:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+            printf("%s,R%d,R%d,#%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->imm);
             break;
         }
 
         /*case OPCODE_LOADP:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
+            printf("%s,R%d,R%d,R%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->rs2);
             break;
         }
 
         case OPCODE_STOREP:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rs3, stage->rs1,
+            printf("%s,R%d,R%d,R%d ", get_opcode_str(stage->opcode), stage->rs3, stage->rs1,
                    stage->rs2);
             break;
         }*/
@@ -93,25 +90,25 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_BN:
         case OPCODE_BNN:
         {
-            printf("%s,#%d ", stage->opcode_str, stage->imm);
+            printf("%s,#%d ", get_opcode_str(stage->opcode), stage->imm);
             break;
         }
 
 		case OPCODE_CMP:
         {
-            printf("%s,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2);
+            printf("%s,R%d,R%d ", get_opcode_str(stage->opcode), stage->rs1, stage->rs2);
             break;
         }
         case OPCODE_CML:
         case OPCODE_JUMP:
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rs1, stage->imm);
+            printf("%s,R%d,#%d ", get_opcode_str(stage->opcode), stage->rs1, stage->imm);
             break;
         }
 
         case OPCODE_JALR:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1, stage->imm);
+            printf("%s,R%d,R%d,#%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1, stage->imm);
             break;
         }
         
@@ -122,7 +119,7 @@ print_instruction(const CPU_Stage *stage)
 
         case OPCODE_HALT:
         {
-            printf("%s", stage->opcode_str);
+            printf("%s", get_opcode_str(stage->opcode));
             break;
         }
     }
@@ -133,9 +130,9 @@ print_instruction(const CPU_Stage *stage)
  * Note: You can edit this function to print in more detail
  */
 static void
-print_stage_content(const char *name, const CPU_Stage *stage)
+print_stage_content(const APEX_CPU *cpu, const char *name, const CPU_Stage *stage)
 {
-    if(!sim){
+    if(!cpu->sim){
     printf("%-15s: pc(%d) ", name, stage->pc);
     print_instruction(stage);
     printf("\n");
@@ -197,11 +194,11 @@ simulate(APEX_CPU* cpu)
 
 
 /*
- * Fetch Stage of APEX Pipeline
+ * Fetch Stage of APEX Pipeline, shared by the out-of-order back end
  *
  * Note: You are free to edit this function according to your implementation
  */
-static void
+void
 APEX_fetch(APEX_CPU *cpu)
 {
     APEX_Instruction *current_ins;
@@ -224,22 +221,22 @@ APEX_fetch(APEX_CPU *cpu)
         /* Index into code memory using this pc and copy all instruction fields
          * into fetch latch  */
         current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
         cpu->fetch.opcode = current_ins->opcode;
         cpu->fetch.rd = current_ins->rd;
         cpu->fetch.rs1 = current_ins->rs1;
         cpu->fetch.rs2 = current_ins->rs2;
         cpu->fetch.imm = current_ins->imm;
         cpu->fetch.rs3 = current_ins->rs3;
-        /* Update PC for next instruction */
-        cpu->pc += 4;
+        /* Update PC for next instruction, the predicted target after a
+         * branch */
+        cpu->pc = APEX_bp_predict(cpu, &cpu->fetch);
 
         /* Copy data from fetch latch to decode latch*/
         cpu->decode = cpu->fetch;
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Fetch", &cpu->fetch);
+            print_stage_content(cpu, "Fetch", &cpu->fetch);
         }
 
         /* Stop fetching new instructions if HALT is fetched */
@@ -250,609 +247,161 @@ APEX_fetch(APEX_CPU *cpu)
     }
     }
     else{
-        if(!sim){
+        if(!cpu->sim){
            printf("Fetch            :EMPTY\n");
         }
     }
 }
 
 /*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Opcode descriptor table. Every stage looks up the behaviour of the
+ * instruction in its latch here, so a new opcode only needs a row (and its
+ * parser entry).
  */
-static void
-APEX_decode(APEX_CPU *cpu)
+static const APEX_Opcode_Info opcode_table[OPCODE_COUNT] = {
+    /*                  src              dest      fu         alu       mem        flags  cond        lat */
+    [OPCODE_ADD]    = { SRC_RS1|SRC_RS2, DEST_RD,  FU_ALU,    ALU_ADD,  MEM_NONE,  TRUE,  COND_NONE,   1 },
+    [OPCODE_SUB]    = { SRC_RS1|SRC_RS2, DEST_RD,  FU_ALU,    ALU_SUB,  MEM_NONE,  TRUE,  COND_NONE,   1 },
+    [OPCODE_MUL]    = { SRC_RS1|SRC_RS2, DEST_RD,  FU_ALU,    ALU_MUL,  MEM_NONE,  TRUE,  COND_NONE,   1 },
+    [OPCODE_AND]    = { SRC_RS1|SRC_RS2, DEST_RD,  FU_ALU,    ALU_AND,  MEM_NONE,  TRUE,  COND_NONE,   1 },
+    [OPCODE_OR]     = { SRC_RS1|SRC_RS2, DEST_RD,  FU_ALU,    ALU_OR,   MEM_NONE,  TRUE,  COND_NONE,   1 },
+    [OPCODE_XOR]    = { SRC_RS1|SRC_RS2, DEST_RD,  FU_ALU,    ALU_XOR,  MEM_NONE,  TRUE,  COND_NONE,   1 },
+    [OPCODE_ADDL]   = { SRC_RS1,         DEST_RD,  FU_ALU,    ALU_ADD,  MEM_NONE,  TRUE,  COND_NONE,   1 },
+    [OPCODE_SUBL]   = { SRC_RS1,         DEST_RD,  FU_ALU,    ALU_SUB,  MEM_NONE,  TRUE,  COND_NONE,   1 },
+    [OPCODE_MOVC]   = { 0,               DEST_RD,  FU_ALU,    ALU_PASS, MEM_NONE,  FALSE, COND_NONE,   1 },
+    [OPCODE_CMP]    = { SRC_RS1|SRC_RS2, 0,        FU_ALU,    ALU_SUB,  MEM_NONE,  TRUE,  COND_NONE,   1 },
+    [OPCODE_CML]    = { SRC_RS1,         0,        FU_ALU,    ALU_SUB,  MEM_NONE,  TRUE,  COND_NONE,   1 },
+    [OPCODE_LOAD]   = { SRC_RS1,         DEST_RD,  FU_AGU,    ALU_NONE, MEM_LOAD,  FALSE, COND_NONE,   1 },
+    [OPCODE_LOADP]  = { SRC_RS1,         DEST_RD|DEST_RS1,
+                                                   FU_AGU,    ALU_NONE, MEM_LOAD,  FALSE, COND_NONE,   1 },
+    [OPCODE_STORE]  = { SRC_RS1|SRC_RS2, 0,        FU_AGU,    ALU_NONE, MEM_STORE, FALSE, COND_NONE,   1 },
+    [OPCODE_STOREP] = { SRC_RS1|SRC_RS2, DEST_RS2, FU_AGU,    ALU_NONE, MEM_STORE, FALSE, COND_NONE,   1 },
+    [OPCODE_BZ]     = { 0,               0,        FU_BRANCH, ALU_NONE, MEM_NONE,  FALSE, COND_Z,      1 },
+    [OPCODE_BNZ]    = { 0,               0,        FU_BRANCH, ALU_NONE, MEM_NONE,  FALSE, COND_NZ,     1 },
+    [OPCODE_BP]     = { 0,               0,        FU_BRANCH, ALU_NONE, MEM_NONE,  FALSE, COND_P,      1 },
+    [OPCODE_BNP]    = { 0,               0,        FU_BRANCH, ALU_NONE, MEM_NONE,  FALSE, COND_NP,     1 },
+    [OPCODE_BN]     = { 0,               0,        FU_BRANCH, ALU_NONE, MEM_NONE,  FALSE, COND_N,      1 },
+    [OPCODE_BNN]    = { 0,               0,        FU_BRANCH, ALU_NONE, MEM_NONE,  FALSE, COND_NN,     1 },
+    [OPCODE_JUMP]   = { SRC_RS1,         0,        FU_BRANCH, ALU_NONE, MEM_NONE,  FALSE, COND_ALWAYS, 1 },
+    [OPCODE_JALR]   = { SRC_RS1,         DEST_RD,  FU_BRANCH, ALU_NONE, MEM_NONE,  FALSE, COND_ALWAYS, 1 },
+    [OPCODE_NOP]    = { 0,               0,        FU_NONE,   ALU_NONE, MEM_NONE,  FALSE, COND_NONE,   1 },
+    [OPCODE_HALT]   = { 0,               0,        FU_NONE,   ALU_NONE, MEM_NONE,  FALSE, COND_NONE,   1 },
+};
+
+const APEX_Opcode_Info *
+get_opcode_info(const CPU_Stage *stage)
 {
-    if (cpu->decode.has_insn)
-    {
-        /* Read operands from register file based on the instruction type */
-        //printf("flag =%d\n", flag);
-        switch (cpu->decode.opcode)
-        {
-            
-            
-
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                
-                if(cpu->forward_flag){
-
-                  if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                    cpu->stalled = 0;
-                        
-                    }
-                    else{
-                        if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
-                          if(cpu->writeback.rd == cpu->decode.rs1){
-                            cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                          }
-                          
-
-                          if(cpu->writeback.rd == cpu->decode.rs2){
-                            cpu->decode.rs2_value = cpu->writeback.result_buffer;
-                          }
-                       }
-                    
-
-                      if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2){
-                        if(flag){
-                         if(cpu->execute.rd == cpu->decode.rs1){
-                             cpu->decode.rs1_value = cpu->execute.result_buffer;
-                         }
-                        
-                         if(cpu->execute.rd == cpu->decode.rs2){
-                             cpu->decode.rs2_value = cpu->execute.result_buffer;
-                         }
-                            
-                        }
-                        flag = 1;
-                      }
-
-                      if(strcmp(cpu->execute.opcode_str,"LOADP") == 0){
-                        if(cpu->execute.rs1 == cpu->decode.rs1 || cpu->execute.rs1 == cpu->decode.rs2){
-                        if(flag){
-                         if(cpu->execute.rs1 == cpu->decode.rs1){
-                             cpu->decode.rs1_value = cpu->execute.rs1_value + 4;
-                         }
-                        
-                         if(cpu->execute.rs1 == cpu->decode.rs2){
-                             cpu->decode.rs2_value = cpu->execute.rs1_value + 4;
-                         }
-                            
-                        }
-                        flag = 1;
-                      }
-                      }
-
-                      if(strcmp(cpu->execute.opcode_str,"STOREP") == 0){
-                        if(cpu->execute.rs2 == cpu->decode.rs1 || cpu->execute.rs2 == cpu->decode.rs2){
-                        if(flag){
-                         if(cpu->execute.rs2 == cpu->decode.rs1){
-                             cpu->decode.rs1_value = cpu->execute.rs2_value + 4;
-                         }
-                        
-                         if(cpu->execute.rs2 == cpu->decode.rs2){
-                             cpu->decode.rs2_value = cpu->execute.rs2_value + 4;
-                         }
-                            
-                        }
-                        flag = 1;
-                      }
-                      }
-
-                        cpu->stalled = 1;
-                    }
-                }
-                else{
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                    cpu->stalled = 0;
-                    }
-                    else{
-                    cpu->arr[cpu->decode.rd]++;
-                    cpu->stalled = 1;
-                    }
-                }  
-                break;
-            }
-
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-            case OPCODE_NOP:
-            case OPCODE_BP:
-            case OPCODE_BNP:
-            case OPCODE_BN:
-            case OPCODE_BNN:
-            {
-               /* BZ,BNZ and NOP doesn't have register operands */
-               break;
-            }
-
-            case OPCODE_LOADP:
-            {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-
-                if(cpu->forward_flag){
-                  
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        cpu->arr[cpu->decode.rd]++;
-                        cpu->arr[cpu->decode.rs1]++;
-                        if(cpu->writeback.rd == cpu->decode.rs1){
-                           cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                        }
-                        
-                        if(flag){
-                        if(cpu->execute.rd == cpu->decode.rs1){
-                            cpu->decode.rs1_value = cpu->execute.result_buffer;
-                            
-                        }
-                        
-                        if(strcmp(cpu->execute.opcode_str,"LOADP")== 0){
-                            if(cpu->execute.rs1 == cpu->decode.rs1){
-                            cpu->decode.rs1_value = cpu->execute.rs1_value + 4;
-                            }
-                            
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"STOREP")== 0){
-                            if(cpu->execute.rs2 == cpu->decode.rs1){
-                            cpu->decode.rs1_value = cpu->execute.rs2_value + 4;
-                            }
-                            
-                        }
-
-                        }
-                        flag = 1;
-                        cpu->stalled = 1; //unstalling
-                    }
-
-                }
-                else{
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {
-                    cpu->stalled = 0;
-                    }
-                    else{
-                    cpu->arr[cpu->decode.rd]++;
-                    cpu->arr[cpu->decode.rs1]++;
-                    cpu->stalled = 1; //unstalling
-                    }
-                }
-
-                break;
-            }
-
-            case OPCODE_LOAD:
-            {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                
-                if(cpu->forward_flag){
-                  
-
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        cpu->arr[cpu->decode.rd]++;
-                        if(cpu->writeback.rd == cpu->decode.rs1){
-                           cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                        }
-                        
-                        if(flag){
-                        if(cpu->execute.rd == cpu->decode.rs1){
-                            cpu->decode.rs1_value = cpu->execute.result_buffer;
-                            
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"LOADP") == 0){
-                            if(cpu->execute.rs1 == cpu->decode.rs1){
-                                cpu->decode.rs1_value = cpu->execute.rs1_value + 4;
-                            }    
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"STOREP") == 0){
-                            if(cpu->execute.rs2 == cpu->decode.rs1){
-                                cpu->decode.rs1_value = cpu->execute.rs2_value + 4;
-                            }    
-                        }
-
-
-                        }
-                        flag = 1;
-                        cpu->stalled = 1; //unstalling
-                    }
+    return &opcode_table[stage->opcode];
+}
 
-                }
-                else{
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {
-                    cpu->stalled = 0;
-                    }
-                    else{
-                    cpu->arr[cpu->decode.rd]++;
-                    cpu->stalled = 1; //unstalling
-                    }
-                }
-                break;
-            }
+/* Value written to a LOADP/STOREP pointer register */
+int
+get_pointer_update(const CPU_Stage *stage, int dest)
+{
+    return (dest == DEST_RS1 ? stage->rs1_value : stage->rs2_value) + 4;
+}
 
+/*
+ * Marks every register the instruction writes as busy (delta 1) or
+ * releases it (delta -1). Without forwarding registers stay busy until
+ * writeback, with forwarding only memory instructions hold them, until MEM.
+ */
+static void
+update_scoreboard(APEX_CPU *cpu, const CPU_Stage *stage, int delta)
+{
+    const APEX_Opcode_Info *info = get_opcode_info(stage);
 
-            case OPCODE_STOREP:
-            {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                
-                if(cpu->forward_flag){
-
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        cpu->arr[cpu->decode.rs2]++;
-                        if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
-                           if(cpu->writeback.rd == cpu->decode.rs1)
-                             cpu->decode.rs1_value = cpu->writeback.result_buffer;
- 
-                           if(cpu->writeback.rd == cpu->decode.rs2)
-                             cpu->decode.rs2_value = cpu->writeback.result_buffer;
-
-                        }
-                        
-                        if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2 ){
-                         if(flag){
-                            if(cpu->execute.rd == cpu->decode.rs1)
-                               cpu->decode.rs1_value = cpu->execute.result_buffer;
-
-                            if(cpu->execute.rd == cpu->decode.rs2)
-                              cpu->decode.rs2_value = cpu->execute.result_buffer;
-
-                        }
-                         flag = 1;
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"LOADP") == 0){
-                        if(cpu->execute.rs1 == cpu->decode.rs1 || cpu->execute.rs1 == cpu->decode.rs2 ){
-                         if(flag){
-                            if(cpu->execute.rs1 == cpu->decode.rs1)
-                               cpu->decode.rs1_value = cpu->execute.rs1_value + 4;
-
-                            if(cpu->execute.rs1 == cpu->decode.rs2)
-                              cpu->decode.rs2_value = cpu->execute.rs1_value +4;
-
-                        }
-                         flag = 1;
-                        }
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"STOREP") == 0){
-                        if(cpu->execute.rs2 == cpu->decode.rs1 || cpu->execute.rs2 == cpu->decode.rs2 ){
-                         if(flag){
-                            if(cpu->execute.rs2 == cpu->decode.rs1)
-                               cpu->decode.rs1_value = cpu->execute.rs2_value + 4;
-
-                            if(cpu->execute.rs1 == cpu->decode.rs2)
-                              cpu->decode.rs2_value = cpu->execute.rs2_value +4;
-
-                        }
-                         flag = 1;
-                        }
-                        }
-                            
-                            cpu->stalled = 1;
-                    }
-                  
+    if (info->dest & DEST_RD)
+    {
+        cpu->arr[stage->rd] += delta;
+    }
+    if (info->dest & DEST_RS1)
+    {
+        cpu->arr[stage->rs1] += delta;
+    }
+    if (info->dest & DEST_RS2)
+    {
+        cpu->arr[stage->rs2] += delta;
+    }
+}
 
-                }
-                else{
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        cpu->arr[cpu->decode.rs2]++;
-                        cpu->stalled = 1;
-                    }
-                }
-                break;
-            }
+/*
+ * Forwards reg from the instruction in a later stage's latch. Loaded values
+ * are never taken from the execute latch, they only exist after MEM.
+ */
+static void
+forward_from_stage(const CPU_Stage *stage, int reg, int *value, int is_execute)
+{
+    const APEX_Opcode_Info *info = get_opcode_info(stage);
 
-            case OPCODE_STORE:
-            {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                
-                if(cpu->forward_flag){
-
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
-                           if(cpu->writeback.rd == cpu->decode.rs1)
-                             cpu->decode.rs1_value = cpu->writeback.result_buffer;
- 
-                           if(cpu->writeback.rd == cpu->decode.rs2)
-                             cpu->decode.rs2_value = cpu->writeback.result_buffer;
-
-                        }
-                        
-                        if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2){
-                         if(flag){
-                            if(cpu->execute.rd == cpu->decode.rs1)
-                               cpu->decode.rs1_value = cpu->execute.result_buffer;
-
-                            if(cpu->execute.rd == cpu->decode.rs2)
-                              cpu->decode.rs2_value = cpu->execute.result_buffer;
-
-                        }
-                         flag = 1;
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"LOADP") == 0){
-                        if(cpu->execute.rs1 == cpu->decode.rs1 || cpu->execute.rs1 == cpu->decode.rs2 ){
-                         if(flag){
-                            if(cpu->execute.rs1 == cpu->decode.rs1)
-                               cpu->decode.rs1_value = cpu->execute.rs1_value + 4;
-
-                            if(cpu->execute.rs1 == cpu->decode.rs2)
-                              cpu->decode.rs2_value = cpu->execute.rs1_value +4;
-
-                        }
-                         flag = 1;
-                        }
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"STOREP") == 0){
-                        if(cpu->execute.rs2 == cpu->decode.rs1 || cpu->execute.rs2 == cpu->decode.rs2 ){
-                         if(flag){
-                            if(cpu->execute.rs2 == cpu->decode.rs1)
-                               cpu->decode.rs1_value = cpu->execute.rs2_value + 4;
-
-                            if(cpu->execute.rs1 == cpu->decode.rs2)
-                              cpu->decode.rs2_value = cpu->execute.rs2_value +4;
-
-                        }
-                         flag = 1;
-                        }
-                        }
-                            
-                            cpu->stalled = 1;
-                    }
-                  
+    if ((info->dest & DEST_RD) && stage->rd == reg
+        && !(is_execute && info->mem == MEM_LOAD))
+    {
+        *value = stage->result_buffer;
+    }
+    if ((info->dest & DEST_RS1) && stage->rs1 == reg)
+    {
+        *value = get_pointer_update(stage, DEST_RS1);
+    }
+    if ((info->dest & DEST_RS2) && stage->rs2 == reg)
+    {
+        *value = get_pointer_update(stage, DEST_RS2);
+    }
+}
 
-                }
-                else{
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        cpu->stalled = 1;
-                    }
-                }
-                
-                break;
-            }
+/* Reads a source register, the execute latch holds the youngest producer */
+static int
+read_source(const APEX_CPU *cpu, int reg)
+{
+    int value = cpu->regs[reg];
 
+    if (cpu->forward_flag)
+    {
+        forward_from_stage(&cpu->writeback, reg, &value, FALSE);
+        forward_from_stage(&cpu->execute, reg, &value, TRUE);
+    }
+    return value;
+}
 
-            case OPCODE_CML:
-            case OPCODE_JUMP:
-            {
-                
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-
-                if(cpu->forward_flag){
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        cpu->stalled = 1;
-                        if(cpu->writeback.rd == cpu->decode.rs1){
-                            if(cpu->writeback.rd == cpu->decode.rs1)
-                               cpu->decode.rs1_value = cpu->writeback.result_buffer;
-
-                        }
-                        if(cpu->execute.rd == cpu->decode.rs1){
-                          if(flag){
-                            if(cpu->execute.rd == cpu->decode.rs1)
-                                cpu->decode.rs1_value = cpu->execute.result_buffer;
-                          }
-                          flag = 1;
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"LOADP") == 0){
-                            if(flag){
-                                if(cpu->execute.rs1 == cpu->decode.rs1)
-                                    cpu->decode.rs1_value = cpu->execute.rs1_value + 4;
-                            }
-                          flag = 1;
-
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"STOREP") == 0){
-                          if(flag){
-                            if(cpu->execute.rs2 == cpu->decode.rs1)
-                                cpu->decode.rs1_value = cpu->execute.rs2_value + 4;
-                          }
-                          flag = 1;
-                        }
-                    }
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_decode(APEX_CPU *cpu)
+{
+    const APEX_Opcode_Info *info;
 
-                }
-                else{
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {   
-                        cpu->stalled = 0;
-                        //printf("CMP Stalled\n");
-                    }
-                    else{
-                        cpu->stalled = 1;
-                    }
-                }
-                break;
-            }
+    if (cpu->decode.has_insn)
+    {
+        info = get_opcode_info(&cpu->decode);
 
-            case OPCODE_CMP:
+        /* Stall while a source register is still held by the scoreboard */
+        if (((info->src & SRC_RS1) && cpu->arr[cpu->decode.rs1] != 0)
+            || ((info->src & SRC_RS2) && cpu->arr[cpu->decode.rs2] != 0))
+        {
+            cpu->stalled = 0;
+        }
+        else
+        {
+            /* Read operands from register file based on the instruction type */
+            if (info->src & SRC_RS1)
             {
-                
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                
-                if(cpu->forward_flag){
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        cpu->stalled = 1;
-                        if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
-                            if(cpu->writeback.rd == cpu->decode.rs1)
-                               cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                            
-                            if(cpu->writeback.rd == cpu->decode.rs2)
-                              cpu->decode.rs2_value = cpu->writeback.result_buffer;
-
-                        }
-                        if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2){
-                          if(flag){
-                            if(cpu->execute.rd == cpu->decode.rs1)
-                                cpu->decode.rs1_value = cpu->execute.result_buffer;
-                            
-                            if(cpu->execute.rd == cpu->decode.rs2)
-                                cpu->decode.rs2_value = cpu->execute.result_buffer;
-                          }
-                          flag = 1;
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"LOADP") == 0){
-                        if(cpu->execute.rs1 == cpu->decode.rs1 || cpu->execute.rs1 == cpu->decode.rs2){
-                          if(flag){
-                            if(cpu->execute.rs1 == cpu->decode.rs1)
-                                cpu->decode.rs1_value = cpu->execute.rs1_value + 4;
-                            
-                            if(cpu->execute.rs1 == cpu->decode.rs2)
-                                cpu->decode.rs2_value = cpu->execute.rs1_value + 4;
-                          }
-                          flag = 1;
-                        }
-
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"STOREP") == 0){
-                         if(cpu->execute.rs2 == cpu->decode.rs1 || cpu->execute.rs2 == cpu->decode.rs2){
-                          if(flag){
-                            if(cpu->execute.rs2 == cpu->decode.rs1)
-                                cpu->decode.rs1_value = cpu->execute.rs2_value + 4;
-                            
-                            if(cpu->execute.rs2 == cpu->decode.rs2)
-                                cpu->decode.rs2_value = cpu->execute.rs2_value + 4;
-                          }
-                          flag = 1;
-                        }
-                        }
-                    }
-
-                }
-                else{
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        cpu->stalled = 1;
-                    }
-                }
-                
-                break;
+                cpu->decode.rs1_value = read_source(cpu, cpu->decode.rs1);
             }
-
-            case OPCODE_MOVC:
+            if (info->src & SRC_RS2)
             {
-                /* MOVC doesn't have register operands */
-                if(cpu->forward_flag){
-
-                }
-                else{
-                   cpu->arr[cpu->decode.rd]++;
-                }
-                break;
+                cpu->decode.rs2_value = read_source(cpu, cpu->decode.rs2);
             }
 
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_JALR:
+            if (!cpu->forward_flag || info->mem != MEM_NONE)
             {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                 if(cpu->forward_flag){
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {
-                       cpu->stalled = 0;
-                    }
-                    else{
-                        //printf("enter else in ADDL\n");
-                        if(cpu->writeback.rd == cpu->decode.rs1){
-                            cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                        }
-                        
-                        if(flag){
-                           // printf("enter flag else in ADDL\n");
-                        if(cpu->execute.rd == cpu->decode.rs1){
-                                cpu->decode.rs1_value = cpu->execute.result_buffer;   
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"LOADP") == 0){
-                            if(cpu->execute.rs1 == cpu->decode.rs1){
-                                cpu->decode.rs1_value = cpu->execute.rs1_value + 4;   
-                        }
-                        }
-
-                        if(strcmp(cpu->execute.opcode_str,"STOREP") == 0){
-                            //printf("enter STOREP else in ADDL\n");
-                            if(cpu->execute.rs2 == cpu->decode.rs1){
-                                cpu->decode.rs1_value = cpu->execute.rs2_value + 4;   
-                        }
-                        }
-
-
-                        flag = 1;
-                        }
-                        cpu->stalled = 1;
-                    }
-                }
-                else{
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {
-                    cpu->stalled = 0;
-                    }
-                    else{
-                    cpu->arr[cpu->decode.rd]++;
-                    cpu->stalled = 1;
-                    }
-                }
-                break;
+                update_scoreboard(cpu, &cpu->decode, 1);
             }
-
+            cpu->stalled = 1;
         }
+
         if(cpu->stalled){
            /* Copy data from decode latch to execute latch*/
            cpu->execute = cpu->decode;
@@ -861,17 +410,68 @@ APEX_decode(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Decode/RF", &cpu->decode);
+            print_stage_content(cpu, "Decode/RF", &cpu->decode);
         }
      
     }
     else{
-        if(!sim){
+        if(!cpu->sim){
           printf("Decode           :EMPTY\n");
         }
     }
 }
 
+/* Result of an ALU_* operation, also used by the out-of-order back end */
+int
+APEX_alu(int op, int a, int b)
+{
+    switch (op)
+    {
+        case ALU_ADD: return a + b;
+        case ALU_SUB: return a - b;
+        case ALU_MUL: return a * b;
+        case ALU_AND: return a & b;
+        case ALU_OR: return a | b;
+        case ALU_XOR: return a ^ b;
+        case ALU_PASS: return b;
+        default: return 0;
+    }
+}
+
+/* Sets the zero, positive and negative flags from an ALU result */
+static void
+set_flags(APEX_CPU *cpu, int result)
+{
+    cpu->zero_flag = result == 0;
+    cpu->p_flag = result > 0;
+    cpu->n_flag = result < 0;
+}
+
+/* Packs the architectural flags into FLAG_* bits */
+int
+APEX_get_flags(const APEX_CPU *cpu)
+{
+    return (cpu->zero_flag ? FLAG_ZERO : 0) | (cpu->p_flag ? FLAG_POSITIVE : 0)
+           | (cpu->n_flag ? FLAG_NEGATIVE : 0);
+}
+
+/* Evaluates a COND_* branch condition against FLAG_* bits */
+int
+APEX_branch_taken(int cond, int flags)
+{
+    switch (cond)
+    {
+        case COND_ALWAYS: return TRUE;
+        case COND_Z: return (flags & FLAG_ZERO) != 0;
+        case COND_NZ: return (flags & FLAG_ZERO) == 0;
+        case COND_P: return (flags & FLAG_POSITIVE) != 0;
+        case COND_NP: return (flags & FLAG_POSITIVE) == 0;
+        case COND_N: return (flags & FLAG_NEGATIVE) != 0;
+        case COND_NN: return (flags & FLAG_NEGATIVE) == 0;
+        default: return FALSE;
+    }
+}
+
 /*
  * Execute Stage of APEX Pipeline
  *
@@ -880,366 +480,52 @@ APEX_decode(APEX_CPU *cpu)
 static void
 APEX_execute(APEX_CPU *cpu)
 {
-    //printf(" %s %d\n",cpu->execute.opcode_str,cpu->execute.has_insn);
+    const APEX_Opcode_Info *info;
+    int taken, target;
+
     if (cpu->execute.has_insn)
     {
-        /* Execute logic based on instruction type */
-        switch (cpu->execute.opcode)
-        {
-            case OPCODE_ADD:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value + cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer > 0){
-                    cpu->p_flag = TRUE;
-                    cpu->n_flag = FALSE;
-                } 
-
-                if (cpu->execute.result_buffer < 0){
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = TRUE;
-                }    
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = FALSE;
-                }
-                break;
-            }
-
-            case OPCODE_SUB:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value - cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer > 0){
-                    cpu->p_flag = TRUE;
-                    cpu->n_flag = FALSE;
-                } 
-
-                if (cpu->execute.result_buffer < 0){
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = TRUE;
-                }    
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = FALSE;
-                }
-                break;
-            }
-
-            case OPCODE_MUL:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value * cpu->execute.rs2_value;
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer > 0){
-                    cpu->p_flag = TRUE;
-                    cpu->n_flag = FALSE;
-                } 
-
-                if (cpu->execute.result_buffer < 0){
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = TRUE;
-                }    
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = FALSE;
-                }
-                break;
-            }
-
-            case OPCODE_AND:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value & cpu->execute.rs2_value;
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer > 0){
-                    cpu->p_flag = TRUE;
-                    cpu->n_flag = FALSE;
-                } 
-
-                if (cpu->execute.result_buffer < 0){
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = TRUE;
-                }    
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = FALSE;
-                }
-                break;
-            }
-
-            case OPCODE_OR:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value | cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer > 0){
-                    cpu->p_flag = TRUE;
-                    cpu->n_flag = FALSE;
-                } 
-
-                if (cpu->execute.result_buffer < 0){
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = TRUE;
-                }    
+        info = get_opcode_info(&cpu->execute);
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = FALSE;
-                }
-                break;
-            }
-
-            case OPCODE_XOR:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
-
-                if (cpu->execute.result_buffer > 0){
-                    cpu->p_flag = TRUE;
-                    cpu->n_flag = FALSE;
-                } 
-
-                if (cpu->execute.result_buffer < 0){
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = TRUE;
-                }    
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = FALSE;
-                }
-                break;
-            }
-
-            case OPCODE_ADDL:
+        /* Execute logic based on the functional unit of the instruction */
+        switch (info->fu)
+        {
+            case FU_ALU:
             {
                 cpu->execute.result_buffer
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-
-                if (cpu->execute.result_buffer > 0){
-                    cpu->p_flag = TRUE;
-                    cpu->n_flag = FALSE;
-                } 
-
-                if (cpu->execute.result_buffer < 0){
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = TRUE;
-                }    
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
+                    = APEX_alu(info->alu, cpu->execute.rs1_value,
+                               (info->src & SRC_RS2) ? cpu->execute.rs2_value
+                                                     : cpu->execute.imm);
+                if (info->sets_flags)
                 {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = FALSE;
+                    set_flags(cpu, cpu->execute.result_buffer);
                 }
                 break;
             }
 
-            case OPCODE_SUBL:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value - cpu->execute.imm;
-
-                
-                if (cpu->execute.result_buffer > 0){
-                    cpu->p_flag = TRUE;
-                    cpu->n_flag = FALSE;
-                } 
-
-                if (cpu->execute.result_buffer < 0){
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = TRUE;
-                }    
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = FALSE;
-                }
-                break;
-            }
-
-            case OPCODE_LOAD:
-            {
-                cpu->execute.memory_address
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-                break;
-            }
-
-            case OPCODE_LOADP:
+            case FU_AGU:
             {
+                /* Loads address off rs1, stores off rs2 */
                 cpu->execute.memory_address
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-                lsp = cpu->execute.rs1_value + 4;
-                //printf("%d loadp\n",lsp);
+                    = (info->mem == MEM_STORE ? cpu->execute.rs2_value
+                                              : cpu->execute.rs1_value)
+                      + cpu->execute.imm;
                 break;
             }
 
-            case OPCODE_JUMP:
+            case FU_BRANCH:
             {
-               /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.rs1_value+ cpu->execute.imm;
-                    //printf("  %d  ", cpu->pc);
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+                cpu->execute.result_buffer = cpu->execute.pc + 4;
+                taken = APEX_branch_taken(info->cond, APEX_get_flags(cpu));
+                target = ((info->src & SRC_RS1) ? cpu->execute.rs1_value
+                                                : cpu->execute.pc)
+                         + cpu->execute.imm;
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-            }
-
-            case OPCODE_JALR:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.pc + 4;
-                    
-                /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
-                    //printf("  %d  ", cpu->pc);
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-            }
-
-            case OPCODE_BZ:
-            {
-                if (cpu->zero_flag == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-
-            case OPCODE_BNZ:
-            {
-                if (cpu->zero_flag == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-
-
-            case OPCODE_BP:
-            {
-                if (cpu->p_flag == TRUE)
+                if (APEX_bp_resolve(cpu, &cpu->execute, taken, target))
                 {
                     /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
+                    cpu->pc = taken ? target : cpu->execute.pc + 4;
 
-            case OPCODE_BNP:
-            {
-                if (cpu->p_flag == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
                     /* Since we are using reverse callbacks for pipeline stages, 
                      * this will prevent the new instruction from being fetched in the current cycle*/
                     cpu->fetch_from_next_cycle = TRUE;
@@ -1252,126 +538,6 @@ APEX_execute(APEX_CPU *cpu)
                 }
                 break;
             }
-
-            case OPCODE_BN:
-            {
-                if (cpu->n_flag == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-
-            case OPCODE_BNN:
-            {
-                if (cpu->n_flag == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
-
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-
-
-            case OPCODE_STORE:
-            {
-               cpu->execute.memory_address
-                    = cpu->execute.rs2_value + cpu->execute.imm;
-                
-               break;
-            }
-
-            case OPCODE_STOREP:
-            {
-                cpu->execute.memory_address
-                    = cpu->execute.rs2_value + cpu->execute.imm;
-                lsp = cpu->execute.rs2_value + 4;
-               break;
-            }
-
-            case OPCODE_CMP:
-            {
-               if (cpu->execute.rs1_value == cpu->execute.rs2_value)
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                 
-                if (cpu->execute.rs1_value > cpu->execute.rs2_value)
-                {
-                    cpu->p_flag = TRUE;
-                    cpu->n_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = TRUE;
-                }
-
-               break;
-            }
-
-
-            case OPCODE_CML:
-            {
-                if (cpu->execute.rs1_value == cpu->execute.imm)
-                {
-                    cpu->zero_flag = TRUE;
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-
-                if (cpu->execute.rs1_value > cpu->execute.imm)
-                {
-                    cpu->p_flag = TRUE;
-                    cpu->n_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->p_flag = FALSE;
-                    cpu->n_flag = TRUE;
-                }
-
-               break;
-
-            }
-
-
-            case OPCODE_MOVC: 
-            {
-                cpu->execute.result_buffer = cpu->execute.imm;
-                break;
-            }
         }
 
         /* Copy data from execute latch to memory latch*/
@@ -1380,11 +546,11 @@ APEX_execute(APEX_CPU *cpu)
         
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Execute", &cpu->execute);
+            print_stage_content(cpu, "Execute", &cpu->execute);
         }
     }
     else{
-        if(!sim){
+        if(!cpu->sim){
            printf("Execute         :EMPTY\n");
         }
     }
@@ -1398,83 +564,34 @@ APEX_execute(APEX_CPU *cpu)
 static void
 APEX_memory(APEX_CPU *cpu)
 {
+    const APEX_Opcode_Info *info;
+
     if (cpu->memory.has_insn)
     {
-        switch (cpu->memory.opcode)
-        {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_BNZ:
-			case OPCODE_BZ:
-			case OPCODE_HALT:
-			case OPCODE_NOP:
-			case OPCODE_MOVC:
-			case OPCODE_CMP:
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_CML:
-            case OPCODE_BP:
-            case OPCODE_BNP:
-            case OPCODE_BN:
-            case OPCODE_BNN:
-            case OPCODE_JALR:
-            case OPCODE_JUMP:
-            {
-                /* No work for ADD */
-                //printf("memory stage %d",cpu->memory.rd);
-                break;
-            }
+        info = get_opcode_info(&cpu->memory);
 
-            case OPCODE_LOAD:
+        switch (info->mem)
+        {
+            case MEM_LOAD:
             {
                 /* Read from data memory */
                 cpu->memory.result_buffer
                     = cpu->data_memory[cpu->memory.memory_address];
-                    
-                    if(cpu->forward_flag){
-                      cpu->arr[cpu->memory.rd]--;
-                      if(cpu->memory.rd == cpu->decode.rs1 || cpu->memory.rd == cpu->decode.rs2){
-                        flag = 0;
-                      }
-                    }
-                break;
-            }
-
-            case OPCODE_STORE:
-            {
-                /* Read from data memory */
-                cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
                 break;
             }
 
-            case OPCODE_STOREP:
+            case MEM_STORE:
             {
-                
+                /* Write rs1 to data memory */
                 cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
-                if(cpu->forward_flag){
-                    cpu->arr[cpu->memory.rs2]--;
-                    
-                }
                 break;
             }
+        }
 
-            case OPCODE_LOADP:
-            {
-                cpu->memory.result_buffer
-                    = cpu->data_memory[cpu->memory.memory_address];
-                if(cpu->forward_flag){
-                      cpu->arr[cpu->memory.rd]--;
-                      cpu->arr[cpu->memory.rs1]--;
-                      if(cpu->memory.rd == cpu->decode.rs1 || cpu->memory.rd == cpu->decode.rs2 || cpu->memory.rs1 == cpu->decode.rs1 || cpu->memory.rs1 == cpu->decode.rs2){
-                        flag = 0;
-                      }
-                    }
-                break;
-            }
+        /* Results are forwardable from the writeback latch from now on */
+        if (cpu->forward_flag && info->mem != MEM_NONE)
+        {
+            update_scoreboard(cpu, &cpu->memory, -1);
         }
 
         /* Copy data from memory latch to writeback latch*/
@@ -1483,11 +600,11 @@ APEX_memory(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Memory", &cpu->memory);
+            print_stage_content(cpu, "Memory", &cpu->memory);
         }
     }
     else{
-        if(!sim){
+        if(!cpu->sim){
            printf("Memory           :EMPTY\n");
         }
     }
@@ -1501,110 +618,31 @@ APEX_memory(APEX_CPU *cpu)
 static int
 APEX_writeback(APEX_CPU *cpu)
 {
+    const APEX_Opcode_Info *info;
+
     if (cpu->writeback.has_insn)
     {
-        /* Write result to register file based on instruction type */
-        switch (cpu->writeback.opcode)
-        {
-            case OPCODE_ADD:
-            case OPCODE_ADDL:
-			case OPCODE_SUB:
-			case OPCODE_SUBL:
-			case OPCODE_MUL:
-			case OPCODE_AND:
-			case OPCODE_OR:
-			case OPCODE_XOR:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                if(cpu->forward_flag){
-
-                }
-                else{
-                    printf("entered writeback else\n\n");
-                cpu->arr[cpu->writeback.rd]--;
-                }
-                break;
-            }
-
-            case OPCODE_LOAD:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                if(cpu->forward_flag){
-
-                }
-                else{
-                cpu->arr[cpu->writeback.rd]--;
-                }
-                break;
-            }
-
-            case OPCODE_MOVC: 
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                if(cpu->forward_flag){
-
-                }
-                else{
-                    printf("entered writeback else\n\n");
-                    cpu->arr[cpu->writeback.rd]--;
-                }
-                break;
-            }
-
-            case OPCODE_STORE:
-			{
-                break;
-			}
-
-            case OPCODE_LOADP:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs[cpu->writeback.rs1] = lsp;
-
-                if(cpu->forward_flag){
-
-                }
-                else{
-                cpu->arr[cpu->writeback.rd]--;
-                cpu->arr[cpu->writeback.rs1]--;
-                }
-                break;
-            }
-
-            case OPCODE_STOREP:
-            {
-                cpu->regs[cpu->writeback.rs2] = lsp;
-
-                if(cpu->forward_flag){
-
-                }
-                else{
-                cpu->arr[cpu->writeback.rs2]--;
-                }
-            
-                break;
-            }
-
-
-            case OPCODE_JALR: 
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                if(cpu->forward_flag){
-
-                }
-                else{
-                cpu->arr[cpu->writeback.rd]--;
-                }
-                break;
-            }
-
+        info = get_opcode_info(&cpu->writeback);
 
+        /* Write results to register file based on the instruction type */
+        if (info->dest & DEST_RD)
+        {
+            cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+        }
+        if (info->dest & DEST_RS1)
+        {
+            cpu->regs[cpu->writeback.rs1]
+                = get_pointer_update(&cpu->writeback, DEST_RS1);
+        }
+        if (info->dest & DEST_RS2)
+        {
+            cpu->regs[cpu->writeback.rs2]
+                = get_pointer_update(&cpu->writeback, DEST_RS2);
+        }
 
-            case OPCODE_CMP:
-            case OPCODE_CML:
-			{
-				break;
-			}
+        if (!cpu->forward_flag)
+        {
+            update_scoreboard(cpu, &cpu->writeback, -1);
         }
 
         cpu->insn_completed++;
@@ -1612,7 +650,7 @@ APEX_writeback(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Writeback", &cpu->writeback);
+            print_stage_content(cpu, "Writeback", &cpu->writeback);
         }
 
         if (cpu->writeback.opcode == OPCODE_HALT)
@@ -1624,7 +662,7 @@ APEX_writeback(APEX_CPU *cpu)
         cpu->stalled = 1;
     }
     else{
-        if(!sim){
+        if(!cpu->sim){
           printf("WriteBack        :EMPTY\n");
         }
     }
@@ -1633,6 +671,30 @@ APEX_writeback(APEX_CPU *cpu)
     return 0;
 }
 
+/*
+ * Runs every pipeline stage once, in reverse order. Returns TRUE when HALT
+ * retires in writeback.
+ */
+static int
+APEX_cpu_cycle(APEX_CPU *cpu)
+{
+    if (cpu->ooo)
+    {
+        return APEX_ooo_cycle(cpu);
+    }
+
+    if (APEX_writeback(cpu))
+    {
+        return TRUE;
+    }
+
+    APEX_memory(cpu);
+    APEX_execute(cpu);
+    APEX_decode(cpu);
+    APEX_fetch(cpu);
+    return FALSE;
+}
+
 /*
  * This function creates and initializes APEX cpu.
  *
@@ -1657,6 +719,7 @@ APEX_cpu_init(const char *filename, const int num, const int cycles, const int f
 
     /* Initialize PC, Registers and all pipeline stages */
     cpu->pc = 4000;
+    cpu->sim = 1;
     memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
     memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
     cpu->single_step = ENABLE_SINGLE_STEP;
@@ -1681,7 +744,7 @@ APEX_cpu_init(const char *filename, const int num, const int cycles, const int f
 
         for (i = 0; i < cpu->code_memory_size; ++i)
         {
-            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
+            printf("%-9s %-9d %-9d %-9d %-9d\n", get_opcode_str(cpu->code_memory[i].opcode),
                    cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
                    cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
         }
@@ -1700,15 +763,15 @@ APEX_cpu_init(const char *filename, const int num, const int cycles, const int f
         cpu->showmem = 3;
         cpu->mem = cycles;
         cpu->forward_flag = forward_flag;
-        sim = 1;
+        cpu->sim = 1;
     }
     else if(num == 4){
         cpu->fwd = 4;
         cpu->forward_flag = forward_flag;
-        sim = 0;
+        cpu->sim = 0;
     }
     else{
-        sig = 1;
+        cpu->sig = 1;
     }
 
     /* To start fetch stage */
@@ -1717,6 +780,23 @@ APEX_cpu_init(const char *filename, const int num, const int cycles, const int f
     return cpu;
 }
 
+/*
+ * Advances the CPU by one clock cycle without any terminal I/O. Returns TRUE
+ * once HALT has retired, FALSE otherwise. All simulation state lives in the
+ * APEX_CPU, so independent instances can be stepped from different threads.
+ */
+int
+APEX_cpu_step(APEX_CPU *cpu)
+{
+    if (APEX_cpu_cycle(cpu))
+    {
+        return TRUE;
+    }
+
+    cpu->clock++;
+    return FALSE;
+}
+
 /*
  * APEX CPU simulation loop
  *
@@ -1730,7 +810,7 @@ APEX_cpu_run(APEX_CPU *cpu)
     while (TRUE)
     {
         //printf("sim = %d", sim);
-        if(!sim){
+        if(!cpu->sim){
          if (ENABLE_DEBUG_MESSAGES)
          {
             printf("--------------------------------------------\n");
@@ -1739,18 +819,21 @@ APEX_cpu_run(APEX_CPU *cpu)
          }
         }
 
-        if (APEX_writeback(cpu))
+        if (APEX_cpu_cycle(cpu))
         {
             /* Halt in writeback stage */
             printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            if (cpu->ooo)
+            {
+                APEX_ooo_print_stats(cpu);
+            }
+            if (cpu->btb_size)
+            {
+                APEX_bp_print_stats(cpu);
+            }
             break;
         }
 
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
-
         
         if(cpu->simulate == 1){
             //sim = 0;
@@ -1768,7 +851,7 @@ APEX_cpu_run(APEX_CPU *cpu)
             }
         }
         if(cpu->display == 2){
-            sim = 0;
+            cpu->sim = 0;
            print_reg_file(cpu);
            if(cpu->cycles == cpu->clock){
         
@@ -1784,7 +867,7 @@ APEX_cpu_run(APEX_CPU *cpu)
            }
         }
         if(cpu->fwd == 4){
-            sim = 0;
+            cpu->sim = 0;
             //printf("\n\n entered fwd single\n");
             print_reg_file(cpu);
             printf("Press any key to advance CPU Clock or <q> to quit:\n");
@@ -1797,8 +880,8 @@ APEX_cpu_run(APEX_CPU *cpu)
             }
         }
 
-        if(sig == 1){
-            sim = 0;
+        if(cpu->sig == 1){
+            cpu->sim = 0;
             print_reg_file(cpu);
             printf("Press any key to advance CPU Clock or <q> to quit:\n");
             scanf("%c", &user_prompt_val);
@@ -1821,7 +904,7 @@ APEX_cpu_run(APEX_CPU *cpu)
 
     if(cpu->simulate == 1)
     {
-        sim = 1;
+        cpu->sim = 1;
         if(cpu->cycles > cpu->clock){
             simulate(cpu);
             printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
@@ -11,10 +11,10 @@
 
 #include "apex_macros.h"
 
-/* Format of an APEX instruction  */
+/* Format of an APEX instruction. The mnemonic is not stored; use
+ * get_opcode_str() when displaying. */
 typedef struct APEX_Instruction
 {
-    char opcode_str[128];
     int opcode;
     int rd;
     int rs1;
@@ -23,11 +23,23 @@ typedef struct APEX_Instruction
     int imm;
 } APEX_Instruction;
 
+/* Per-opcode behaviour consulted by every pipeline stage */
+typedef struct APEX_Opcode_Info
+{
+    unsigned char src;             /* SRC_* registers read in decode */
+    unsigned char dest;            /* DEST_* registers written back */
+    unsigned char fu;              /* FU_* class executing the opcode */
+    unsigned char alu;             /* ALU_* operation of FU_ALU opcodes */
+    unsigned char mem;             /* MEM_* data memory access */
+    unsigned char sets_flags;      /* Result updates zero/positive/negative */
+    unsigned char cond;            /* COND_* of FU_BRANCH opcodes */
+    unsigned char latency;         /* Execute cycles */
+} APEX_Opcode_Info;
+
 /* Model of CPU stage latch */
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
     int opcode;
     int rs1;
     int rs2;
@@ -40,8 +52,92 @@ typedef struct CPU_Stage
     int result_buffer;
     int memory_address;
     int has_insn;
+    int pred_pc;                   /* Next PC fetch predicted */
+    int bp_history;                /* Global history the prediction used */
+    int ras_top;                   /* Return address stack after fetch */
+    int ras_count;
 } CPU_Stage;
 
+/* Branch target buffer entry, direct mapped on the PC */
+typedef struct APEX_BTB_Entry
+{
+    int valid;
+    int pc;
+    int target;
+} APEX_BTB_Entry;
+
+typedef struct APEX_BP_Stats
+{
+    int branches;                  /* Resolved control transfers */
+    int taken;
+    int mispredicts;               /* Wrong next PC, flushed in EX */
+    int btb_misses;                /* Fetched transfers missing the BTB */
+    int ras_returns;               /* Fetched returns predicted by the RAS */
+} APEX_BP_Stats;
+
+/* Out-of-order back end: renamed register holding a result or the flags */
+typedef struct APEX_Phys_Reg
+{
+    int value;
+    int flags;                     /* FLAG_* of flag-setting producers */
+    int valid;                     /* Result has been written */
+} APEX_Phys_Reg;
+
+/* Reorder buffer entry, retired in program order */
+typedef struct APEX_ROB_Entry
+{
+    CPU_Stage insn;                /* Operands, result and address */
+    int seq;                       /* Program order */
+    int phys[3];                   /* Renamed rd, rs1 and rs2 destinations, -1 if none */
+    int flags_phys;                /* Renamed flags destination, -1 if none */
+    int flags;                     /* FLAG_* result */
+    int lsq;                       /* LSQ slot of memory instructions */
+    int completed;
+    int rat[RAT_SIZE];             /* Rename table after a branch, for recovery */
+} APEX_ROB_Entry;
+
+/* Issue queue entry, sources are rs1, rs2 and the flags */
+typedef struct APEX_IQ_Entry
+{
+    int rob;
+    int seq;
+    int tag[3];                    /* Physical register awaited */
+    int value[3];
+    int ready[3];
+} APEX_IQ_Entry;
+
+/* Load/store queue entry, kept in program order */
+typedef struct APEX_LSQ_Entry
+{
+    int rob;
+    int seq;
+    int is_store;
+    int addr_valid;                /* Address (and store data) computed */
+    int address;
+    int data;
+    int issued;                    /* Load sent to the memory port */
+} APEX_LSQ_Entry;
+
+/* Functional unit or memory port, busy until its instruction completes */
+typedef struct APEX_OoO_Unit
+{
+    int busy;
+    int rob;
+    int done;                      /* Clock cycle of completion */
+} APEX_OoO_Unit;
+
+typedef struct APEX_OoO_Stats
+{
+    int stall_rob;                 /* Dispatch stall cycles by full structure */
+    int stall_iq;
+    int stall_lsq;
+    int stall_prf;
+    int flushes;                   /* Taken branches */
+    int squashed;                  /* Instructions removed by flushes */
+    int lsq_forwards;              /* Loads served by an older store */
+    int ooo_issues;                /* Issued ahead of an older waiting instruction */
+} APEX_OoO_Stats;
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU
 {
@@ -66,6 +162,8 @@ typedef struct APEX_CPU
     int n_flag;
     int fetch_from_next_cycle;
     int arr[32];
+    int sim;                       /* Suppress per-stage output when set */
+    int sig;                       /* Default single-step mode */
 
     /* Pipeline stages */
     CPU_Stage fetch;
@@ -73,10 +171,64 @@ typedef struct APEX_CPU
     CPU_Stage execute;
     CPU_Stage memory;
     CPU_Stage writeback;
+
+    /* Branch prediction in fetch, BP_* */
+    int bp;
+    int btb_size;
+    APEX_BTB_Entry btb[BTB_SIZE_MAX];
+    unsigned char bimodal[BP_TABLE_SIZE]; /* 2-bit counters, >= 2 predicts taken */
+    unsigned char gshare[BP_TABLE_SIZE];
+    unsigned char chooser[BP_TABLE_SIZE]; /* >= 2 picks gshare */
+    int ghr;                       /* Global history, youngest outcome in bit 0 */
+    int ras[RAS_SIZE];             /* Return addresses pushed by JALR */
+    int ras_link[RAS_SIZE];        /* JALR rd of each entry */
+    int ras_top;                   /* Next free slot, wraps around */
+    int ras_count;
+    APEX_BP_Stats bp_stats;
+
+    /* Out-of-order back end, replaces execute/memory/writeback when set */
+    int ooo;
+    int prf_size;
+    int rob_size;
+    int iq_size;
+    int lsq_size;
+    int seq;                       /* Sequence number of the next dispatch */
+    APEX_Phys_Reg prf[PHY_FILE_MAX];
+    int free_list[PHY_FILE_MAX];
+    int free_count;
+    int rat[RAT_SIZE];             /* Latest physical register, -1 = architectural */
+    APEX_ROB_Entry rob[ROB_SIZE_MAX];
+    int rob_head;
+    int rob_count;
+    APEX_IQ_Entry iq[FU_COUNT][IQ_SIZE_MAX];
+    int iq_count[FU_COUNT];
+    APEX_LSQ_Entry lsq[LSQ_SIZE_MAX];
+    int lsq_head;
+    int lsq_count;
+    APEX_OoO_Unit units[FU_COUNT + 1];
+    APEX_OoO_Stats ooo_stats;
 } APEX_CPU;
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
+const char *get_opcode_str(const int opcode);
+const APEX_Opcode_Info *get_opcode_info(const CPU_Stage *stage);
+int get_pointer_update(const CPU_Stage *stage, int dest);
+int APEX_alu(int op, int a, int b);
+int APEX_get_flags(const APEX_CPU *cpu);
+int APEX_branch_taken(int cond, int flags);
+void APEX_fetch(APEX_CPU *cpu);
+int APEX_bp_parse(const char *name);
+int APEX_bp_configure(APEX_CPU *cpu, int kind, int btb_size);
+int APEX_bp_predict(APEX_CPU *cpu, CPU_Stage *stage);
+int APEX_bp_resolve(APEX_CPU *cpu, const CPU_Stage *stage, int taken,
+                    int target);
+void APEX_bp_print_stats(const APEX_CPU *cpu);
+int APEX_ooo_configure(APEX_CPU *cpu, int prf_size, int rob_size, int iq_size,
+                       int lsq_size);
+int APEX_ooo_cycle(APEX_CPU *cpu);
+void APEX_ooo_print_stats(const APEX_CPU *cpu);
 APEX_CPU *APEX_cpu_init(const char *filename,const int num, const int cycles, const int forward_flag);
+int APEX_cpu_step(APEX_CPU *cpu);
 void APEX_cpu_run(APEX_CPU *cpu);
 void APEX_cpu_stop(APEX_CPU *cpu);
 #endif
@@ -19,6 +19,42 @@
 #define REG_FILE_SIZE 32
 #define PHY_FILE_SIZE 8
 
+/* Out-of-order back end: default and largest physical register file, reorder
+ * buffer, per-FU issue queue and load/store queue sizes */
+#define PHY_FILE_MAX 128
+#define ROB_SIZE 16
+#define ROB_SIZE_MAX 64
+#define IQ_SIZE 8
+#define IQ_SIZE_MAX 32
+#define LSQ_SIZE 8
+#define LSQ_SIZE_MAX 32
+
+/* Rename table slot of the condition flags, after the integer registers */
+#define RAT_FLAGS REG_FILE_SIZE
+#define RAT_SIZE (REG_FILE_SIZE + 1)
+
+/* Condition flags packed into one physical register value */
+#define FLAG_ZERO 0x1
+#define FLAG_POSITIVE 0x2
+#define FLAG_NEGATIVE 0x4
+
+/* Branch predictors of the in-order fetch stage. BP_NONE fetches past
+ * every branch and redirects fetch when one is taken in EX */
+#define BP_NONE 0x0
+#define BP_STATIC 0x1
+#define BP_BIMODAL 0x2
+#define BP_GSHARE 0x3
+#define BP_TOURNAMENT 0x4
+
+/* Global history length, and entries of each 2-bit counter table */
+#define BP_HISTORY_BITS 12
+#define BP_TABLE_SIZE (1 << BP_HISTORY_BITS)
+
+/* Default and largest branch target buffer, return address stack depth */
+#define BTB_SIZE 64
+#define BTB_SIZE_MAX 1024
+#define RAS_SIZE 8
+
 /* Numeric OPCODE identifiers for instructions */
 #define OPCODE_ADD 0x0
 #define OPCODE_SUB 0x1
@@ -45,6 +81,51 @@
 #define OPCODE_BNP 0x16
 #define OPCODE_BN 0x17
 #define OPCODE_BNN 0x18
+#define OPCODE_COUNT 0x19
+
+/* Opcode descriptor: source registers read in decode */
+#define SRC_RS1 0x1
+#define SRC_RS2 0x2
+
+/* Opcode descriptor: registers written back, RS1/RS2 are pointer updates */
+#define DEST_RD 0x1
+#define DEST_RS1 0x2
+#define DEST_RS2 0x4
+
+/* Opcode descriptor: functional unit classes */
+#define FU_NONE 0x0
+#define FU_ALU 0x1
+#define FU_AGU 0x2
+#define FU_BRANCH 0x3
+#define FU_COUNT 0x4
+
+/* Out-of-order unit slot of the data memory port, after the FU classes */
+#define MEM_PORT FU_COUNT
+
+/* Opcode descriptor: ALU operations, the second operand is rs2 or imm */
+#define ALU_NONE 0x0
+#define ALU_ADD 0x1
+#define ALU_SUB 0x2
+#define ALU_MUL 0x3
+#define ALU_AND 0x4
+#define ALU_OR 0x5
+#define ALU_XOR 0x6
+#define ALU_PASS 0x7
+
+/* Opcode descriptor: data memory access in MEM */
+#define MEM_NONE 0x0
+#define MEM_LOAD 0x1
+#define MEM_STORE 0x2
+
+/* Opcode descriptor: branch conditions */
+#define COND_NONE 0x0
+#define COND_ALWAYS 0x1
+#define COND_Z 0x2
+#define COND_NZ 0x3
+#define COND_P 0x4
+#define COND_NP 0x5
+#define COND_N 0x6
+#define COND_NN 0x7
 
 
 /* Set this flag to 1 to enable debug messages */
@@ -0,0 +1,697 @@
+/*
+ * apex_ooo.c
+ * Out-of-order back end of the APEX pipeline
+ *
+ * Fetch is shared with the in-order pipeline. Decode renames and dispatches
+ * one instruction per cycle into the reorder buffer, the issue queue of its
+ * functional unit class and, for memory instructions, the load/store queue:
+ *
+ *   rename     every written register and the condition flags get a free
+ *              physical register; the rename table maps each architectural
+ *              register to its youngest producer, -1 when the committed
+ *              value in cpu->regs is current
+ *   issue      each FU class issues its oldest ready entry when the unit is
+ *              free; results wake up waiting entries when the unit completes
+ *              after the opcode's latency
+ *   memory     the AGU puts addresses and store data in the LSQ; a load goes
+ *              to the memory port once every older store address is known,
+ *              taking the data of the youngest older store to the same
+ *              address if there is one
+ *   commit     the reorder buffer head updates cpu->regs, the flags and data
+ *              memory (stores) and frees its physical registers
+ *
+ * Branches are predicted not taken. A taken branch squashes every younger
+ * instruction when it issues and restores the rename table saved when it
+ * was dispatched.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Index into APEX_ROB_Entry.phys of each DEST_* register */
+static const int dest_regs[3] = {DEST_RD, DEST_RS1, DEST_RS2};
+
+static int
+dest_arch_reg(const CPU_Stage *insn, int i)
+{
+    return i == 0 ? insn->rd : i == 1 ? insn->rs1 : insn->rs2;
+}
+
+/*
+ * Sets the back end sizes and empties it. Returns -1 if a size is out of
+ * range; a LOADP needs two physical registers.
+ */
+int
+APEX_ooo_configure(APEX_CPU *cpu, int prf_size, int rob_size, int iq_size,
+                   int lsq_size)
+{
+    int i;
+
+    if (prf_size < 2 || prf_size > PHY_FILE_MAX || rob_size < 1
+        || rob_size > ROB_SIZE_MAX || iq_size < 1 || iq_size > IQ_SIZE_MAX
+        || lsq_size < 1 || lsq_size > LSQ_SIZE_MAX)
+    {
+        return -1;
+    }
+
+    cpu->ooo = TRUE;
+    cpu->prf_size = prf_size;
+    cpu->rob_size = rob_size;
+    cpu->iq_size = iq_size;
+    cpu->lsq_size = lsq_size;
+
+    for (i = 0; i < prf_size; ++i)
+    {
+        cpu->free_list[i] = prf_size - 1 - i;
+    }
+    cpu->free_count = prf_size;
+    for (i = 0; i < RAT_SIZE; ++i)
+    {
+        cpu->rat[i] = -1;
+    }
+    cpu->rob_head = cpu->rob_count = 0;
+    cpu->lsq_head = cpu->lsq_count = 0;
+    memset(cpu->iq_count, 0, sizeof(cpu->iq_count));
+    memset(cpu->units, 0, sizeof(cpu->units));
+    memset(&cpu->ooo_stats, 0, sizeof(cpu->ooo_stats));
+    return 0;
+}
+
+static APEX_ROB_Entry *
+rob_at(APEX_CPU *cpu, int n)
+{
+    return &cpu->rob[(cpu->rob_head + n) % cpu->rob_size];
+}
+
+static int
+alloc_phys(APEX_CPU *cpu)
+{
+    int p = cpu->free_list[--cpu->free_count];
+
+    cpu->prf[p].valid = FALSE;
+    return p;
+}
+
+/* Returns the physical registers of an entry, the flags share rd's */
+static void
+free_phys(APEX_CPU *cpu, const APEX_ROB_Entry *e)
+{
+    int i;
+
+    for (i = 0; i < 3; ++i)
+    {
+        if (e->phys[i] >= 0)
+        {
+            cpu->free_list[cpu->free_count++] = e->phys[i];
+        }
+    }
+    if (e->flags_phys >= 0 && e->flags_phys != e->phys[0])
+    {
+        cpu->free_list[cpu->free_count++] = e->flags_phys;
+    }
+}
+
+/* Physical registers a dispatch needs */
+static int
+phys_needed(const APEX_Opcode_Info *info)
+{
+    int i, n = 0;
+
+    for (i = 0; i < 3; ++i)
+    {
+        n += (info->dest & dest_regs[i]) != 0;
+    }
+    return n + (info->sets_flags && !(info->dest & DEST_RD));
+}
+
+/* Reads a renamed source into an issue queue slot */
+static void
+rename_source(APEX_CPU *cpu, APEX_IQ_Entry *q, int slot, int arch)
+{
+    int p = cpu->rat[arch];
+
+    q->tag[slot] = p;
+    q->ready[slot] = TRUE;
+    if (p < 0)
+    {
+        q->value[slot] = arch == RAT_FLAGS ? APEX_get_flags(cpu) : cpu->regs[arch];
+    }
+    else if (cpu->prf[p].valid)
+    {
+        q->value[slot] = arch == RAT_FLAGS ? cpu->prf[p].flags : cpu->prf[p].value;
+    }
+    else
+    {
+        q->ready[slot] = FALSE;
+    }
+}
+
+/*
+ * Rename/dispatch stage. Stalls, and keeps fetch stalled, while the reorder
+ * buffer, the issue queue, the LSQ or the free list is full.
+ */
+static void
+ooo_dispatch(APEX_CPU *cpu)
+{
+    const APEX_Opcode_Info *info;
+    APEX_ROB_Entry *e;
+    APEX_IQ_Entry q;
+    int i, idx;
+
+    cpu->stalled = 1;
+    if (!cpu->decode.has_insn)
+    {
+        return;
+    }
+
+    info = get_opcode_info(&cpu->decode);
+    if (cpu->rob_count == cpu->rob_size)
+    {
+        cpu->ooo_stats.stall_rob++;
+        cpu->stalled = 0;
+    }
+    else if (info->fu != FU_NONE && cpu->iq_count[info->fu] == cpu->iq_size)
+    {
+        cpu->ooo_stats.stall_iq++;
+        cpu->stalled = 0;
+    }
+    else if (info->mem != MEM_NONE && cpu->lsq_count == cpu->lsq_size)
+    {
+        cpu->ooo_stats.stall_lsq++;
+        cpu->stalled = 0;
+    }
+    else if (cpu->free_count < phys_needed(info))
+    {
+        cpu->ooo_stats.stall_prf++;
+        cpu->stalled = 0;
+    }
+    if (!cpu->stalled)
+    {
+        return;
+    }
+
+    idx = (cpu->rob_head + cpu->rob_count++) % cpu->rob_size;
+    e = &cpu->rob[idx];
+    e->insn = cpu->decode;
+    e->seq = cpu->seq++;
+    e->completed = info->fu == FU_NONE;
+    e->lsq = -1;
+    e->flags_phys = -1;
+
+    /* Sources are read before this instruction's own destinations rename */
+    q.rob = idx;
+    q.seq = e->seq;
+    for (i = 0; i < 3; ++i)
+    {
+        q.tag[i] = -1;
+        q.value[i] = 0;
+        q.ready[i] = TRUE;
+    }
+    if (info->src & SRC_RS1)
+    {
+        rename_source(cpu, &q, 0, e->insn.rs1);
+    }
+    if (info->src & SRC_RS2)
+    {
+        rename_source(cpu, &q, 1, e->insn.rs2);
+    }
+    if (info->cond != COND_NONE && info->cond != COND_ALWAYS)
+    {
+        rename_source(cpu, &q, 2, RAT_FLAGS);
+    }
+
+    /* Pointer updates rename after rd, like the in-order writeback order */
+    for (i = 0; i < 3; ++i)
+    {
+        e->phys[i] = -1;
+        if (info->dest & dest_regs[i])
+        {
+            e->phys[i] = alloc_phys(cpu);
+            cpu->rat[dest_arch_reg(&e->insn, i)] = e->phys[i];
+        }
+    }
+    if (info->sets_flags)
+    {
+        e->flags_phys = e->phys[0] >= 0 ? e->phys[0] : alloc_phys(cpu);
+        cpu->rat[RAT_FLAGS] = e->flags_phys;
+    }
+
+    if (info->fu == FU_BRANCH)
+    {
+        memcpy(e->rat, cpu->rat, sizeof(e->rat));
+    }
+
+    if (info->mem != MEM_NONE)
+    {
+        APEX_LSQ_Entry *l;
+
+        e->lsq = (cpu->lsq_head + cpu->lsq_count++) % cpu->lsq_size;
+        l = &cpu->lsq[e->lsq];
+        l->rob = idx;
+        l->seq = e->seq;
+        l->is_store = info->mem == MEM_STORE;
+        l->addr_valid = FALSE;
+        l->issued = FALSE;
+    }
+
+    if (info->fu != FU_NONE)
+    {
+        cpu->iq[info->fu][cpu->iq_count[info->fu]++] = q;
+    }
+
+    cpu->decode.has_insn = FALSE;
+}
+
+/* Writes a physical register and wakes up the entries waiting for it */
+static void
+broadcast(APEX_CPU *cpu, int p, int value, int flags)
+{
+    int fu, i, j;
+
+    cpu->prf[p].value = value;
+    cpu->prf[p].flags = flags;
+    cpu->prf[p].valid = TRUE;
+
+    for (fu = 0; fu < FU_COUNT; ++fu)
+    {
+        for (i = 0; i < cpu->iq_count[fu]; ++i)
+        {
+            APEX_IQ_Entry *q = &cpu->iq[fu][i];
+
+            for (j = 0; j < 3; ++j)
+            {
+                if (!q->ready[j] && q->tag[j] == p)
+                {
+                    q->value[j] = j == 2 ? flags : value;
+                    q->ready[j] = TRUE;
+                }
+            }
+        }
+    }
+}
+
+/* Removes every instruction younger than the branch in ROB entry idx */
+static void
+squash_younger(APEX_CPU *cpu, int idx)
+{
+    APEX_ROB_Entry *branch = &cpu->rob[idx];
+    int fu, i, n;
+
+    while (cpu->rob_count > 0)
+    {
+        APEX_ROB_Entry *e = rob_at(cpu, cpu->rob_count - 1);
+
+        if (e == branch)
+        {
+            break;
+        }
+        free_phys(cpu, e);
+        cpu->rob_count--;
+        cpu->ooo_stats.squashed++;
+    }
+
+    for (fu = 0; fu < FU_COUNT; ++fu)
+    {
+        for (i = 0, n = 0; i < cpu->iq_count[fu]; ++i)
+        {
+            if (cpu->iq[fu][i].seq < branch->seq)
+            {
+                cpu->iq[fu][n++] = cpu->iq[fu][i];
+            }
+        }
+        cpu->iq_count[fu] = n;
+    }
+
+    while (cpu->lsq_count > 0
+           && cpu->lsq[(cpu->lsq_head + cpu->lsq_count - 1) % cpu->lsq_size].seq
+              > branch->seq)
+    {
+        cpu->lsq_count--;
+    }
+
+    for (i = 0; i <= FU_COUNT; ++i)
+    {
+        if (cpu->units[i].busy && cpu->rob[cpu->units[i].rob].seq > branch->seq)
+        {
+            cpu->units[i].busy = FALSE;
+        }
+    }
+
+    memcpy(cpu->rat, branch->rat, sizeof(cpu->rat));
+}
+
+/* Reads the operands of an issued entry and does its FU's work */
+static void
+execute_entry(APEX_CPU *cpu, const APEX_IQ_Entry *q)
+{
+    APEX_ROB_Entry *e = &cpu->rob[q->rob];
+    const APEX_Opcode_Info *info = get_opcode_info(&e->insn);
+    int result;
+
+    e->insn.rs1_value = q->value[0];
+    e->insn.rs2_value = q->value[1];
+
+    switch (info->fu)
+    {
+        case FU_ALU:
+        {
+            result = APEX_alu(info->alu, e->insn.rs1_value,
+                              (info->src & SRC_RS2) ? e->insn.rs2_value
+                                                    : e->insn.imm);
+            e->insn.result_buffer = result;
+            e->flags = (result == 0 ? FLAG_ZERO : 0) | (result > 0 ? FLAG_POSITIVE : 0)
+                       | (result < 0 ? FLAG_NEGATIVE : 0);
+            break;
+        }
+
+        case FU_AGU:
+        {
+            /* Loads address off rs1, stores off rs2 */
+            e->insn.memory_address
+                = (info->mem == MEM_STORE ? e->insn.rs2_value : e->insn.rs1_value)
+                  + e->insn.imm;
+            break;
+        }
+
+        case FU_BRANCH:
+        {
+            e->insn.result_buffer = e->insn.pc + 4;
+
+            if (APEX_branch_taken(info->cond, q->value[2]))
+            {
+                cpu->pc = ((info->src & SRC_RS1) ? e->insn.rs1_value : e->insn.pc)
+                          + e->insn.imm;
+                squash_younger(cpu, q->rob);
+                cpu->ooo_stats.flushes++;
+
+                /* Same redirect as the in-order execute stage */
+                cpu->fetch_from_next_cycle = TRUE;
+                cpu->decode.has_insn = FALSE;
+                cpu->fetch.has_insn = TRUE;
+            }
+            break;
+        }
+    }
+}
+
+/*
+ * Issue stage. Branches issue first so a flush never lets a wrong-path
+ * instruction start this cycle.
+ */
+static void
+ooo_issue(APEX_CPU *cpu)
+{
+    static const int order[] = {FU_BRANCH, FU_ALU, FU_AGU};
+    int k, fu, i, j, fu2;
+
+    for (k = 0; k < 3; ++k)
+    {
+        APEX_OoO_Unit *unit;
+        APEX_IQ_Entry q;
+
+        fu = order[k];
+        unit = &cpu->units[fu];
+        if (unit->busy)
+        {
+            continue;
+        }
+
+        for (i = 0; i < cpu->iq_count[fu]; ++i)
+        {
+            if (cpu->iq[fu][i].ready[0] && cpu->iq[fu][i].ready[1]
+                && cpu->iq[fu][i].ready[2])
+            {
+                break;
+            }
+        }
+        if (i == cpu->iq_count[fu])
+        {
+            continue;
+        }
+
+        q = cpu->iq[fu][i];
+        for (j = i; j < cpu->iq_count[fu] - 1; ++j)
+        {
+            cpu->iq[fu][j] = cpu->iq[fu][j + 1];
+        }
+        cpu->iq_count[fu]--;
+
+        /* Older entries still waiting in any queue make this out of order */
+        for (fu2 = 0; fu2 < FU_COUNT; ++fu2)
+        {
+            if (cpu->iq_count[fu2] > 0 && cpu->iq[fu2][0].seq < q.seq)
+            {
+                cpu->ooo_stats.ooo_issues++;
+                break;
+            }
+        }
+
+        unit->busy = TRUE;
+        unit->rob = q.rob;
+        unit->done = cpu->clock + get_opcode_info(&cpu->rob[q.rob].insn)->latency;
+        execute_entry(cpu, &q);
+    }
+}
+
+/* Data of the youngest older store to the load's address. Returns FALSE
+ * while an older store address is unknown. */
+static int
+load_data(APEX_CPU *cpu, int n, int *data)
+{
+    const APEX_LSQ_Entry *load = &cpu->lsq[(cpu->lsq_head + n) % cpu->lsq_size];
+    int i, forwarded = FALSE;
+
+    *data = cpu->data_memory[load->address];
+    for (i = 0; i < n; ++i)
+    {
+        const APEX_LSQ_Entry *l = &cpu->lsq[(cpu->lsq_head + i) % cpu->lsq_size];
+
+        if (!l->is_store)
+        {
+            continue;
+        }
+        if (!l->addr_valid)
+        {
+            return FALSE;
+        }
+        if (l->address == load->address)
+        {
+            *data = l->data;
+            forwarded = TRUE;
+        }
+    }
+
+    cpu->ooo_stats.lsq_forwards += forwarded;
+    return TRUE;
+}
+
+/* Memory stage: sends the oldest load that can go to the memory port */
+static void
+ooo_memory(APEX_CPU *cpu)
+{
+    APEX_OoO_Unit *port = &cpu->units[MEM_PORT];
+    int n;
+
+    if (port->busy)
+    {
+        return;
+    }
+
+    for (n = 0; n < cpu->lsq_count; ++n)
+    {
+        APEX_LSQ_Entry *l = &cpu->lsq[(cpu->lsq_head + n) % cpu->lsq_size];
+
+        if (l->is_store || !l->addr_valid || l->issued)
+        {
+            continue;
+        }
+        if (load_data(cpu, n, &cpu->rob[l->rob].insn.result_buffer))
+        {
+            l->issued = TRUE;
+            port->busy = TRUE;
+            port->rob = l->rob;
+            port->done = cpu->clock + 1;
+        }
+        return;
+    }
+}
+
+/* Completion: units whose latency has elapsed write their results */
+static void
+ooo_complete(APEX_CPU *cpu)
+{
+    int i, j;
+
+    for (i = 0; i <= FU_COUNT; ++i)
+    {
+        APEX_OoO_Unit *unit = &cpu->units[i];
+        APEX_ROB_Entry *e;
+        const APEX_Opcode_Info *info;
+
+        if (!unit->busy || unit->done > cpu->clock)
+        {
+            continue;
+        }
+        unit->busy = FALSE;
+        e = &cpu->rob[unit->rob];
+        info = get_opcode_info(&e->insn);
+
+        if (i == MEM_PORT)
+        {
+            broadcast(cpu, e->phys[0], e->insn.result_buffer, 0);
+            e->completed = TRUE;
+            continue;
+        }
+
+        /* Pointer updates are known once the AGU has read the pointer */
+        for (j = 1; j < 3; ++j)
+        {
+            if (e->phys[j] >= 0)
+            {
+                broadcast(cpu, e->phys[j], get_pointer_update(&e->insn, dest_regs[j]), 0);
+            }
+        }
+
+        if (info->fu == FU_AGU)
+        {
+            APEX_LSQ_Entry *l = &cpu->lsq[e->lsq];
+
+            l->address = e->insn.memory_address;
+            l->data = e->insn.rs1_value;
+            l->addr_valid = TRUE;
+            e->completed = l->is_store;
+            continue;
+        }
+
+        if (e->phys[0] >= 0)
+        {
+            broadcast(cpu, e->phys[0], e->insn.result_buffer, e->flags);
+        }
+        else if (e->flags_phys >= 0)
+        {
+            broadcast(cpu, e->flags_phys, 0, e->flags);
+        }
+        e->completed = TRUE;
+    }
+}
+
+/*
+ * Commit stage: retires the reorder buffer head. Returns TRUE when HALT
+ * commits.
+ */
+static int
+ooo_commit(APEX_CPU *cpu)
+{
+    APEX_ROB_Entry *e;
+    const APEX_Opcode_Info *info;
+    int i, j, arch, p;
+
+    if (cpu->rob_count == 0 || !rob_at(cpu, 0)->completed)
+    {
+        return FALSE;
+    }
+
+    e = rob_at(cpu, 0);
+    info = get_opcode_info(&e->insn);
+
+    for (i = 0; i < 3; ++i)
+    {
+        if (e->phys[i] < 0)
+        {
+            continue;
+        }
+        arch = dest_arch_reg(&e->insn, i);
+        cpu->regs[arch] = cpu->prf[e->phys[i]].value;
+        if (cpu->rat[arch] == e->phys[i])
+        {
+            cpu->rat[arch] = -1;
+        }
+    }
+    if (e->flags_phys >= 0)
+    {
+        p = cpu->prf[e->flags_phys].flags;
+        cpu->zero_flag = (p & FLAG_ZERO) != 0;
+        cpu->p_flag = (p & FLAG_POSITIVE) != 0;
+        cpu->n_flag = (p & FLAG_NEGATIVE) != 0;
+        if (cpu->rat[RAT_FLAGS] == e->flags_phys)
+        {
+            cpu->rat[RAT_FLAGS] = -1;
+        }
+    }
+
+    if (info->mem != MEM_NONE)
+    {
+        const APEX_LSQ_Entry *l = &cpu->lsq[cpu->lsq_head];
+
+        if (l->is_store)
+        {
+            cpu->data_memory[l->address] = l->data;
+        }
+        cpu->lsq_head = (cpu->lsq_head + 1) % cpu->lsq_size;
+        cpu->lsq_count--;
+    }
+
+    /* Freed registers must not come back through a branch's saved table */
+    for (i = 1; i < cpu->rob_count; ++i)
+    {
+        APEX_ROB_Entry *b = rob_at(cpu, i);
+
+        if (get_opcode_info(&b->insn)->fu != FU_BRANCH)
+        {
+            continue;
+        }
+        for (j = 0; j < RAT_SIZE; ++j)
+        {
+            if (b->rat[j] >= 0
+                && (b->rat[j] == e->phys[0] || b->rat[j] == e->phys[1]
+                    || b->rat[j] == e->phys[2] || b->rat[j] == e->flags_phys))
+            {
+                b->rat[j] = -1;
+            }
+        }
+    }
+    free_phys(cpu, e);
+
+    cpu->rob_head = (cpu->rob_head + 1) % cpu->rob_size;
+    cpu->rob_count--;
+    cpu->insn_completed++;
+
+    return e->insn.opcode == OPCODE_HALT;
+}
+
+/*
+ * Runs every out-of-order stage once, in reverse order. Returns TRUE when
+ * HALT commits.
+ */
+int
+APEX_ooo_cycle(APEX_CPU *cpu)
+{
+    if (ooo_commit(cpu))
+    {
+        return TRUE;
+    }
+
+    ooo_complete(cpu);
+    ooo_memory(cpu);
+    ooo_issue(cpu);
+    ooo_dispatch(cpu);
+    APEX_fetch(cpu);
+    return FALSE;
+}
+
+void
+APEX_ooo_print_stats(const APEX_CPU *cpu)
+{
+    const APEX_OoO_Stats *s = &cpu->ooo_stats;
+
+    printf("APEX_CPU: OoO prf = %d rob = %d iq = %d lsq = %d\n", cpu->prf_size,
+           cpu->rob_size, cpu->iq_size, cpu->lsq_size);
+    printf("APEX_CPU: OoO dispatch stalls rob = %d iq = %d lsq = %d prf = %d\n",
+           s->stall_rob, s->stall_iq, s->stall_lsq, s->stall_prf);
+    printf("APEX_CPU: OoO flushes = %d squashed = %d lsq_forwards = %d "
+           "out_of_order_issues = %d\n",
+           s->flushes, s->squashed, s->lsq_forwards, s->ooo_issues);
+}
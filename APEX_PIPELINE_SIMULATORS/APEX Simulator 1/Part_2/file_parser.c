@@ -15,6 +15,51 @@
 #include "apex_cpu.h"
 #include "apex_macros.h"
 
+/* Mnemonics indexed by numeric opcode, used only when displaying */
+static const char *opcode_str_table[] = {
+    [OPCODE_ADD] = "ADD",
+    [OPCODE_SUB] = "SUB",
+    [OPCODE_MUL] = "MUL",
+    [OPCODE_AND] = "AND",
+    [OPCODE_OR] = "OR",
+    [OPCODE_XOR] = "EX-OR",
+    [OPCODE_MOVC] = "MOVC",
+    [OPCODE_LOAD] = "LOAD",
+    [OPCODE_STORE] = "STORE",
+    [OPCODE_BZ] = "BZ",
+    [OPCODE_BNZ] = "BNZ",
+    [OPCODE_HALT] = "HALT",
+    [OPCODE_NOP] = "NOP",
+    [OPCODE_JALR] = "JALR",
+    [OPCODE_JUMP] = "JUMP",
+    [OPCODE_ADDL] = "ADDL",
+    [OPCODE_SUBL] = "SUBL",
+    [OPCODE_CMP] = "CMP",
+    [OPCODE_CML] = "CML",
+    [OPCODE_LOADP] = "LOADP",
+    [OPCODE_STOREP] = "STOREP",
+    [OPCODE_BP] = "BP",
+    [OPCODE_BNP] = "BNP",
+    [OPCODE_BN] = "BN",
+    [OPCODE_BNN] = "BNN",
+};
+
+/*
+ * Returns the mnemonic of a numeric opcode
+ */
+const char *
+get_opcode_str(const int opcode)
+{
+    if (opcode < 0
+        || opcode >= (int)(sizeof(opcode_str_table) / sizeof(opcode_str_table[0]))
+        || !opcode_str_table[opcode])
+    {
+        return "???";
+    }
+
+    return opcode_str_table[opcode];
+}
+
 /*
  * This function is related to parsing input file
  *
@@ -181,13 +226,14 @@ split_opcode_from_insn_string(char *buffer, char tokens[2][128])
 {
     int token_num = 0;
 
-    char *token = strtok(buffer, " ");
+    char *saveptr;
+    char *token = strtok_r(buffer, " ", &saveptr);
 
     while (token != NULL)
     {
         strcpy(tokens[token_num], token);
         token_num++;
-        token = strtok(NULL, " ");
+        token = strtok_r(NULL, " ", &saveptr);
     }
 }
 
@@ -210,17 +256,17 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
 
     split_opcode_from_insn_string(buffer, top_level_tokens);
 
-    char *token = strtok(top_level_tokens[1], ",");
+    char *saveptr;
+    char *token = strtok_r(top_level_tokens[1], ",", &saveptr);
 
     while (token != NULL)
     {
         strcpy(tokens[token_num], token);
         token_num++;
-        token = strtok(NULL, ",");
+        token = strtok_r(NULL, ",", &saveptr);
     }
 
-    strcpy(ins->opcode_str, top_level_tokens[0]);
-    ins->opcode = set_opcode_str(ins->opcode_str);
+    ins->opcode = set_opcode_str(top_level_tokens[0]);
 
     switch (ins->opcode)
     {
@@ -15,26 +15,18 @@ int
 main(int argc, char const *argv[])
 {
     int cmd = 0, cycle = 0,forward_flag=0; 
-    const char* scmd;
+    int i, ooo = 0, prf_size = PHY_FILE_SIZE, rob_size = ROB_SIZE;
+    int iq_size = IQ_SIZE, lsq_size = LSQ_SIZE;
+    int bp = -1, btb_size = BTB_SIZE;
+    const char* scmd = "";
     APEX_CPU *cpu;
     printf(" argc  %d   ",argc);
     //int cmd = 0;
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
-    if(argc != 6)
+    if(argc < 2)
     {
-        if(argc != 5)
-        {
-            if (argc != 4)
-            {   
-                if(argc != 3){
-                    
-                    if(argc !=2){
-                    fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
-                    exit(1);
-                    }
-                }
-            }
-        }
+        fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
+        exit(1);
     }
 
     if(argc > 2){
@@ -74,6 +66,30 @@ main(int argc, char const *argv[])
         
         //printf("Argument = %s cmd = %d\n", argv[2],cmd); 
     }
+    else if(strcmp(scmd, "OoO") == 0 && argc > 3){
+        /* Simulate on the out-of-order back end, options are <name> <size> pairs */
+        cmd = 1;
+        cycle = atoi(argv[3]);
+        ooo = 1;
+        for(i = 4; i + 1 < argc; i += 2){
+            if(strcmp(argv[i], "prf") == 0){
+                prf_size = atoi(argv[i + 1]);
+            }
+            else if(strcmp(argv[i], "rob") == 0){
+                rob_size = atoi(argv[i + 1]);
+            }
+            else if(strcmp(argv[i], "iq") == 0){
+                iq_size = atoi(argv[i + 1]);
+            }
+            else if(strcmp(argv[i], "lsq") == 0){
+                lsq_size = atoi(argv[i + 1]);
+            }
+            else{
+                fprintf(stderr, "APEX_Error: Unknown OoO option %s\n", argv[i]);
+                exit(1);
+            }
+        }
+    }
     else if(strcmp(scmd,"Single_step") == 0){
      //printf("Argument = %s \n", argv[2]);
         cmd = 4;
@@ -82,6 +98,24 @@ main(int argc, char const *argv[])
          //  }
 
     }
+
+    /* In-order runs take <name> <value> pairs after the cycle count */
+    for(i = 4; !ooo && cmd >= 1 && cmd <= 3 && i + 1 < argc; i += 2){
+        if(strcmp(argv[i], "bp") == 0){
+            bp = APEX_bp_parse(argv[i + 1]);
+            if(bp < 0){
+                fprintf(stderr, "APEX_Error: Unknown branch predictor %s\n", argv[i + 1]);
+                exit(1);
+            }
+        }
+        else if(strcmp(argv[i], "btb") == 0){
+            btb_size = atoi(argv[i + 1]);
+        }
+        else{
+            fprintf(stderr, "APEX_Error: Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
    // printf("\narg3 = %d\n", atoi(argv[3]));
     cpu = APEX_cpu_init(argv[1],cmd,cycle,forward_flag);
     if (!cpu)
@@ -90,6 +124,20 @@ main(int argc, char const *argv[])
         exit(1);
     }
 
+    if(ooo && APEX_ooo_configure(cpu, prf_size, rob_size, iq_size, lsq_size) != 0)
+    {
+        fprintf(stderr, "APEX_Error: OoO sizes must be prf 2..%d rob 1..%d iq 1..%d lsq 1..%d\n",
+                PHY_FILE_MAX, ROB_SIZE_MAX, IQ_SIZE_MAX, LSQ_SIZE_MAX);
+        exit(1);
+    }
+
+    if((bp >= 0 || btb_size != BTB_SIZE)
+       && APEX_bp_configure(cpu, bp < 0 ? BP_NONE : bp, btb_size) != 0)
+    {
+        fprintf(stderr, "APEX_Error: BTB size must be 1..%d\n", BTB_SIZE_MAX);
+        exit(1);
+    }
+
     APEX_cpu_run(cpu);
     APEX_cpu_stop(cpu);
     return 0;
@@ -0,0 +1,550 @@
+/*
+ * apex_cache.c
+ * Set-associative cache timing model
+ *
+ * The cache only keeps tags: data always lives in the backing memory, so
+ * a cache can never change what a program computes, only how long each
+ * access takes. An access hitting in the cache takes hit_latency cycles,
+ * a miss hit_latency + miss_latency.
+ *
+ * Write-back caches allocate on a store miss and write a dirty line back
+ * when it is evicted. Write-through caches send every store on to memory
+ * and do not allocate on a store miss, which then costs a hit. Both kinds
+ * of memory write go through a write buffer and add no latency.
+ *
+ * Replacement fills an invalid way first, then evicts by policy:
+ *
+ *   lru     least recently used
+ *   plru    tree pseudo-LRU, one bit per internal node of a binary tree
+ *           over the ways; needs a power-of-two associativity
+ *   random  a per-cache xorshift generator, so runs are reproducible
+ *
+ * With prefetch on, a miss, or the first hit on a prefetched line, also
+ * brings in the next line (tagged next-line prefetch). The prefetch fills
+ * in the background and takes no cycles from the access.
+ *
+ * Misses are also counted per instruction, by code memory index.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cache.h"
+#include "apex_macros.h"
+
+typedef struct APEX_Cache_Line
+{
+    unsigned int tag;
+    int valid;
+    int dirty;
+    int prefetched;                /* Brought in by the prefetcher, not yet used */
+    unsigned int last_use;         /* LRU timestamp */
+} APEX_Cache_Line;
+
+struct APEX_Cache
+{
+    APEX_Cache_Config cfg;
+    int num_sets;
+    int line_shift;                /* log2(line_size) */
+    APEX_Cache_Line *lines;        /* num_sets x assoc */
+    unsigned long long *plru;      /* Tree bits per set, node i is bit i */
+    unsigned int tick;             /* LRU clock */
+    unsigned int seed;             /* Random replacement state */
+    APEX_Cache_Stats stats;
+    int num_pcs;
+    int *pc_misses;                /* Misses per code memory index */
+};
+
+static const char *policy_names[] = {
+    [CACHE_LRU] = "lru",
+    [CACHE_PLRU] = "plru",
+    [CACHE_RANDOM] = "random",
+};
+
+/* Caches start out disabled; the geometry is the one the size option
+ * turns on */
+void
+APEX_cache_default_config(APEX_Cache_Config *cfg)
+{
+    cfg->size = 0;
+    cfg->assoc = 4;
+    cfg->line_size = 4;
+    cfg->policy = CACHE_LRU;
+    cfg->write_back = TRUE;
+    cfg->hit_latency = 1;
+    cfg->miss_latency = 10;
+    cfg->prefetch = FALSE;
+}
+
+/*
+ * Applies a command line or manifest option to cfg. The options of a cache
+ * are prefix (size), prefix_assoc, prefix_line, prefix_repl
+ * (lru|plru|random), prefix_write (wb|wt), prefix_hit, prefix_miss and
+ * prefix_prefetch (y|n).
+ * Returns TRUE if name is one of them, FALSE otherwise. Values are checked
+ * by APEX_cache_create.
+ */
+int
+APEX_cache_parse_option(APEX_Cache_Config *cfg, const char *prefix,
+                        const char *name, const char *value)
+{
+    size_t len = strlen(prefix);
+    int i;
+
+    if (strncmp(name, prefix, len) != 0)
+    {
+        return FALSE;
+    }
+    name += len;
+
+    if (strcmp(name, "") == 0)
+    {
+        cfg->size = atoi(value);
+    }
+    else if (strcmp(name, "_assoc") == 0)
+    {
+        cfg->assoc = atoi(value);
+    }
+    else if (strcmp(name, "_line") == 0)
+    {
+        cfg->line_size = atoi(value);
+    }
+    else if (strcmp(name, "_repl") == 0)
+    {
+        cfg->policy = -1;
+        for (i = CACHE_LRU; i <= CACHE_RANDOM; ++i)
+        {
+            if (strcmp(value, policy_names[i]) == 0)
+            {
+                cfg->policy = i;
+            }
+        }
+    }
+    else if (strcmp(name, "_write") == 0)
+    {
+        cfg->write_back = strcmp(value, "wb") == 0 ? TRUE
+                          : strcmp(value, "wt") == 0 ? FALSE : -1;
+    }
+    else if (strcmp(name, "_hit") == 0)
+    {
+        cfg->hit_latency = atoi(value);
+    }
+    else if (strcmp(name, "_miss") == 0)
+    {
+        cfg->miss_latency = atoi(value);
+    }
+    else if (strcmp(name, "_prefetch") == 0)
+    {
+        cfg->prefetch = (strcmp(value, "y") == 0);
+    }
+    else
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Writes cfg as size/assoc/line/repl/write/hit/miss[/pf], or "off" */
+void
+APEX_cache_format(const APEX_Cache_Config *cfg, char *buf, size_t len)
+{
+    if (cfg->size == 0)
+    {
+        snprintf(buf, len, "off");
+        return;
+    }
+    snprintf(buf, len, "%d/%d/%d/%s/%s/%d/%d%s", cfg->size, cfg->assoc,
+             cfg->line_size,
+             cfg->policy >= CACHE_LRU && cfg->policy <= CACHE_RANDOM
+                 ? policy_names[cfg->policy] : "?",
+             cfg->write_back ? "wb" : "wt", cfg->hit_latency,
+             cfg->miss_latency, cfg->prefetch ? "/pf" : "");
+}
+
+static int
+log2_exact(int n)
+{
+    int shift = 0;
+
+    if (n < 1 || (n & (n - 1)) != 0)
+    {
+        return -1;
+    }
+    while ((1 << shift) < n)
+    {
+        shift++;
+    }
+    return shift;
+}
+
+/*
+ * Creates an empty cache with room for per-PC miss counts of num_pcs
+ * instructions. Returns NULL if the configuration is invalid: size not a
+ * whole number of sets, line size not a power of two, plru with an
+ * associativity that is not a power of two up to 64, or a latency outside
+ * 1..APEX_MAX_CACHE_LATENCY (hit) or 0..APEX_MAX_CACHE_LATENCY (miss).
+ */
+APEX_Cache *
+APEX_cache_create(const APEX_Cache_Config *cfg, int num_pcs)
+{
+    APEX_Cache *cache;
+    int line_shift = log2_exact(cfg->line_size);
+
+    if (cfg->size < 1 || cfg->assoc < 1 || line_shift < 0
+        || cfg->size % (cfg->assoc * cfg->line_size) != 0
+        || cfg->policy < CACHE_LRU || cfg->policy > CACHE_RANDOM
+        || (cfg->policy == CACHE_PLRU
+            && (log2_exact(cfg->assoc) < 0 || cfg->assoc > 64))
+        || (cfg->write_back != TRUE && cfg->write_back != FALSE)
+        || cfg->hit_latency < 1 || cfg->hit_latency > APEX_MAX_CACHE_LATENCY
+        || cfg->miss_latency < 0 || cfg->miss_latency > APEX_MAX_CACHE_LATENCY)
+    {
+        return NULL;
+    }
+
+    cache = calloc(1, sizeof(APEX_Cache));
+    if (!cache)
+    {
+        return NULL;
+    }
+
+    cache->cfg = *cfg;
+    cache->line_shift = line_shift;
+    cache->num_sets = cfg->size / (cfg->assoc * cfg->line_size);
+    cache->num_pcs = num_pcs > 0 ? num_pcs : 0;
+    cache->seed = 2463534242u;
+    cache->lines = calloc((size_t)cache->num_sets * cfg->assoc,
+                          sizeof(APEX_Cache_Line));
+    cache->plru = calloc(cache->num_sets, sizeof(unsigned long long));
+    cache->pc_misses = calloc(cache->num_pcs + 1, sizeof(int));
+    if (!cache->lines || !cache->plru || !cache->pc_misses)
+    {
+        APEX_cache_destroy(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void
+APEX_cache_destroy(APEX_Cache *cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+    free(cache->lines);
+    free(cache->plru);
+    free(cache->pc_misses);
+    free(cache);
+}
+
+const APEX_Cache_Config *
+APEX_cache_config(const APEX_Cache *cache)
+{
+    return &cache->cfg;
+}
+
+const APEX_Cache_Stats *
+APEX_cache_stats(const APEX_Cache *cache)
+{
+    return &cache->stats;
+}
+
+/* Points the tree bits on the path to way away from it */
+static void
+plru_touch(APEX_Cache *cache, int set, int way)
+{
+    int levels = log2_exact(cache->cfg.assoc), node = 1, bit, i;
+
+    for (i = levels - 1; i >= 0; --i)
+    {
+        bit = (way >> i) & 1;
+        if (bit)
+        {
+            cache->plru[set] &= ~(1ULL << node);
+        }
+        else
+        {
+            cache->plru[set] |= 1ULL << node;
+        }
+        node = 2 * node + bit;
+    }
+}
+
+/* Follows the tree bits to the pseudo least recently used way */
+static int
+plru_victim(const APEX_Cache *cache, int set)
+{
+    int levels = log2_exact(cache->cfg.assoc), node = 1, way = 0, bit, i;
+
+    for (i = 0; i < levels; ++i)
+    {
+        bit = (cache->plru[set] >> node) & 1;
+        way = (way << 1) | bit;
+        node = 2 * node + bit;
+    }
+    return way;
+}
+
+static int
+choose_victim(APEX_Cache *cache, int set, const APEX_Cache_Line *ways)
+{
+    int i, victim = 0;
+
+    for (i = 0; i < cache->cfg.assoc; ++i)
+    {
+        if (!ways[i].valid)
+        {
+            return i;
+        }
+    }
+
+    switch (cache->cfg.policy)
+    {
+        case CACHE_PLRU:
+            return plru_victim(cache, set);
+
+        case CACHE_RANDOM:
+            cache->seed ^= cache->seed << 13;
+            cache->seed ^= cache->seed >> 17;
+            cache->seed ^= cache->seed << 5;
+            return cache->seed % cache->cfg.assoc;
+    }
+
+    for (i = 1; i < cache->cfg.assoc; ++i)
+    {
+        if (ways[i].last_use < ways[victim].last_use)
+        {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+/* Returns the way of set holding tag, or -1 */
+static int
+find_way(const APEX_Cache_Line *ways, int assoc, unsigned int tag)
+{
+    int way;
+
+    for (way = 0; way < assoc; ++way)
+    {
+        if (ways[way].valid && ways[way].tag == tag)
+        {
+            return way;
+        }
+    }
+    return -1;
+}
+
+/* Marks way of set most recently used */
+static void
+touch(APEX_Cache *cache, int set, APEX_Cache_Line *ways, int way)
+{
+    ways[way].last_use = cache->tick;
+    if (cache->cfg.policy == CACHE_PLRU)
+    {
+        plru_touch(cache, set, way);
+    }
+}
+
+/* Brings block into its set, evicting a victim. Returns the way */
+static int
+fill(APEX_Cache *cache, unsigned int block)
+{
+    int set = block % cache->num_sets;
+    APEX_Cache_Line *ways = &cache->lines[(size_t)set * cache->cfg.assoc];
+    int way = choose_victim(cache, set, ways);
+
+    if (ways[way].valid && ways[way].dirty)
+    {
+        cache->stats.mem_writes++;
+    }
+    ways[way].tag = block / cache->num_sets;
+    ways[way].valid = TRUE;
+    ways[way].dirty = FALSE;
+    ways[way].prefetched = FALSE;
+    touch(cache, set, ways, way);
+    return way;
+}
+
+/* Next-line prefetch: brings in the line after block unless present */
+static void
+prefetch(APEX_Cache *cache, unsigned int block)
+{
+    int set = (block + 1) % cache->num_sets;
+    APEX_Cache_Line *ways = &cache->lines[(size_t)set * cache->cfg.assoc];
+
+    if (find_way(ways, cache->cfg.assoc, (block + 1) / cache->num_sets) < 0)
+    {
+        ways[fill(cache, block + 1)].prefetched = TRUE;
+        cache->stats.prefetches++;
+    }
+}
+
+/*
+ * Looks up the word at addr, updating tags, replacement state and
+ * statistics. pc_index is the code memory index of the accessing
+ * instruction. Returns the cycles the access takes.
+ */
+int
+APEX_cache_access(APEX_Cache *cache, unsigned int addr, int is_write,
+                  int pc_index)
+{
+    unsigned int block = addr >> cache->line_shift;
+    int set = block % cache->num_sets;
+    APEX_Cache_Line *ways = &cache->lines[(size_t)set * cache->cfg.assoc];
+    int way, latency = cache->cfg.hit_latency, trigger;
+
+    cache->stats.accesses++;
+    cache->tick++;
+    if (is_write && !cache->cfg.write_back)
+    {
+        cache->stats.mem_writes++;
+    }
+
+    way = find_way(ways, cache->cfg.assoc, block / cache->num_sets);
+    trigger = way < 0;
+    if (way >= 0)
+    {
+        cache->stats.hits++;
+        touch(cache, set, ways, way);
+
+        /* First use of a prefetched line keeps the stream going */
+        if (ways[way].prefetched)
+        {
+            ways[way].prefetched = FALSE;
+            cache->stats.prefetch_hits++;
+            trigger = TRUE;
+        }
+    }
+    else
+    {
+        cache->stats.misses++;
+        cache->pc_misses[pc_index >= 0 && pc_index < cache->num_pcs
+                             ? pc_index : cache->num_pcs]++;
+
+        /* Write-through stores that miss go straight to memory */
+        if (!is_write || cache->cfg.write_back)
+        {
+            latency += cache->cfg.miss_latency;
+            way = fill(cache, block);
+        }
+    }
+
+    if (way >= 0 && is_write && cache->cfg.write_back)
+    {
+        ways[way].dirty = TRUE;
+    }
+    if (trigger && cache->cfg.prefetch)
+    {
+        prefetch(cache, block);
+    }
+
+    return latency;
+}
+
+/*
+ * Writes the counters of a cache called name as one "json" member, with
+ * a trailing comma, or as "csv" rows. Per-instruction misses are listed by
+ * their PC in prog for every instruction that missed.
+ */
+void
+APEX_cache_print_stats(const APEX_Cache *cache, FILE *fp, const char *name,
+                       const char *format, const APEX_Program *prog)
+{
+    const APEX_Cache_Stats *st = &cache->stats;
+    char cfg[64];
+    int i, first = TRUE;
+
+    APEX_cache_format(&cache->cfg, cfg, sizeof(cfg));
+    if (strcmp(format, "json") == 0)
+    {
+        fprintf(fp, "  \"%s\": {\"config\": \"%s\", \"accesses\": %d, "
+                "\"hits\": %d, \"misses\": %d, \"miss_rate\": %.4f, "
+                "\"mem_writes\": %d, \"prefetches\": %d, \"prefetch_hits\": %d, "
+                "\"misses_by_pc\": {",
+                name, cfg, st->accesses, st->hits, st->misses,
+                st->accesses ? (double)st->misses / st->accesses : 0.0,
+                st->mem_writes, st->prefetches, st->prefetch_hits);
+        for (i = 0; i < cache->num_pcs; ++i)
+        {
+            if (cache->pc_misses[i])
+            {
+                fprintf(fp, "%s\"%d\": %d", first ? "" : ", ", APEX_program_pc(prog, i),
+                        cache->pc_misses[i]);
+                first = FALSE;
+            }
+        }
+        fprintf(fp, "}},\n");
+        return;
+    }
+
+    fprintf(fp, "%s_config,%s\n", name, cfg);
+    fprintf(fp, "%s_accesses,%d\n", name, st->accesses);
+    fprintf(fp, "%s_hits,%d\n", name, st->hits);
+    fprintf(fp, "%s_misses,%d\n", name, st->misses);
+    fprintf(fp, "%s_mem_writes,%d\n", name, st->mem_writes);
+    fprintf(fp, "%s_prefetches,%d\n", name, st->prefetches);
+    fprintf(fp, "%s_prefetch_hits,%d\n", name, st->prefetch_hits);
+    for (i = 0; i < cache->num_pcs; ++i)
+    {
+        if (cache->pc_misses[i])
+        {
+            fprintf(fp, "%s_misses_pc_%d,%d\n", name, APEX_program_pc(prog, i),
+                    cache->pc_misses[i]);
+        }
+    }
+}
+
+/* Writes tags, replacement state and statistics to fp. Returns 0 on
+ * success, -1 on failure. */
+int
+APEX_cache_save(const APEX_Cache *cache, FILE *fp)
+{
+    size_t num_lines = (size_t)cache->num_sets * cache->cfg.assoc;
+
+    if (fwrite(cache->lines, sizeof(APEX_Cache_Line), num_lines, fp) != num_lines
+        || fwrite(cache->plru, sizeof(unsigned long long), cache->num_sets, fp)
+               != (size_t)cache->num_sets
+        || fwrite(&cache->tick, sizeof(cache->tick), 1, fp) != 1
+        || fwrite(&cache->seed, sizeof(cache->seed), 1, fp) != 1
+        || fwrite(&cache->stats, sizeof(cache->stats), 1, fp) != 1
+        || fwrite(cache->pc_misses, sizeof(int), cache->num_pcs + 1, fp)
+               != (size_t)cache->num_pcs + 1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Reads state written by APEX_cache_save from a cache configured like
+ * like, for the same program, into a new cache. Returns NULL on failure.
+ */
+APEX_Cache *
+APEX_cache_load(const APEX_Cache *like, FILE *fp)
+{
+    APEX_Cache *cache = APEX_cache_create(&like->cfg, like->num_pcs);
+    size_t num_lines;
+
+    if (!cache)
+    {
+        return NULL;
+    }
+
+    num_lines = (size_t)cache->num_sets * cache->cfg.assoc;
+    if (fread(cache->lines, sizeof(APEX_Cache_Line), num_lines, fp) != num_lines
+        || fread(cache->plru, sizeof(unsigned long long), cache->num_sets, fp)
+               != (size_t)cache->num_sets
+        || fread(&cache->tick, sizeof(cache->tick), 1, fp) != 1
+        || fread(&cache->seed, sizeof(cache->seed), 1, fp) != 1
+        || fread(&cache->stats, sizeof(cache->stats), 1, fp) != 1
+        || fread(cache->pc_misses, sizeof(int), cache->num_pcs + 1, fp)
+               != (size_t)cache->num_pcs + 1)
+    {
+        APEX_cache_destroy(cache);
+        return NULL;
+    }
+    return cache;
+}
@@ -0,0 +1,56 @@
+/*
+ * apex_cache.h
+ * Set-associative cache timing model, used as the L1 data cache in front
+ * of data_memory and the instruction cache in front of code_memory
+ */
+#ifndef _APEX_CACHE_H_
+#define _APEX_CACHE_H_
+
+#include <stdio.h>
+
+#include "apex_program.h"
+
+/* Geometry is in words, or instructions for an instruction cache:
+ * memories are word-addressed */
+typedef struct APEX_Cache_Config
+{
+    int size;                      /* Capacity in words, 0 = no cache */
+    int assoc;                     /* Ways per set */
+    int line_size;                 /* Words per line, a power of two */
+    int policy;                    /* CACHE_LRU, CACHE_PLRU or CACHE_RANDOM */
+    int write_back;                /* TRUE: write-back, write-allocate;
+                                    * FALSE: write-through, no-write-allocate */
+    int hit_latency;               /* Cycles an access spends in its stage */
+    int miss_latency;              /* Extra cycles to fill a line on a miss */
+    int prefetch;                  /* Tagged next-line prefetch */
+} APEX_Cache_Config;
+
+typedef struct APEX_Cache_Stats
+{
+    int accesses;
+    int hits;
+    int misses;
+    int mem_writes;                /* Dirty lines evicted (write-back) or
+                                    * stores written through (write-through) */
+    int prefetches;                /* Lines brought in by the prefetcher */
+    int prefetch_hits;             /* Prefetched lines used before eviction */
+} APEX_Cache_Stats;
+
+typedef struct APEX_Cache APEX_Cache;
+
+void APEX_cache_default_config(APEX_Cache_Config *cfg);
+int APEX_cache_parse_option(APEX_Cache_Config *cfg, const char *prefix,
+                            const char *name, const char *value);
+void APEX_cache_format(const APEX_Cache_Config *cfg, char *buf, size_t len);
+APEX_Cache *APEX_cache_create(const APEX_Cache_Config *cfg, int num_pcs);
+void APEX_cache_destroy(APEX_Cache *cache);
+const APEX_Cache_Config *APEX_cache_config(const APEX_Cache *cache);
+const APEX_Cache_Stats *APEX_cache_stats(const APEX_Cache *cache);
+int APEX_cache_access(APEX_Cache *cache, unsigned int addr, int is_write,
+                      int pc_index);
+void APEX_cache_print_stats(const APEX_Cache *cache, FILE *fp,
+                            const char *name, const char *format,
+                            const APEX_Program *prog);
+int APEX_cache_save(const APEX_Cache *cache, FILE *fp);
+APEX_Cache *APEX_cache_load(const APEX_Cache *like, FILE *fp);
+#endif
@@ -0,0 +1,446 @@
+/*
+ * apex_checkpoint.c
+ * Saves and restores the architectural and pipeline state of an APEX_CPU,
+ * so a warmed-up machine can be resumed by many later runs.
+ *
+ * Snapshot layout, host byte order:
+ *
+ *   APEX_Snapshot_Header
+ *   APEX_Snapshot_State
+ *   num_runs x { start, length, length x data word }
+ *   data cache state, see APEX_cache_save, when a data cache is configured
+ *   instruction cache state, likewise
+ *
+ * Data memory is stored as runs of non-zero words of the allocated pages
+ * only, a run never crossing a page; everything not covered by a run
+ * restores as zero.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+typedef struct APEX_Snapshot_Header
+{
+    unsigned int magic;            /* APEX_SNAPSHOT_MAGIC */
+    unsigned int version;          /* APEX_SNAPSHOT_VERSION */
+    unsigned int state_size;       /* sizeof(APEX_Snapshot_State) */
+    unsigned int num_runs;         /* Non-zero data memory runs that follow */
+} APEX_Snapshot_Header;
+
+/* Everything but data memory and the run mode set on the command line */
+typedef struct APEX_Snapshot_State
+{
+    int code_memory_size;          /* Checked against the program on restore */
+    unsigned int code_checksum;
+    int forward_flag;              /* Scoreboard use depends on it */
+    unsigned int mem_size;         /* Data memory words */
+    APEX_FU_Config fu;             /* So do the pending result cycles */
+    APEX_Cache_Config dcache;      /* All zero without a data cache */
+    APEX_Cache_Config icache;      /* Same for the instruction cache */
+    int pc;
+    int clock;
+    int insn_completed;
+    int regs[REG_FILE_SIZE];
+    int stalled;
+    int zero_flag;
+    int fetch_from_next_cycle;
+    int arr[16];
+    int ready_cycle[REG_FILE_SIZE];
+    int flag_ready_cycle;
+    int div_ready_cycle;
+    int fu_drain_cycle;
+    int mem_stall;
+    int fetch_stall;
+    APEX_Stats stats;
+    CPU_Stage fetch;
+    CPU_Stage decode;
+    CPU_Stage execute;
+    CPU_Stage memory;
+    CPU_Stage writeback;
+} APEX_Snapshot_State;
+
+static unsigned int
+fnv1a(unsigned int hash, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t i;
+
+    for (i = 0; i < len; ++i)
+    {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* FNV-1a over the decoded program and its layout, to catch restoring into
+ * another program or one loaded at other addresses */
+static unsigned int
+code_checksum(const APEX_CPU *cpu)
+{
+    const APEX_Program *prog = &cpu->program;
+    unsigned int hash = 2166136261u;
+
+    hash = fnv1a(hash, prog->code, (size_t)prog->size * sizeof(APEX_Instruction));
+    return fnv1a(hash, prog->segments,
+                 (size_t)prog->num_segments * sizeof(APEX_Segment));
+}
+
+static void
+cache_config(const APEX_Cache *cache, APEX_Cache_Config *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    if (cache)
+    {
+        *cfg = *APEX_cache_config(cache);
+    }
+}
+
+static unsigned int
+num_data_pages(const APEX_Memory *mem)
+{
+    return (mem->size - 1) / MEM_PAGE_WORDS + 1;
+}
+
+static int
+count_data_runs(const APEX_CPU *cpu)
+{
+    const int *page;
+    unsigned int p, i;
+    int runs = 0;
+
+    for (p = 0; p < num_data_pages(&cpu->data_memory); ++p)
+    {
+        page = APEX_mem_page(&cpu->data_memory, p << MEM_PAGE_SHIFT);
+        for (i = 0; page && i < MEM_PAGE_WORDS; ++i)
+        {
+            if (page[i] && (i == 0 || !page[i - 1]))
+            {
+                runs++;
+            }
+        }
+    }
+    return runs;
+}
+
+static int
+valid_register(const int reg)
+{
+    return reg >= -1 && reg < REG_FILE_SIZE;
+}
+
+/* TRUE when a restored latch holds a known opcode and registers, whether
+ * it is occupied or a stale copy */
+static int
+valid_latch(const CPU_Stage *stage)
+{
+    return stage->opcode >= 0 && stage->opcode < NUM_OPCODES
+           && valid_register(stage->rd) && valid_register(stage->rs1)
+           && valid_register(stage->rs2) && valid_register(stage->rs3);
+}
+
+/* TRUE when the restored pipeline state can be run: every latch decodes and
+ * each scoreboard entry counts at most one pending write per latch */
+static int
+valid_pipeline(const APEX_Snapshot_State *state)
+{
+    int i;
+
+    if (!valid_latch(&state->fetch) || !valid_latch(&state->decode)
+        || !valid_latch(&state->execute) || !valid_latch(&state->memory)
+        || !valid_latch(&state->writeback))
+    {
+        return FALSE;
+    }
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        if (state->arr[i] < 0 || state->arr[i] > 5)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Writes a snapshot of cpu to filename. Returns 0 on success, -1 on failure.
+ */
+int
+APEX_cpu_save(const APEX_CPU *cpu, const char *filename)
+{
+    FILE *fp;
+    APEX_Snapshot_Header header;
+    APEX_Snapshot_State state;
+    const int *page;
+    unsigned int p;
+    int i, run[2];
+
+    /* Only the scalar pipeline latches are part of a snapshot */
+    if (cpu->width > 1)
+    {
+        fprintf(stderr, "APEX_Error: Snapshots need a width 1 pipeline\n");
+        return -1;
+    }
+
+    fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        return -1;
+    }
+
+    header.magic = APEX_SNAPSHOT_MAGIC;
+    header.version = APEX_SNAPSHOT_VERSION;
+    header.state_size = sizeof(state);
+    header.num_runs = count_data_runs(cpu);
+
+    memset(&state, 0, sizeof(state));
+    state.code_memory_size = cpu->program.size;
+    state.code_checksum = code_checksum(cpu);
+    state.forward_flag = cpu->forward_flag;
+    state.mem_size = cpu->data_memory.size;
+    state.fu = cpu->fu;
+    cache_config(cpu->dcache, &state.dcache);
+    cache_config(cpu->icache, &state.icache);
+    state.pc = cpu->pc;
+    state.clock = cpu->clock;
+    state.insn_completed = cpu->insn_completed;
+    memcpy(state.regs, cpu->regs, sizeof(state.regs));
+    state.stalled = cpu->stalled;
+    state.zero_flag = cpu->zero_flag;
+    state.fetch_from_next_cycle = cpu->fetch_from_next_cycle;
+    memcpy(state.arr, cpu->arr, sizeof(state.arr));
+    memcpy(state.ready_cycle, cpu->ready_cycle, sizeof(state.ready_cycle));
+    state.flag_ready_cycle = cpu->flag_ready_cycle;
+    state.div_ready_cycle = cpu->div_ready_cycle;
+    state.fu_drain_cycle = cpu->fu_drain_cycle;
+    state.mem_stall = cpu->mem_stall;
+    state.fetch_stall = cpu->fetch_stall;
+    state.stats = cpu->stats;
+    state.fetch = cpu->fetch;
+    state.decode = cpu->decode;
+    state.execute = cpu->execute;
+    state.memory = cpu->memory;
+    state.writeback = cpu->writeback;
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1
+        || fwrite(&state, sizeof(state), 1, fp) != 1)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    for (p = 0; p < num_data_pages(&cpu->data_memory); ++p)
+    {
+        page = APEX_mem_page(&cpu->data_memory, p << MEM_PAGE_SHIFT);
+        for (i = 0; page && i < (int)MEM_PAGE_WORDS; i += run[1])
+        {
+            if (!page[i])
+            {
+                run[1] = 1;
+                continue;
+            }
+
+            run[0] = (p << MEM_PAGE_SHIFT) + i;
+            for (run[1] = 1; i + run[1] < (int)MEM_PAGE_WORDS
+                             && page[i + run[1]]; ++run[1])
+                ;
+
+            if (fwrite(run, sizeof(run), 1, fp) != 1
+                || fwrite(&page[i], sizeof(int), run[1], fp) != (size_t)run[1])
+            {
+                fclose(fp);
+                return -1;
+            }
+        }
+    }
+
+    if ((cpu->dcache && APEX_cache_save(cpu->dcache, fp) != 0)
+        || (cpu->icache && APEX_cache_save(cpu->icache, fp) != 0))
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+/*
+ * Loads a snapshot written by APEX_cpu_save into cpu, which must have been
+ * initialized with the same program and forwarding setting. The run mode
+ * (batch, cycle budget, display options) is kept from cpu. Returns 0 on
+ * success, -1 on failure, in which case cpu is left untouched.
+ */
+int
+APEX_cpu_restore(APEX_CPU *cpu, const char *filename)
+{
+    FILE *fp;
+    APEX_Snapshot_Header header;
+    APEX_Snapshot_State state;
+    APEX_Cache_Config dcache, icache;
+    APEX_Cache *warm_dcache, *warm_icache;
+    APEX_Memory data_memory;
+    int words[MEM_PAGE_WORDS];
+    unsigned int i;
+    int run[2], j;
+
+    if (cpu->width > 1)
+    {
+        fprintf(stderr, "APEX_Error: Snapshots need a width 1 pipeline\n");
+        return -1;
+    }
+
+    fp = fopen(filename, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open snapshot %s\n", filename);
+        return -1;
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1
+        || header.magic != APEX_SNAPSHOT_MAGIC
+        || header.version != APEX_SNAPSHOT_VERSION
+        || header.state_size != sizeof(state)
+        || fread(&state, sizeof(state), 1, fp) != 1)
+    {
+        fprintf(stderr, "APEX_Error: %s is not a valid snapshot\n", filename);
+        fclose(fp);
+        return -1;
+    }
+
+    if (state.code_memory_size != cpu->program.size
+        || state.code_checksum != code_checksum(cpu))
+    {
+        fprintf(stderr, "APEX_Error: Snapshot %s was taken from a different program\n",
+                filename);
+        fclose(fp);
+        return -1;
+    }
+
+    if (state.forward_flag != cpu->forward_flag)
+    {
+        fprintf(stderr, "APEX_Error: Snapshot %s was taken with forwarding %s\n",
+                filename, state.forward_flag ? "on" : "off");
+        fclose(fp);
+        return -1;
+    }
+
+    if (memcmp(&state.fu, &cpu->fu, sizeof(state.fu)) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Snapshot %s was taken with other functional units\n",
+                filename);
+        fclose(fp);
+        return -1;
+    }
+
+    cache_config(cpu->dcache, &dcache);
+    cache_config(cpu->icache, &icache);
+    if (memcmp(&state.dcache, &dcache, sizeof(dcache)) != 0
+        || memcmp(&state.icache, &icache, sizeof(icache)) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Snapshot %s was taken with other caches\n",
+                filename);
+        fclose(fp);
+        return -1;
+    }
+
+    if (!valid_pipeline(&state))
+    {
+        fprintf(stderr, "APEX_Error: Snapshot %s holds an invalid pipeline state\n",
+                filename);
+        fclose(fp);
+        return -1;
+    }
+
+    /* A retired HALT leaves an empty pipeline that would never fetch again */
+    if (state.writeback.opcode == OPCODE_HALT && !state.writeback.has_insn)
+    {
+        fprintf(stderr, "APEX_Error: Snapshot %s was taken after HALT\n",
+                filename);
+        fclose(fp);
+        return -1;
+    }
+
+    if (state.mem_size != cpu->data_memory.size)
+    {
+        fprintf(stderr, "APEX_Error: Snapshot %s was taken with %u words of data memory\n",
+                filename, state.mem_size);
+        fclose(fp);
+        return -1;
+    }
+
+    if (APEX_mem_init(&data_memory, state.mem_size) != 0)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    for (i = 0; i < header.num_runs; ++i)
+    {
+        if (fread(run, sizeof(run), 1, fp) != 1
+            || run[0] < 0 || run[1] < 1 || run[1] > (int)MEM_PAGE_WORDS
+            || (unsigned int)run[0] >= data_memory.size
+            || (unsigned int)run[1] > data_memory.size - run[0]
+            || fread(words, sizeof(int), run[1], fp) != (size_t)run[1])
+        {
+            fprintf(stderr, "APEX_Error: Snapshot %s is truncated or corrupt\n",
+                    filename);
+            APEX_mem_free(&data_memory);
+            fclose(fp);
+            return -1;
+        }
+        for (j = 0; j < run[1]; ++j)
+        {
+            APEX_mem_write(&data_memory, run[0] + j, words[j]);
+        }
+    }
+
+    warm_dcache = cpu->dcache ? APEX_cache_load(cpu->dcache, fp) : NULL;
+    warm_icache = cpu->icache ? APEX_cache_load(cpu->icache, fp) : NULL;
+    if ((cpu->dcache && !warm_dcache) || (cpu->icache && !warm_icache))
+    {
+        fprintf(stderr, "APEX_Error: Snapshot %s is truncated or corrupt\n",
+                filename);
+        APEX_cache_destroy(warm_dcache);
+        APEX_cache_destroy(warm_icache);
+        APEX_mem_free(&data_memory);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    APEX_mem_free(&cpu->data_memory);
+    cpu->data_memory = data_memory;
+    if (warm_dcache)
+    {
+        APEX_cache_destroy(cpu->dcache);
+        cpu->dcache = warm_dcache;
+    }
+    if (warm_icache)
+    {
+        APEX_cache_destroy(cpu->icache);
+        cpu->icache = warm_icache;
+    }
+    cpu->pc = state.pc;
+    cpu->clock = state.clock;
+    cpu->insn_completed = state.insn_completed;
+    memcpy(cpu->regs, state.regs, sizeof(cpu->regs));
+    cpu->stalled = state.stalled;
+    cpu->zero_flag = state.zero_flag;
+    cpu->fetch_from_next_cycle = state.fetch_from_next_cycle;
+    memcpy(cpu->arr, state.arr, sizeof(cpu->arr));
+    memcpy(cpu->ready_cycle, state.ready_cycle, sizeof(cpu->ready_cycle));
+    cpu->flag_ready_cycle = state.flag_ready_cycle;
+    cpu->div_ready_cycle = state.div_ready_cycle;
+    cpu->fu_drain_cycle = state.fu_drain_cycle;
+    cpu->mem_stall = state.mem_stall;
+    cpu->fetch_stall = state.fetch_stall;
+    cpu->stats = state.stats;
+    cpu->fetch = state.fetch;
+    cpu->decode = state.decode;
+    cpu->execute = state.execute;
+    cpu->memory = state.memory;
+    cpu->writeback = state.writeback;
+    return 0;
+}
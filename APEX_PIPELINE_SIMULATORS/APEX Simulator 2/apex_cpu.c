@@ -6,26 +6,70 @@
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
  * State University of New York at Binghamton
  */
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "apex_cpu.h"
+#include "apex_trace.h"
 #include "apex_macros.h"
-int sim=1, sig;
-int flag = 1;
-/* Converts the PC(4000 series) into array index for code memory
- *
- * Note: You are not supposed to edit this function
+
+/*
+ * Opcode descriptor table. The scoreboard, functional unit, superscalar and
+ * fast-forward code look up the behaviour of an opcode here.
  */
-static int
-get_code_memory_index_from_pc(const int pc)
+static const APEX_Opcode_Info opcode_table[NUM_OPCODES] = {
+    /*                  src                      dest     fu       mem        addr          flags  cond       lat */
+    [OPCODE_ADD]    = { SRC_RS1|SRC_RS2,         DEST_RD, FU_ALU,  MEM_NONE,  ADDR_NONE,    TRUE,  COND_NONE, 1 },
+    [OPCODE_SUB]    = { SRC_RS1|SRC_RS2,         DEST_RD, FU_ALU,  MEM_NONE,  ADDR_NONE,    TRUE,  COND_NONE, 1 },
+    [OPCODE_MUL]    = { SRC_RS1|SRC_RS2,         DEST_RD, FU_MUL,  MEM_NONE,  ADDR_NONE,    TRUE,  COND_NONE, 0 },
+    [OPCODE_DIV]    = { SRC_RS1|SRC_RS2,         DEST_RD, FU_DIV,  MEM_NONE,  ADDR_NONE,    TRUE,  COND_NONE, 0 },
+    [OPCODE_AND]    = { SRC_RS1|SRC_RS2,         DEST_RD, FU_ALU,  MEM_NONE,  ADDR_NONE,    TRUE,  COND_NONE, 1 },
+    [OPCODE_OR]     = { SRC_RS1|SRC_RS2,         DEST_RD, FU_ALU,  MEM_NONE,  ADDR_NONE,    TRUE,  COND_NONE, 1 },
+    [OPCODE_XOR]    = { SRC_RS1|SRC_RS2,         DEST_RD, FU_ALU,  MEM_NONE,  ADDR_NONE,    TRUE,  COND_NONE, 1 },
+    [OPCODE_ADDL]   = { SRC_RS1,                 DEST_RD, FU_ALU,  MEM_NONE,  ADDR_NONE,    TRUE,  COND_NONE, 1 },
+    [OPCODE_SUBL]   = { SRC_RS1,                 DEST_RD, FU_ALU,  MEM_NONE,  ADDR_NONE,    TRUE,  COND_NONE, 1 },
+    [OPCODE_MOVC]   = { 0,                       DEST_RD, FU_ALU,  MEM_NONE,  ADDR_NONE,    FALSE, COND_NONE, 1 },
+    [OPCODE_CMP]    = { SRC_RS1|SRC_RS2,         0,       FU_ALU,  MEM_NONE,  ADDR_NONE,    TRUE,  COND_NONE, 1 },
+    [OPCODE_LOAD]   = { SRC_RS1,                 DEST_RD, FU_AGU,  MEM_LOAD,  ADDR_RS1_IMM, FALSE, COND_NONE, 1 },
+    [OPCODE_LDR]    = { SRC_RS1|SRC_RS2,         DEST_RD, FU_AGU,  MEM_LOAD,  ADDR_RS1_RS2, FALSE, COND_NONE, 1 },
+    [OPCODE_STORE]  = { SRC_RS1|SRC_RS2,         0,       FU_AGU,  MEM_STORE, ADDR_RS2_IMM, FALSE, COND_NONE, 1 },
+    [OPCODE_STR]    = { SRC_RS1|SRC_RS2|SRC_RS3, 0,       FU_AGU,  MEM_STORE, ADDR_RS1_RS2, FALSE, COND_NONE, 1 },
+    [OPCODE_BZ]     = { 0,                       0,       FU_ALU,  MEM_NONE,  ADDR_NONE,    FALSE, COND_Z,    1 },
+    [OPCODE_BNZ]    = { 0,                       0,       FU_ALU,  MEM_NONE,  ADDR_NONE,    FALSE, COND_NZ,   1 },
+    [OPCODE_NOP]    = { 0,                       0,       FU_NONE, MEM_NONE,  ADDR_NONE,    FALSE, COND_NONE, 1 },
+    [OPCODE_HALT]   = { 0,                       0,       FU_NONE, MEM_NONE,  ADDR_NONE,    FALSE, COND_NONE, 1 },
+};
+
+const APEX_Opcode_Info *
+get_opcode_info(const int opcode)
 {
-    return (pc - 4000) / 4;
+    return &opcode_table[opcode];
 }
 
-static void
-print_instruction(const CPU_Stage *stage)
+/* Data memory address of an access, a store's data is rs1 or rs3 */
+int
+APEX_mem_address(const int addr, const int rs1_value, const int rs2_value,
+                 const int imm)
+{
+    switch (addr)
+    {
+        case ADDR_RS1_IMM:
+            return rs1_value + imm;
+
+        case ADDR_RS2_IMM:
+            return rs2_value + imm;
+
+        case ADDR_RS1_RS2:
+            return rs1_value + rs2_value;
+    }
+    return 0;
+}
+
+/* Prints a latch's instruction in assembly form, also used by apex_trace_dump */
+void
+print_instruction(FILE *fp, const CPU_Stage *stage)
 {
     switch (stage->opcode)
     {
@@ -37,48 +81,48 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_OR:
         case OPCODE_XOR:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
+            fprintf(fp, "%s,R%d,R%d,R%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->rs2);
             break;
         }
 
         case OPCODE_MOVC:
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
+            fprintf(fp, "%s,R%d,#%d ", get_opcode_str(stage->opcode), stage->rd, stage->imm);
             break;
         }
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+            fprintf(fp, "%s,R%d,R%d,#%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->imm);
             break;
         }
 
         case OPCODE_STORE:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
+            fprintf(fp, "%s,R%d,R%d,#%d ", get_opcode_str(stage->opcode), stage->rs1, stage->rs2,
                    stage->imm);
             break;
         }
 
         case OPCODE_LOAD:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+            fprintf(fp, "%s,R%d,R%d,#%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->imm);
             break;
         }
 
         case OPCODE_LDR:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
+            fprintf(fp, "%s,R%d,R%d,R%d ", get_opcode_str(stage->opcode), stage->rd, stage->rs1,
                    stage->rs2);
             break;
         }
 
         case OPCODE_STR:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rs3, stage->rs1,
+            fprintf(fp, "%s,R%d,R%d,R%d ", get_opcode_str(stage->opcode), stage->rs3, stage->rs1,
                    stage->rs2);
             break;
         }
@@ -86,24 +130,24 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_BZ:
         case OPCODE_BNZ:
         {
-            printf("%s,#%d ", stage->opcode_str, stage->imm);
+            fprintf(fp, "%s,#%d ", get_opcode_str(stage->opcode), stage->imm);
             break;
         }
 
 		case OPCODE_CMP:
         {
-            printf("%s,R%d,R%d ", stage->opcode_str, stage->rs1, stage->rs2);
+            fprintf(fp, "%s,R%d,R%d ", get_opcode_str(stage->opcode), stage->rs1, stage->rs2);
             break;
         }
         
         case OPCODE_NOP:
 		{
-			printf("NOP");
+			fprintf(fp, "NOP");
 		}
 
         case OPCODE_HALT:
         {
-            printf("%s", stage->opcode_str);
+            fprintf(fp, "%s", get_opcode_str(stage->opcode));
             break;
         }
     }
@@ -114,11 +158,11 @@ print_instruction(const CPU_Stage *stage)
  * Note: You can edit this function to print in more detail
  */
 static void
-print_stage_content(const char *name, const CPU_Stage *stage)
+print_stage_content(const APEX_CPU *cpu, const char *name, const CPU_Stage *stage)
 {
-    if(!sim){
+    if(!cpu->sim){
     printf("%-15s: pc(%d) ", name, stage->pc);
-    print_instruction(stage);
+    print_instruction(stdout, stage);
     printf("\n");
    }
 
@@ -157,9 +201,9 @@ print_reg_file(const APEX_CPU *cpu)
     printf("\nFlag Contents: Rg.Z = %d\n",cpu->zero_flag);
 
     printf("\n\n========== STATE OF DATA MEMORY ==========\n\n");
-    for(int i = 0; i < 100; i++) {
-        if(cpu->data_memory[i] != 0){
-           printf("|   MEM[%d]\t|\tData Value = %d    |\n", i, cpu->data_memory[i]);
+    for(int i = 0; i < 100 && APEX_mem_in_range(&cpu->data_memory, i); i++) {
+        if(APEX_mem_read(&cpu->data_memory, i) != 0){
+           printf("|   MEM[%d]\t|\tData Value = %d    |\n", i, APEX_mem_read(&cpu->data_memory, i));
         }
     }
 
@@ -175,21 +219,154 @@ simulate(APEX_CPU* cpu)
   }
 
   printf("\n\n========== STATE OF DATA MEMORY ==========\n\n");
-  for(int i = 0; i < 100; i++) {
-    printf("|   MEM[%d]\t|\tData Value = %d    |\n", i, cpu->data_memory[i]);
+  for(int i = 0; i < 100 && APEX_mem_in_range(&cpu->data_memory, i); i++) {
+    printf("|   MEM[%d]\t|\tData Value = %d    |\n", i, APEX_mem_read(&cpu->data_memory, i));
   }
 }
 
 
+static const char *
+fault_type_str(const int type)
+{
+    switch (type)
+    {
+        case FAULT_STORE:
+            return "store";
+
+        case FAULT_FETCH:
+            return "fetch";
+
+        default:
+            return "load";
+    }
+}
+
+/*
+ * Writes the performance counters as "json" or "csv". Returns 0 on success
+ * and -1 for an unknown format.
+ */
+int
+APEX_cpu_print_stats(const APEX_CPU *cpu, FILE *fp, const char *format)
+{
+    const APEX_Stats *st = &cpu->stats;
+    int cycles = cpu->clock - st->ffwd_insns;
+    double ipc = cycles ? (double)(cpu->insn_completed - st->ffwd_insns) / cycles
+                        : 0.0;
+    int i, first = TRUE;
+
+    if (strcmp(format, "json") == 0)
+    {
+        fprintf(fp, "{\n");
+        fprintf(fp, "  \"status\": \"%s\",\n", APEX_status_str(cpu->status));
+        if (cpu->status == APEX_FAULTED)
+        {
+            fprintf(fp, "  \"fault\": {\"type\": \"%s\", \"pc\": %d, "
+                    "\"cycle\": %d, \"address\": %d},\n",
+                    fault_type_str(cpu->fault.type),
+                    cpu->fault.pc, cpu->fault.cycle, cpu->fault.address);
+        }
+        fprintf(fp, "  \"width\": %d,\n", cpu->width);
+        fprintf(fp, "  \"cycles\": %d,\n", cpu->clock);
+        fprintf(fp, "  \"instructions\": %d,\n", cpu->insn_completed);
+        fprintf(fp, "  \"ipc\": %.4f,\n", ipc);
+        fprintf(fp, "  \"stalls\": {\"raw_rs1\": %d, \"raw_rs2\": %d, "
+                "\"raw_rs3\": %d, \"load_use\": %d, \"branch_bubble\": %d, "
+                "\"group_dep\": %d, \"fu_latency\": %d, \"fu_busy\": %d, "
+                "\"dcache\": %d, \"icache\": %d},\n",
+                st->stall_raw_rs1, st->stall_raw_rs2, st->stall_raw_rs3,
+                st->stall_load_use, st->stall_branch_bubble, st->stall_group_dep,
+                st->stall_fu_latency, st->stall_fu_busy, st->stall_dcache,
+                st->stall_icache);
+        fprintf(fp, "  \"forwarded\": {\"execute\": %d, \"writeback\": %d},\n",
+                st->fwd_from_execute, st->fwd_from_writeback);
+        fprintf(fp, "  \"flushes\": %d,\n", st->flushes);
+        fprintf(fp, "  \"ffwd_instructions\": %d,\n", st->ffwd_insns);
+        fprintf(fp, "  \"data_pages\": %u,\n", cpu->data_memory.num_pages);
+        if (cpu->dcache)
+        {
+            APEX_cache_print_stats(cpu->dcache, fp, "dcache", format,
+                                   &cpu->program);
+        }
+        if (cpu->icache)
+        {
+            APEX_cache_print_stats(cpu->icache, fp, "icache", format,
+                                   &cpu->program);
+        }
+        fprintf(fp, "  \"retired\": {");
+        for (i = 0; i < NUM_OPCODES; ++i)
+        {
+            if (st->retired[i])
+            {
+                fprintf(fp, "%s\"%s\": %d", first ? "" : ", ",
+                        get_opcode_str(i), st->retired[i]);
+                first = FALSE;
+            }
+        }
+        fprintf(fp, "}\n}\n");
+        return 0;
+    }
+
+    if (strcmp(format, "csv") == 0)
+    {
+        fprintf(fp, "counter,value\n");
+        fprintf(fp, "status,%s\n", APEX_status_str(cpu->status));
+        if (cpu->status == APEX_FAULTED)
+        {
+            fprintf(fp, "fault_type,%s\n",
+                    fault_type_str(cpu->fault.type));
+            fprintf(fp, "fault_pc,%d\n", cpu->fault.pc);
+            fprintf(fp, "fault_cycle,%d\n", cpu->fault.cycle);
+            fprintf(fp, "fault_address,%d\n", cpu->fault.address);
+        }
+        fprintf(fp, "width,%d\n", cpu->width);
+        fprintf(fp, "cycles,%d\n", cpu->clock);
+        fprintf(fp, "instructions,%d\n", cpu->insn_completed);
+        fprintf(fp, "ipc,%.4f\n", ipc);
+        fprintf(fp, "stall_raw_rs1,%d\n", st->stall_raw_rs1);
+        fprintf(fp, "stall_raw_rs2,%d\n", st->stall_raw_rs2);
+        fprintf(fp, "stall_raw_rs3,%d\n", st->stall_raw_rs3);
+        fprintf(fp, "stall_load_use,%d\n", st->stall_load_use);
+        fprintf(fp, "stall_branch_bubble,%d\n", st->stall_branch_bubble);
+        fprintf(fp, "stall_group_dep,%d\n", st->stall_group_dep);
+        fprintf(fp, "stall_fu_latency,%d\n", st->stall_fu_latency);
+        fprintf(fp, "stall_fu_busy,%d\n", st->stall_fu_busy);
+        fprintf(fp, "stall_dcache,%d\n", st->stall_dcache);
+        fprintf(fp, "stall_icache,%d\n", st->stall_icache);
+        fprintf(fp, "fwd_from_execute,%d\n", st->fwd_from_execute);
+        fprintf(fp, "fwd_from_writeback,%d\n", st->fwd_from_writeback);
+        fprintf(fp, "flushes,%d\n", st->flushes);
+        fprintf(fp, "ffwd_instructions,%d\n", st->ffwd_insns);
+        fprintf(fp, "data_pages,%u\n", cpu->data_memory.num_pages);
+        if (cpu->dcache)
+        {
+            APEX_cache_print_stats(cpu->dcache, fp, "dcache", format,
+                                   &cpu->program);
+        }
+        if (cpu->icache)
+        {
+            APEX_cache_print_stats(cpu->icache, fp, "icache", format,
+                                   &cpu->program);
+        }
+        for (i = 0; i < NUM_OPCODES; ++i)
+        {
+            fprintf(fp, "retired_%s,%d\n", get_opcode_str(i), st->retired[i]);
+        }
+        return 0;
+    }
+
+    return -1;
+}
+
 /*
- * Fetch Stage of APEX Pipeline
+ * Fetch Stage of APEX Pipeline. Returns TRUE when fetch faulted.
  *
  * Note: You are free to edit this function according to your implementation
  */
-static void
+static int
 APEX_fetch(APEX_CPU *cpu)
 {
-    APEX_Instruction *current_ins;
+    const APEX_Instruction *current_ins;
+    int index;
 
     if (cpu->fetch.has_insn)
     {
@@ -198,24 +375,59 @@ APEX_fetch(APEX_CPU *cpu)
         if (cpu->fetch_from_next_cycle == TRUE)
         {
             cpu->fetch_from_next_cycle = FALSE;
+            cpu->fetch_stall = 0;
+            cpu->stats.stall_branch_bubble++;
+            if (cpu->trace)
+            {
+                APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_FETCH,
+                                 &cpu->fetch, TRACE_STALL_BRANCH);
+            }
 
             /* Skip this cycle*/
-            return;
+            return FALSE;
         }
 
-        /* Store current PC in fetch latch */
-        cpu->fetch.pc = cpu->pc;
-
         /* Index into code memory using this pc and copy all instruction fields
          * into fetch latch  */
-        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
+        index = APEX_program_index(&cpu->program, cpu->pc);
+        if (APEX_UNLIKELY(index < 0))
+        {
+            return APEX_fetch_fault(cpu, !cpu->decode.has_insn
+                                             && !cpu->execute.has_insn
+                                             && !cpu->memory.has_insn
+                                             && !cpu->writeback.has_insn);
+        }
+        current_ins = &cpu->program.code[index];
+
+        /* Store current PC in fetch latch */
+        cpu->fetch.pc = cpu->pc;
         cpu->fetch.opcode = current_ins->opcode;
         cpu->fetch.rd = current_ins->rd;
         cpu->fetch.rs1 = current_ins->rs1;
         cpu->fetch.rs2 = current_ins->rs2;
         cpu->fetch.imm = current_ins->imm;
         cpu->fetch.rs3 = current_ins->rs3;
+
+        /* Wait out an instruction cache miss */
+        if (cpu->fetch_stall == 0)
+        {
+            cpu->fetch_stall = APEX_fetch_latency(cpu, cpu->pc, index);
+        }
+        if (--cpu->fetch_stall > 0)
+        {
+            cpu->stats.stall_icache++;
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content(cpu, "Fetch", &cpu->fetch);
+            }
+            if (cpu->trace)
+            {
+                APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_FETCH,
+                                 &cpu->fetch, TRACE_STALL_ICACHE);
+            }
+            return FALSE;
+        }
+
         /* Update PC for next instruction */
         cpu->pc += 4;
 
@@ -224,7 +436,13 @@ APEX_fetch(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Fetch", &cpu->fetch);
+            print_stage_content(cpu, "Fetch", &cpu->fetch);
+        }
+
+        if (cpu->trace)
+        {
+            APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_FETCH,
+                             &cpu->fetch, TRACE_STALL_NONE);
         }
 
         /* Stop fetching new instructions if HALT is fetched */
@@ -235,395 +453,520 @@ APEX_fetch(APEX_CPU *cpu)
     }
     }
     else{
-        if(!sim){
+        if(!cpu->sim){
            printf("Fetch            :EMPTY\n");
         }
     }
+    return FALSE;
 }
 
 /*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Attributes one decode stall cycle to its cause. With forwarding enabled
+ * only loads hold the scoreboard, so every stall is a load-use stall.
  */
 static void
-APEX_decode(APEX_CPU *cpu)
+count_decode_stall(APEX_CPU *cpu)
 {
-    if (cpu->decode.has_insn)
+    const CPU_Stage *stage = &cpu->decode;
+
+    if (cpu->forward_flag)
+    {
+        cpu->stats.stall_load_use++;
+        cpu->stall_reason = TRACE_STALL_LOAD_USE;
+    }
+    else if (cpu->arr[stage->rs1] != 0)
+    {
+        cpu->stats.stall_raw_rs1++;
+        cpu->stall_reason = TRACE_STALL_RAW_RS1;
+    }
+    else if (cpu->arr[stage->rs2] != 0)
+    {
+        cpu->stats.stall_raw_rs2++;
+        cpu->stall_reason = TRACE_STALL_RAW_RS2;
+    }
+    else
+    {
+        cpu->stats.stall_raw_rs3++;
+        cpu->stall_reason = TRACE_STALL_RAW_RS3;
+    }
+}
+
+/*
+ * A load's result_buffer holds its address until MEM, and the execute latch
+ * keeps the load after it moves on, so loads are only forwarded from WB
+ */
+static int
+execute_forwardable(const APEX_CPU *cpu)
+{
+    return get_opcode_info(cpu->execute.opcode)->mem != MEM_LOAD;
+}
+
+/*
+ * TRUE when src holds an instruction whose result is not in the register
+ * file yet. By the time decode runs, execute has passed its instruction
+ * on to MEM, so that latch is live while MEM holds the same instruction.
+ */
+static int
+latch_in_flight(const APEX_CPU *cpu, const CPU_Stage *src)
+{
+    if (src->has_insn)
+    {
+        return TRUE;
+    }
+    return src == &cpu->execute && cpu->memory.has_insn
+           && cpu->memory.pc == cpu->execute.pc;
+}
+
+/* Returns the result held in a later stage latch and counts the forward,
+ * unless the latch is stale and the value really comes from the registers */
+static int
+forward_from(APEX_CPU *cpu, const CPU_Stage *src)
+{
+    if (!latch_in_flight(cpu, src))
+    {
+        return src->result_buffer;
+    }
+
+    if (src == &cpu->execute)
+    {
+        cpu->stats.fwd_from_execute++;
+    }
+    else
+    {
+        cpu->stats.fwd_from_writeback++;
+    }
+
+    return src->result_buffer;
+}
+
+/*
+ * Reads the operands of the instruction in decode, forwarding from later
+ * latches when enabled, and clears cpu->stalled on a scoreboard hazard
+ */
+static void
+decode_operands(APEX_CPU *cpu)
+{
+    switch (cpu->decode.opcode)
     {
-        /* Read operands from register file based on the instruction type */
-        //printf("flag =%d\n", flag);
-        switch (cpu->decode.opcode)
+        
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_NOP:
         {
-            
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-            case OPCODE_NOP:
-            {
-               /* BZ,BNZ and NOP doesn't have register operands */
-               break;
-            }
+           /* BZ,BNZ and NOP doesn't have register operands */
+           break;
+        }
 
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_DIV:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                
-                if(cpu->forward_flag){
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        {
+            cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+            cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
+            
+            if(cpu->forward_flag){
 
-                  if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                    cpu->stalled = 0;
-                        
-                    }
-                    else{
-                        if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
-                          if(cpu->writeback.rd == cpu->decode.rs1){
-                            cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                          }
-                          
-
-                          if(cpu->writeback.rd == cpu->decode.rs2){
-                            cpu->decode.rs2_value = cpu->writeback.result_buffer;
-                          }
-                       }
+              if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
+                {
+                count_decode_stall(cpu);
+                cpu->stalled = 0;
                     
-
-                      if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2){
-                        if(flag){
-                         if(cpu->execute.rd == cpu->decode.rs1){
-                             cpu->decode.rs1_value = cpu->execute.result_buffer;
-                         }
-                        
-                         if(cpu->execute.rd == cpu->decode.rs2){
-                             cpu->decode.rs2_value = cpu->execute.result_buffer;
-                         }
-                            
-                        }
-                        flag = 1;
-                      }
-                        cpu->stalled = 1;
-                    }
                 }
                 else{
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                    cpu->stalled = 0;
-                    }
-                    else{
-                    cpu->arr[cpu->decode.rd]++;
-                    cpu->stalled = 1;
-                    }
-                }
-                
-                
-                break;
-            }
+                    if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
+                      if(cpu->writeback.rd == cpu->decode.rs1){
+                        cpu->decode.rs1_value = forward_from(cpu, &cpu->writeback);
+                      }
+                      
 
-            case OPCODE_LOAD:
-            {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+                      if(cpu->writeback.rd == cpu->decode.rs2){
+                        cpu->decode.rs2_value = forward_from(cpu, &cpu->writeback);
+                      }
+                   }
                 
-                if(cpu->forward_flag){
-                  
 
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        cpu->arr[cpu->decode.rd]++;
-                        if(cpu->writeback.rd == cpu->decode.rs1){
-                           cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                        }
+                  if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2){
+                    if(execute_forwardable(cpu)){
+                     if(cpu->execute.rd == cpu->decode.rs1){
+                         cpu->decode.rs1_value = forward_from(cpu, &cpu->execute);
+                     }
+                    
+                     if(cpu->execute.rd == cpu->decode.rs2){
+                         cpu->decode.rs2_value = forward_from(cpu, &cpu->execute);
+                     }
                         
-                        if(flag){
-                        if(cpu->execute.rd == cpu->decode.rs1){
-                            cpu->decode.rs1_value = cpu->execute.result_buffer;
-                            
-                        }
-                        }
-                        flag = 1;
-                        cpu->stalled = 1; //unstalling
                     }
-
+                  }
+                    cpu->stalled = 1;
+                }
+            }
+            else{
+                if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
+                {
+                count_decode_stall(cpu);
+                cpu->stalled = 0;
                 }
                 else{
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {
-                    cpu->stalled = 0;
-                    }
-                    else{
-                    cpu->arr[cpu->decode.rd]++;
-                    cpu->stalled = 1; //unstalling
-                    }
+                cpu->arr[cpu->decode.rd]++;
+                cpu->stalled = 1;
                 }
-                break;
             }
+            
+            
+            break;
+        }
 
-            case OPCODE_LDR:
-            {
-                
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-
-                if(cpu->forward_flag){
+        case OPCODE_LOAD:
+        {
+            cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+            
+            if(cpu->forward_flag){
+              
 
-                  if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
+                if(cpu->arr[cpu->decode.rs1] != 0)
+                {
+                    count_decode_stall(cpu);
                     cpu->stalled = 0;
-                    }
-                  else{
+                }
+                else{
                     cpu->arr[cpu->decode.rd]++;
-                    if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
-                       if(cpu->writeback.rd == cpu->decode.rs1)
-                         cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                    
-                       if(cpu->writeback.rd == cpu->decode.rs2)
-                         cpu->decode.rs2_value = cpu->writeback.result_buffer;
-
+                    if(cpu->writeback.rd == cpu->decode.rs1){
+                       cpu->decode.rs1_value = forward_from(cpu, &cpu->writeback);
                     }
-
-                   if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2){
-                    if(flag){
-                       if(cpu->execute.rd == cpu->decode.rs1)
-                         cpu->decode.rs1_value = cpu->execute.result_buffer;
                     
-                       if(cpu->execute.rd == cpu->decode.rs2)
-                         cpu->decode.rs2_value = cpu->execute.result_buffer;
+                    if(execute_forwardable(cpu)){
+                    if(cpu->execute.rd == cpu->decode.rs1){
+                        cpu->decode.rs1_value = forward_from(cpu, &cpu->execute);
+                        
                     }
-                    flag = 1;
                     }
-                    cpu->stalled = 1;
-                  }
+                    cpu->stalled = 1; //unstalling
+                }
 
+            }
+            else{
+                if(cpu->arr[cpu->decode.rs1] != 0)
+                {
+                count_decode_stall(cpu);
+                cpu->stalled = 0;
                 }
                 else{
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                    cpu->stalled = 0;
-                    }
-                    else{
-                    cpu->arr[cpu->decode.rd]++;
-                    cpu->stalled = 1;
-                    }
+                cpu->arr[cpu->decode.rd]++;
+                cpu->stalled = 1; //unstalling
                 }
-                
-                break;
             }
+            break;
+        }
 
-            case OPCODE_STORE:
-            {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                
-                if(cpu->forward_flag){
+        case OPCODE_LDR:
+        {
+            
+            cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
+            cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
 
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
-                           if(cpu->writeback.rd == cpu->decode.rs1)
-                             cpu->decode.rs1_value = cpu->writeback.result_buffer;
- 
-                           if(cpu->writeback.rd == cpu->decode.rs2)
-                             cpu->decode.rs2_value = cpu->writeback.result_buffer;
+            if(cpu->forward_flag){
 
-                        }
-                        
-                        if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2){
-                         if(flag){
-                            if(cpu->execute.rd == cpu->decode.rs1)
-                               cpu->decode.rs1_value = cpu->execute.result_buffer;
+              if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
+                {
+                count_decode_stall(cpu);
+                cpu->stalled = 0;
+                }
+              else{
+                cpu->arr[cpu->decode.rd]++;
+                if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
+                   if(cpu->writeback.rd == cpu->decode.rs1)
+                     cpu->decode.rs1_value = forward_from(cpu, &cpu->writeback);
+                
+                   if(cpu->writeback.rd == cpu->decode.rs2)
+                     cpu->decode.rs2_value = forward_from(cpu, &cpu->writeback);
 
-                            if(cpu->execute.rd == cpu->decode.rs2)
-                              cpu->decode.rs2_value = cpu->execute.result_buffer;
+                }
 
-                        }
-                         flag = 1;
-                        }
-                            
-                            cpu->stalled = 1;
-                    }
-                  
+               if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2){
+                if(execute_forwardable(cpu)){
+                   if(cpu->execute.rd == cpu->decode.rs1)
+                     cpu->decode.rs1_value = forward_from(cpu, &cpu->execute);
+                
+                   if(cpu->execute.rd == cpu->decode.rs2)
+                     cpu->decode.rs2_value = forward_from(cpu, &cpu->execute);
+                }
+                }
+                cpu->stalled = 1;
+              }
 
+            }
+            else{
+                if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
+                {
+                count_decode_stall(cpu);
+                cpu->stalled = 0;
                 }
                 else{
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        cpu->stalled = 1;
-                    }
+                cpu->arr[cpu->decode.rd]++;
+                cpu->stalled = 1;
                 }
-                
-                break;
             }
+            
+            break;
+        }
 
-            case OPCODE_CMP:
-            {
-                
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                
-                if(cpu->forward_flag){
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
-                        cpu->stalled = 1;
-                        if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
-                            if(cpu->writeback.rd == cpu->decode.rs1)
-                               cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                            
-                            if(cpu->writeback.rd == cpu->decode.rs2)
-                              cpu->decode.rs2_value = cpu->writeback.result_buffer;
-
-                        }
-                        if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2){
-                          if(flag){
-                            if(cpu->execute.rd == cpu->decode.rs1)
-                                cpu->decode.rs1_value = cpu->execute.result_buffer;
-                            
-                            if(cpu->execute.rd == cpu->decode.rs2)
-                                cpu->decode.rs2_value = cpu->execute.result_buffer;
-                          }
-                          flag = 1;
-                        }
-                    }
-
-                        
+        case OPCODE_STORE:
+        {
+            cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+            cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
+            
+            if(cpu->forward_flag){
 
+                if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
+                {
+                    count_decode_stall(cpu);
+                    cpu->stalled = 0;
                 }
                 else{
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
-                    {
-                        cpu->stalled = 0;
+                    if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
+                       if(cpu->writeback.rd == cpu->decode.rs1)
+                         cpu->decode.rs1_value = forward_from(cpu, &cpu->writeback);
+ 
+                       if(cpu->writeback.rd == cpu->decode.rs2)
+                         cpu->decode.rs2_value = forward_from(cpu, &cpu->writeback);
+
                     }
-                    else{
-                        cpu->stalled = 1;
+                    
+                    if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2){
+                     if(execute_forwardable(cpu)){
+                        if(cpu->execute.rd == cpu->decode.rs1)
+                           cpu->decode.rs1_value = forward_from(cpu, &cpu->execute);
+
+                        if(cpu->execute.rd == cpu->decode.rs2)
+                          cpu->decode.rs2_value = forward_from(cpu, &cpu->execute);
+
                     }
+                    }
+                        
+                        cpu->stalled = 1;
                 }
-                
-                break;
-            }
-
-            case OPCODE_MOVC:
-            {
-                /* MOVC doesn't have register operands */
-                if(cpu->forward_flag){
+              
 
+            }
+            else{
+                if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
+                {
+                    count_decode_stall(cpu);
+                    cpu->stalled = 0;
                 }
                 else{
-                   cpu->arr[cpu->decode.rd]++;
+                    cpu->stalled = 1;
                 }
-                break;
             }
+            
+            break;
+        }
 
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            {
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+        case OPCODE_CMP:
+        {
+            
+            cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
+            cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+            
+            if(cpu->forward_flag){
+                if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
+                {
+                    count_decode_stall(cpu);
+                    cpu->stalled = 0;
+                }
+                else{
+                    cpu->stalled = 1;
+                    if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2){
+                        if(cpu->writeback.rd == cpu->decode.rs1)
+                           cpu->decode.rs1_value = forward_from(cpu, &cpu->writeback);
+                        
+                        if(cpu->writeback.rd == cpu->decode.rs2)
+                          cpu->decode.rs2_value = forward_from(cpu, &cpu->writeback);
 
-                 if(cpu->forward_flag){
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {
-                       cpu->stalled = 0;
                     }
-                    else{
-                        if(cpu->writeback.rd == cpu->decode.rs1){
-                            cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                        }
+                    if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2){
+                      if(execute_forwardable(cpu)){
+                        if(cpu->execute.rd == cpu->decode.rs1)
+                            cpu->decode.rs1_value = forward_from(cpu, &cpu->execute);
                         
-                        if(flag){
-                        if(cpu->execute.rd == cpu->decode.rs1){
-                                cpu->decode.rs1_value = cpu->execute.result_buffer;   
-                        }
-                        flag = 1;
-                        }
-                        cpu->stalled = 1;
+                        if(cpu->execute.rd == cpu->decode.rs2)
+                            cpu->decode.rs2_value = forward_from(cpu, &cpu->execute);
+                      }
                     }
                 }
-                else{
-                    if(cpu->arr[cpu->decode.rs1] != 0)
-                    {
+
+                    
+
+            }
+            else{
+                if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0)
+                {
+                    count_decode_stall(cpu);
                     cpu->stalled = 0;
-                    }
-                    else{
-                    cpu->arr[cpu->decode.rd]++;
+                }
+                else{
                     cpu->stalled = 1;
-                    }
                 }
-                break;
             }
+            
+            break;
+        }
 
-            case OPCODE_STR:
-            {
-                
-                cpu->decode.rs3_value = cpu->regs[cpu->decode.rs3];
-                cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                
-                if(cpu->forward_flag){
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0 || cpu->arr[cpu->decode.rs3] != 0)
-                    {
-                        cpu->stalled = 0;
-                    }
-                    else{
+        case OPCODE_MOVC:
+        {
+            /* MOVC doesn't have register operands */
+            if(cpu->forward_flag){
 
-                        if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2 || cpu->memory.rd == cpu->decode.rs3){
-                            if(cpu->writeback.rd == cpu->decode.rs1)
-                            cpu->decode.rs1_value = cpu->writeback.result_buffer;
-                            
-                            if(cpu->writeback.rd == cpu->decode.rs2)
-                            cpu->decode.rs2_value = cpu->writeback.result_buffer;
-                            
-                            if(cpu->writeback.rd == cpu->decode.rs3)
-                            cpu->decode.rs3_value = cpu->writeback.result_buffer;
-                            
-                        }
+            }
+            else{
+               cpu->arr[cpu->decode.rd]++;
+            }
+            break;
+        }
 
-                        if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2 || cpu->execute.rd == cpu->decode.rs3){
-                          if(flag){
-                            if(cpu->execute.rd == cpu->decode.rs1)
-                                cpu->decode.rs1_value = cpu->execute.result_buffer;
-                            
-                            if(cpu->execute.rd == cpu->decode.rs2)
-                                cpu->decode.rs2_value = cpu->execute.result_buffer;
-                                
-                            if(cpu->execute.rd == cpu->decode.rs3)
-                                cpu->decode.rs3_value = cpu->execute.result_buffer;
-                          }
-                          flag = 1;
-                        }
-                        cpu->stalled = 1;
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        {
+            cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+
+             if(cpu->forward_flag){
+                if(cpu->arr[cpu->decode.rs1] != 0)
+                {
+                   count_decode_stall(cpu);
+                   cpu->stalled = 0;
+                }
+                else{
+                    if(cpu->writeback.rd == cpu->decode.rs1){
+                        cpu->decode.rs1_value = forward_from(cpu, &cpu->writeback);
+                    }
+                    
+                    if(execute_forwardable(cpu)){
+                    if(cpu->execute.rd == cpu->decode.rs1){
+                            cpu->decode.rs1_value = forward_from(cpu, &cpu->execute);   
+                    }
                     }
+                    cpu->stalled = 1;
+                }
+            }
+            else{
+                if(cpu->arr[cpu->decode.rs1] != 0)
+                {
+                count_decode_stall(cpu);
+                cpu->stalled = 0;
+                }
+                else{
+                cpu->arr[cpu->decode.rd]++;
+                cpu->stalled = 1;
+                }
+            }
+            break;
+        }
 
+        case OPCODE_STR:
+        {
+            
+            cpu->decode.rs3_value = cpu->regs[cpu->decode.rs3];
+            cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
+            cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
+            
+            if(cpu->forward_flag){
+                if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0 || cpu->arr[cpu->decode.rs3] != 0)
+                {
+                    count_decode_stall(cpu);
+                    cpu->stalled = 0;
                 }
                 else{
-                    if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0 || cpu->arr[cpu->decode.rs3] != 0)
-                    {
-                        cpu->stalled = 0;
+
+                    if(cpu->writeback.rd == cpu->decode.rs1 || cpu->writeback.rd == cpu->decode.rs2 || cpu->memory.rd == cpu->decode.rs3){
+                        if(cpu->writeback.rd == cpu->decode.rs1)
+                        cpu->decode.rs1_value = forward_from(cpu, &cpu->writeback);
+                        
+                        if(cpu->writeback.rd == cpu->decode.rs2)
+                        cpu->decode.rs2_value = forward_from(cpu, &cpu->writeback);
+                        
+                        if(cpu->writeback.rd == cpu->decode.rs3)
+                        cpu->decode.rs3_value = forward_from(cpu, &cpu->writeback);
                         
                     }
-                    else{
-                        cpu->stalled = 1;
+
+                    if(cpu->execute.rd == cpu->decode.rs1 || cpu->execute.rd == cpu->decode.rs2 || cpu->execute.rd == cpu->decode.rs3){
+                      if(execute_forwardable(cpu)){
+                        if(cpu->execute.rd == cpu->decode.rs1)
+                            cpu->decode.rs1_value = forward_from(cpu, &cpu->execute);
+                        
+                        if(cpu->execute.rd == cpu->decode.rs2)
+                            cpu->decode.rs2_value = forward_from(cpu, &cpu->execute);
+                            
+                        if(cpu->execute.rd == cpu->decode.rs3)
+                            cpu->decode.rs3_value = forward_from(cpu, &cpu->execute);
+                      }
                     }
+                    cpu->stalled = 1;
+                }
+
+            }
+            else{
+                if(cpu->arr[cpu->decode.rs1] != 0 || cpu->arr[cpu->decode.rs2] != 0 || cpu->arr[cpu->decode.rs3] != 0)
+                {
+                    count_decode_stall(cpu);
+                    cpu->stalled = 0;
+                    
+                }
+                else{
+                    cpu->stalled = 1;
                 }
-                break;
-                
             }
+            break;
+            
         }
+    }
+}
+
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_decode(APEX_CPU *cpu)
+{
+    int reason;
+
+    if (cpu->decode.has_insn)
+    {
+        /* Multi-cycle results and a busy divider hold the instruction
+         * before its operands are read, as does Execute held behind a
+         * data cache miss */
+        reason = cpu->execute.has_insn ? TRACE_STALL_DCACHE
+                                       : APEX_fu_hazard(cpu, &cpu->decode);
+        if (reason == TRACE_STALL_DCACHE)
+        {
+            cpu->stall_reason = reason;
+            cpu->stalled = 0;
+        }
+        else if (reason != TRACE_STALL_NONE)
+        {
+            if (reason == TRACE_STALL_FU_BUSY)
+            {
+                cpu->stats.stall_fu_busy++;
+            }
+            else
+            {
+                cpu->stats.stall_fu_latency++;
+            }
+            cpu->stall_reason = reason;
+            cpu->stalled = 0;
+        }
+        else
+        {
+            cpu->stalled = 1;
+            decode_operands(cpu);
+        }
+
         if(cpu->stalled){
            /* Copy data from decode latch to execute latch*/
            cpu->execute = cpu->decode;
@@ -632,17 +975,72 @@ APEX_decode(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Decode/RF", &cpu->decode);
+            print_stage_content(cpu, "Decode/RF", &cpu->decode);
+        }
+
+        if (cpu->trace)
+        {
+            APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_DECODE,
+                             &cpu->decode,
+                             cpu->stalled ? TRACE_STALL_NONE : cpu->stall_reason);
         }
      
     }
     else{
-        if(!sim){
+        if(!cpu->sim){
           printf("Decode           :EMPTY\n");
         }
     }
 }
 
+/*
+ * Computes an arithmetic/logic result and sets the zero flag from it. Shared
+ * by APEX_execute, the superscalar pipeline and the functional fast-forward
+ * interpreter.
+ */
+int
+APEX_alu(APEX_CPU *cpu, const int opcode, const int a, const int b)
+{
+    int result = 0;
+
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+            result = a + b;
+            break;
+
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+            result = a - b;
+            break;
+
+        case OPCODE_MUL:
+            result = a * b;
+            break;
+
+        case OPCODE_DIV:
+            result = a / b;
+            break;
+
+        case OPCODE_AND:
+            result = a & b;
+            break;
+
+        case OPCODE_OR:
+            result = a | b;
+            break;
+
+        case OPCODE_XOR:
+            result = a ^ b;
+            break;
+    }
+
+    /* Set the zero flag based on the result */
+    cpu->zero_flag = (result == 0) ? TRUE : FALSE;
+    return result;
+}
+
 /*
  * Execute Stage of APEX Pipeline
  *
@@ -653,158 +1051,46 @@ APEX_execute(APEX_CPU *cpu)
 {
     if (cpu->execute.has_insn)
     {
-        /* Execute logic based on instruction type */
-        switch (cpu->execute.opcode)
+        /* MEM is still busy with a data cache miss */
+        if (cpu->memory.has_insn)
         {
-            case OPCODE_ADD:
+            if (ENABLE_DEBUG_MESSAGES)
             {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value + cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                break;
+                print_stage_content(cpu, "Execute", &cpu->execute);
             }
-
-            case OPCODE_SUB:
+            if (cpu->trace)
             {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value - cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                break;
+                APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_EXECUTE,
+                                 &cpu->execute, TRACE_STALL_DCACHE);
             }
+            return;
+        }
 
-            case OPCODE_MUL:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value * cpu->execute.rs2_value;
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                break;
-            }
+        APEX_fu_issue(cpu, &cpu->execute);
 
+        /* Execute logic based on instruction type */
+        switch (cpu->execute.opcode)
+        {
+            case OPCODE_ADD:
+            case OPCODE_SUB:
+            case OPCODE_MUL:
             case OPCODE_DIV:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value / cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                break;
-            }
-
             case OPCODE_AND:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value & cpu->execute.rs2_value;
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
-            }
-
             case OPCODE_OR:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value | cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                break;
-            }
-
             case OPCODE_XOR:
             {
                 cpu->execute.result_buffer
-                    = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                }
+                    = APEX_alu(cpu, cpu->execute.opcode,
+                               cpu->execute.rs1_value, cpu->execute.rs2_value);
                 break;
             }
 
             case OPCODE_ADDL:
-            {
-                cpu->execute.result_buffer
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                break;
-            }
-
             case OPCODE_SUBL:
             {
                 cpu->execute.result_buffer
-                    = cpu->execute.rs1_value - cpu->execute.imm;
-
-                
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer != 0)
-                {
-                    cpu->zero_flag = FALSE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = TRUE;
-                }
+                    = APEX_alu(cpu, cpu->execute.opcode,
+                               cpu->execute.rs1_value, cpu->execute.imm);
                 break;
             }
 
@@ -834,6 +1120,7 @@ APEX_execute(APEX_CPU *cpu)
 
                     /* Flush previous stages */
                     cpu->decode.has_insn = FALSE;
+                    cpu->stats.flushes++;
 
                     /* Make sure fetch stage is enabled to start fetching from new PC */
                     cpu->fetch.has_insn = TRUE;
@@ -854,6 +1141,7 @@ APEX_execute(APEX_CPU *cpu)
 
                     /* Flush previous stages */
                     cpu->decode.has_insn = FALSE;
+                    cpu->stats.flushes++;
 
                     /* Make sure fetch stage is enabled to start fetching from new PC */
                     cpu->fetch.has_insn = TRUE;
@@ -903,26 +1191,259 @@ APEX_execute(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Execute", &cpu->execute);
+            print_stage_content(cpu, "Execute", &cpu->execute);
+        }
+
+        if (cpu->trace)
+        {
+            APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_EXECUTE,
+                             &cpu->execute, TRACE_STALL_NONE);
         }
     }
     else{
-        if(!sim){
+        if(!cpu->sim){
            printf("Execute          :EMPTY\n");
         }
     }
 }
 
 /*
- * Memory Stage of APEX Pipeline
+ * Resizes data memory to size words, discarding its contents. Returns 0 on
+ * success and -1 for a size outside 1..APEX_MAX_DATA_MEMORY.
+ */
+int
+APEX_cpu_set_mem_size(APEX_CPU *cpu, const unsigned int size)
+{
+    APEX_Memory mem;
+
+    if (APEX_mem_init(&mem, size) != 0)
+    {
+        return -1;
+    }
+    APEX_mem_free(&cpu->data_memory);
+    cpu->data_memory = mem;
+    return 0;
+}
+
+/*
+ * Writes the words the program preloads (.word) into data memory. Call
+ * after sizing it. Returns 0 on success, -1 after reporting a word outside
+ * data memory.
+ */
+int
+APEX_cpu_load_data(APEX_CPU *cpu)
+{
+    const APEX_Data_Word *word;
+    int i;
+
+    for (i = 0; i < cpu->program.num_data; ++i)
+    {
+        word = &cpu->program.data[i];
+        if (!APEX_mem_in_range(&cpu->data_memory, word->addr))
+        {
+            fprintf(stderr, "APEX_Error: Data word at %u is outside data memory of %u words\n",
+                    word->addr, cpu->data_memory.size);
+            return -1;
+        }
+        APEX_mem_write(&cpu->data_memory, word->addr, word->value);
+    }
+    return 0;
+}
+
+/* Replaces *slot with a cache built from cfg, or none when cfg->size is 0 */
+static int
+replace_cache(APEX_CPU *cpu, APEX_Cache **slot, const APEX_Cache_Config *cfg)
+{
+    APEX_Cache *cache = NULL;
+
+    if (cfg->size != 0)
+    {
+        cache = APEX_cache_create(cfg, cpu->program.size);
+        if (!cache)
+        {
+            return -1;
+        }
+    }
+
+    APEX_cache_destroy(*slot);
+    *slot = cache;
+    return 0;
+}
+
+/*
+ * Installs an L1 data cache built from cfg, or none when cfg->size is 0.
+ * Returns 0 on success and -1 for an invalid configuration.
+ */
+int
+APEX_cpu_set_dcache(APEX_CPU *cpu, const APEX_Cache_Config *cfg)
+{
+    cpu->mem_stall = 0;
+    return replace_cache(cpu, &cpu->dcache, cfg);
+}
+
+/* Same for the instruction cache, whose sizes are in instructions */
+int
+APEX_cpu_set_icache(APEX_CPU *cpu, const APEX_Cache_Config *cfg)
+{
+    cpu->fetch_stall = 0;
+    return replace_cache(cpu, &cpu->icache, cfg);
+}
+
+/* Cycles fetching the instruction at pc, index in code memory, takes: one,
+ * or the instruction cache latency. The cache is addressed by PC word, so
+ * segments far apart never share a line; index only keys the per-PC miss
+ * counters */
+int
+APEX_fetch_latency(APEX_CPU *cpu, const int pc, const int index)
+{
+    if (!cpu->icache)
+    {
+        return 1;
+    }
+    return APEX_cache_access(cpu->icache, (unsigned int)pc / 4, FALSE, index);
+}
+
+/*
+ * Records an out-of-range access by the instruction in stage and stops the
+ * CPU. Kept out of line: it runs at most once per simulation.
+ */
+APEX_COLD void
+APEX_cpu_fault(APEX_CPU *cpu, const CPU_Stage *stage, const int type)
+{
+    cpu->fault.type = type;
+    cpu->fault.pc = stage->pc;
+    cpu->fault.cycle = cpu->clock;
+    cpu->fault.address = stage->memory_address;
+}
+
+/*
+ * Fetch found no instruction at cpu->pc. An older branch still in the
+ * pipeline may redirect fetch, so this only faults once everything behind
+ * fetch has drained; until then fetch waits. Returns TRUE when it faulted.
+ */
+APEX_COLD int
+APEX_fetch_fault(APEX_CPU *cpu, const int drained)
+{
+    CPU_Stage stage;
+
+    if (!drained)
+    {
+        return FALSE;
+    }
+    memset(&stage, 0, sizeof(stage));
+    stage.pc = cpu->pc;
+    stage.memory_address = cpu->pc;
+    APEX_cpu_fault(cpu, &stage, FAULT_FETCH);
+    return TRUE;
+}
+
+/*
+ * Moves the program so execution starts at pc. Returns 0 on success and -1
+ * when a segment would leave the code address range.
+ */
+int
+APEX_cpu_set_code_base(APEX_CPU *cpu, const int pc)
+{
+    if (APEX_program_relocate(&cpu->program, pc) != 0)
+    {
+        return -1;
+    }
+    cpu->pc = pc;
+    return 0;
+}
+
+/*
+ * Links another program into code memory at base, or after the existing
+ * code when base is -1, see APEX_program_add_module. Returns 0 on success,
+ * -1 after reporting an error. Call before configuring the caches, whose
+ * per-PC counters are sized by the program.
+ */
+int
+APEX_cpu_add_module(APEX_CPU *cpu, const char *filename, const int base)
+{
+    return APEX_program_add_module(&cpu->program, filename, base);
+}
+
+/* Name of a cpu->status, as reported by the stats and the sweep */
+const char *
+APEX_status_str(const int status)
+{
+    switch (status)
+    {
+        case APEX_HALTED:
+            return "halt";
+
+        case APEX_FAULTED:
+            return "fault";
+
+        default:
+            return "budget";
+    }
+}
+
+/* Cycles the instruction in stage spends in MEM: one, or the data cache
+ * latency of a load or store. Returns 0 after recording a fault when the
+ * access is outside data memory */
+int
+APEX_memory_latency(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    int mem = get_opcode_info(stage->opcode)->mem;
+    int is_write = (mem == MEM_STORE);
+
+    if (mem == MEM_NONE)
+    {
+        return 1;
+    }
+
+    if (!APEX_mem_in_range(&cpu->data_memory, stage->memory_address))
+    {
+        APEX_cpu_fault(cpu, stage, is_write ? FAULT_STORE : FAULT_LOAD);
+        return 0;
+    }
+
+    if (!cpu->dcache)
+    {
+        return 1;
+    }
+    return APEX_cache_access(cpu->dcache, stage->memory_address, is_write,
+                             APEX_program_index(&cpu->program, stage->pc));
+}
+
+/*
+ * Memory Stage of APEX Pipeline. Returns TRUE when the access faulted, which
+ * leaves the instruction in the memory latch.
  *
  * Note: You are free to edit this function according to your implementation
  */
-static void
+static int
 APEX_memory(APEX_CPU *cpu)
 {
     if (cpu->memory.has_insn)
     {
+        /* The access happens, and its data moves, in the last cycle */
+        if (cpu->mem_stall == 0)
+        {
+            cpu->mem_stall = APEX_memory_latency(cpu, &cpu->memory);
+            if (APEX_UNLIKELY(cpu->mem_stall == 0))
+            {
+                return TRUE;
+            }
+        }
+        if (--cpu->mem_stall > 0)
+        {
+            cpu->stats.stall_dcache++;
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content(cpu, "Memory", &cpu->memory);
+            }
+            if (cpu->trace)
+            {
+                APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_MEMORY,
+                                 &cpu->memory, TRACE_STALL_DCACHE);
+            }
+            return FALSE;
+        }
+
         switch (cpu->memory.opcode)
         {
             case OPCODE_ADD:
@@ -950,13 +1471,10 @@ APEX_memory(APEX_CPU *cpu)
             {
                 /* Read from data memory */
                 cpu->memory.result_buffer
-                    = cpu->data_memory[cpu->memory.memory_address];
+                    = APEX_mem_read(&cpu->data_memory, cpu->memory.memory_address);
                     
                     if(cpu->forward_flag){
                       cpu->arr[cpu->memory.rd]--;
-                      if(cpu->memory.rd == cpu->decode.rs1 || cpu->memory.rd == cpu->decode.rs2){
-                        flag = 0;
-                      }
                     }
                 break;
             }
@@ -964,26 +1482,25 @@ APEX_memory(APEX_CPU *cpu)
             case OPCODE_STORE:
             {
                 /* Read from data memory */
-                cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
+                APEX_mem_write(&cpu->data_memory, cpu->memory.memory_address,
+                               cpu->memory.rs1_value);
                 break;
             }
 
             case OPCODE_STR:
             {
                 
-                cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs3_value;
+                APEX_mem_write(&cpu->data_memory, cpu->memory.memory_address,
+                               cpu->memory.rs3_value);
                 break;
             }
 
             case OPCODE_LDR:
             {
                 cpu->memory.result_buffer
-                    = cpu->data_memory[cpu->memory.memory_address];
+                    = APEX_mem_read(&cpu->data_memory, cpu->memory.memory_address);
                 if(cpu->forward_flag){
                       cpu->arr[cpu->memory.rd]--;
-                      if(cpu->memory.rd == cpu->decode.rs1 || cpu->memory.rd == cpu->decode.rs2){
-                        flag = 0;
-                      }
                     }
                 break;
             }
@@ -995,14 +1512,21 @@ APEX_memory(APEX_CPU *cpu)
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Memory", &cpu->memory);
+            print_stage_content(cpu, "Memory", &cpu->memory);
+        }
+
+        if (cpu->trace)
+        {
+            APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_MEMORY,
+                             &cpu->memory, TRACE_STALL_NONE);
         }
     }
     else{
-        if(!sim){
+        if(!cpu->sim){
            printf("Memory           :EMPTY\n");
         }
     }
+    return FALSE;
 }
 
 /*
@@ -1015,6 +1539,22 @@ APEX_writeback(APEX_CPU *cpu)
 {
     if (cpu->writeback.has_insn)
     {
+        /* HALT retires once the last multi-cycle result is written */
+        if (cpu->writeback.opcode == OPCODE_HALT && APEX_fu_draining(cpu))
+        {
+            cpu->stats.stall_fu_latency++;
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content(cpu, "Writeback", &cpu->writeback);
+            }
+            if (cpu->trace)
+            {
+                APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_WRITEBACK,
+                                 &cpu->writeback, TRACE_STALL_FU_LATENCY);
+            }
+            return FALSE;
+        }
+
         /* Write result to register file based on instruction type */
         switch (cpu->writeback.opcode)
         {
@@ -1076,11 +1616,18 @@ APEX_writeback(APEX_CPU *cpu)
         }
 
         cpu->insn_completed++;
+        cpu->stats.retired[cpu->writeback.opcode]++;
         cpu->writeback.has_insn = FALSE;
 
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Writeback", &cpu->writeback);
+            print_stage_content(cpu, "Writeback", &cpu->writeback);
+        }
+
+        if (cpu->trace)
+        {
+            APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_WRITEBACK,
+                             &cpu->writeback, TRACE_STALL_NONE);
         }
 
         if (cpu->writeback.opcode == OPCODE_HALT)
@@ -1092,7 +1639,7 @@ APEX_writeback(APEX_CPU *cpu)
         cpu->stalled = 1;
     }
     else{
-        if(!sim){
+        if(!cpu->sim){
           printf("WriteBack        :EMPTY\n");
         }
     }
@@ -1101,6 +1648,38 @@ APEX_writeback(APEX_CPU *cpu)
     return 0;
 }
 
+/*
+ * Runs every pipeline stage once, in reverse order. Returns APEX_HALTED when
+ * HALT retires in writeback, APEX_FAULTED when a memory access faults and
+ * APEX_RUNNING otherwise. A fault ends the cycle with the younger stages
+ * untouched.
+ */
+static int
+APEX_cpu_cycle(APEX_CPU *cpu)
+{
+    if (cpu->width > 1)
+    {
+        return APEX_cpu_cycle_wide(cpu);
+    }
+
+    if (APEX_writeback(cpu))
+    {
+        return APEX_HALTED;
+    }
+
+    if (APEX_memory(cpu))
+    {
+        return APEX_FAULTED;
+    }
+    APEX_execute(cpu);
+    APEX_decode(cpu);
+    if (APEX_fetch(cpu))
+    {
+        return APEX_FAULTED;
+    }
+    return APEX_RUNNING;
+}
+
 /*
  * This function creates and initializes APEX cpu.
  *
@@ -1111,6 +1690,7 @@ APEX_cpu_init(const char *filename, const int num, const int cycles, const int f
 {
     int i;
     APEX_CPU *cpu;
+    APEX_FU_Config fu;
     if (!filename)
     {
         return NULL;
@@ -1123,37 +1703,26 @@ APEX_cpu_init(const char *filename, const int num, const int cycles, const int f
         return NULL;
     }
 
-    /* Initialize PC, Registers and all pipeline stages */
-    cpu->pc = 4000;
+    /* Initialize Registers and all pipeline stages */
+    cpu->sim = 1;
     memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
-    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-    cpu->single_step = ENABLE_SINGLE_STEP;
-
-    /* Parse input file and create code memory */
-    cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
-    if (!cpu->code_memory)
+    if (APEX_mem_init(&cpu->data_memory, DATA_MEMORY_SIZE) != 0)
     {
         free(cpu);
         return NULL;
     }
+    cpu->single_step = ENABLE_SINGLE_STEP;
 
-    if (ENABLE_DEBUG_MESSAGES)
+    /* Map a pre-assembled image if given one, otherwise parse input file and
+     * create code memory. Execution starts at its first instruction */
+    if (APEX_program_load(&cpu->program, filename) != 0)
     {
-        fprintf(stderr,
-                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
-                cpu->code_memory_size);
-        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
-        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
-        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
-               "imm");
-
-        for (i = 0; i < cpu->code_memory_size; ++i)
-        {
-            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
-                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
-                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
-        }
+        APEX_mem_free(&cpu->data_memory);
+        free(cpu);
+        return NULL;
     }
+    cpu->pc = cpu->program.entry;
+
     cpu->clock = 0;
     if(num == 1){
         cpu->simulate = 1;
@@ -1168,23 +1737,231 @@ APEX_cpu_init(const char *filename, const int num, const int cycles, const int f
         cpu->showmem = 3;
         cpu->mem = cycles;
         cpu->forward_flag = forward_flag;
-        sim = 1;
+        cpu->sim = 1;
     }
     else if(num == 4){
         cpu->fwd = 4;
         cpu->forward_flag = forward_flag;
-        sim = 0;
+        cpu->sim = 0;
+    }
+    else if(num == 5){
+        cpu->batch = 1;
+        cpu->cycles = cycles;
+        cpu->forward_flag = forward_flag;
     }
     else{
-        sig = 1;
+        cpu->sig = 1;
+    }
+
+    if (ENABLE_DEBUG_MESSAGES && !cpu->batch)
+    {
+        fprintf(stderr,
+                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
+                cpu->program.size);
+        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
+        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
+        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
+               "imm");
+
+        for (i = 0; i < cpu->program.size; ++i)
+        {
+            printf("%-9s %-9d %-9d %-9d %-9d\n",
+                   get_opcode_str(cpu->program.code[i].opcode),
+                   cpu->program.code[i].rd, cpu->program.code[i].rs1,
+                   cpu->program.code[i].rs2, cpu->program.code[i].imm);
+        }
     }
 
     /* To start fetch stage */
     cpu->stalled = 1;
     cpu->fetch.has_insn = TRUE;
+    APEX_cpu_set_width(cpu, 1);
+    APEX_fu_default_config(&fu);
+    APEX_fu_configure(cpu, &fu);
     return cpu;
 }
 
+/*
+ * Advances the CPU by one clock cycle without any terminal I/O. Returns
+ * APEX_RUNNING, or the reason the CPU stopped (APEX_HALTED once HALT has
+ * retired, APEX_FAULTED after a memory fault), which is also left in
+ * cpu->status. All simulation state lives in the APEX_CPU, so independent
+ * instances can be stepped from different threads.
+ */
+int
+APEX_cpu_step(APEX_CPU *cpu)
+{
+    cpu->status = APEX_cpu_cycle(cpu);
+    if (cpu->status != APEX_RUNNING)
+    {
+        return cpu->status;
+    }
+
+    cpu->clock++;
+    return APEX_RUNNING;
+}
+
+/*
+ * Functional fast-forward: interprets instructions architecturally, with no
+ * pipeline timing, until the PC reaches target (FFWD_PC) or target
+ * instructions have completed (FFWD_INSN), counting one cycle per
+ * instruction. Opcode semantics are the same as in APEX_execute,
+ * APEX_memory and APEX_writeback.
+ *
+ * Must be called on a freshly initialized CPU. On return the register file,
+ * zero flag and data memory are up to date and the empty pipeline resumes
+ * fetching at cpu->pc. A HALT or an access outside data memory is never
+ * executed here, it is left for the pipeline, which stops or faults on it.
+ * Returns 0 when the target was reached, 1 when stopped at such an
+ * instruction, 2 when the clock reached the batch budget (cpu->cycles, or
+ * INT_MAX without one), -1 when the PC left code memory and -2 when a latch
+ * past fetch already holds an instruction.
+ */
+int
+APEX_cpu_fast_forward(APEX_CPU *cpu, const int until, const int target)
+{
+    const APEX_Instruction *ins;
+    const APEX_Opcode_Info *info;
+    int index, addr, a, b, ret = 0;
+
+    /* fetch.has_insn only says fetching is enabled */
+    if (cpu->decode.has_insn || cpu->execute.has_insn || cpu->memory.has_insn
+        || cpu->writeback.has_insn)
+    {
+        fprintf(stderr, "APEX_Error: Fast-forward needs an empty pipeline\n");
+        return -2;
+    }
+
+    while (TRUE)
+    {
+        if ((until == FFWD_PC && cpu->pc == target)
+            || (until == FFWD_INSN && cpu->insn_completed >= target))
+        {
+            break;
+        }
+        if (cpu->cycles > 0 ? cpu->clock >= cpu->cycles : cpu->clock == INT_MAX)
+        {
+            ret = 2;
+            break;
+        }
+
+        index = APEX_program_index(&cpu->program, cpu->pc);
+        if (index < 0)
+        {
+            ret = -1;
+            break;
+        }
+
+        ins = &cpu->program.code[index];
+        if (ins->opcode == OPCODE_HALT)
+        {
+            ret = 1;
+            break;
+        }
+
+        info = get_opcode_info(ins->opcode);
+        a = (info->src & SRC_RS1) ? cpu->regs[ins->rs1] : 0;
+        b = (info->src & SRC_RS2) ? cpu->regs[ins->rs2] : 0;
+        addr = APEX_mem_address(info->addr, a, b, ins->imm);
+        if (info->mem != MEM_NONE
+            && !APEX_mem_in_range(&cpu->data_memory, addr))
+        {
+            ret = 1;
+            break;
+        }
+
+        cpu->pc += 4;
+        if (info->mem == MEM_LOAD)
+        {
+            cpu->regs[ins->rd] = APEX_mem_read(&cpu->data_memory, addr);
+        }
+        else if (info->mem == MEM_STORE)
+        {
+            APEX_mem_write(&cpu->data_memory, addr,
+                           (info->src & SRC_RS3) ? cpu->regs[ins->rs3] : a);
+        }
+        else if (info->cond != COND_NONE)
+        {
+            if ((info->cond == COND_Z) == (cpu->zero_flag == TRUE))
+            {
+                cpu->pc = cpu->pc - 4 + ins->imm;
+            }
+        }
+        else if (info->dest & DEST_RD)
+        {
+            /* MOVC reads no register, ADDL/SUBL take imm for rs2 */
+            cpu->regs[ins->rd] = !info->src ? ins->imm
+                : APEX_alu(cpu, ins->opcode, a,
+                           (info->src & SRC_RS2) ? b : ins->imm);
+        }
+        else if (info->sets_flags)
+        {
+            /* CMP */
+            cpu->zero_flag = (a == b) ? TRUE : FALSE;
+        }
+
+        cpu->insn_completed++;
+        cpu->clock++;
+        cpu->stats.ffwd_insns++;
+    }
+
+    /* Empty latches must not look like an R0 result to forward into the
+     * first detailed instructions */
+    memset(&cpu->decode, 0, sizeof(cpu->decode));
+    memset(&cpu->execute, 0, sizeof(cpu->execute));
+    memset(&cpu->memory, 0, sizeof(cpu->memory));
+    memset(&cpu->writeback, 0, sizeof(cpu->writeback));
+    cpu->execute.rd = -1;
+    cpu->memory.rd = -1;
+    cpu->writeback.rd = -1;
+    return ret;
+}
+
+static void
+print_fault(const APEX_CPU *cpu)
+{
+    fprintf(stderr, "APEX_Error: Memory fault, %s address %d at pc %d in cycle %d\n",
+            cpu->fault.type == FAULT_FETCH ? "fetch from"
+                : (cpu->fault.type == FAULT_STORE ? "store to" : "load from"),
+            cpu->fault.address, cpu->fault.pc, cpu->fault.cycle);
+}
+
+/*
+ * Non-interactive simulation loop used by batch mode. Runs until HALT
+ * retires, a memory access faults or the cycle budget (cpu->cycles, 0 =
+ * unlimited) is exhausted, without reading stdin or printing per-cycle
+ * state, then prints a one line summary.
+ */
+static void
+APEX_cpu_run_batch(APEX_CPU *cpu)
+{
+    int i;
+
+    /* The budget is checked first: after a fast-forward or a restore the
+     * clock may already have reached it */
+    while (cpu->cycles <= 0 || cpu->clock < cpu->cycles)
+    {
+        if (APEX_cpu_step(cpu))
+        {
+            break;
+        }
+    }
+
+    if (cpu->status == APEX_FAULTED)
+    {
+        print_fault(cpu);
+    }
+    printf("APEX_CPU: Batch %s, cycles = %d instructions = %d Z = %d regs =",
+           cpu->status == APEX_HALTED ? "Complete"
+               : (cpu->status == APEX_FAULTED ? "Faulted" : "Stopped"),
+           cpu->clock, cpu->insn_completed, cpu->zero_flag);
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        printf(" %d", cpu->regs[i]);
+    }
+    printf("\n");
+}
+
 /*
  * APEX CPU simulation loop
  *
@@ -1195,10 +1972,16 @@ APEX_cpu_run(APEX_CPU *cpu)
 {
     char user_prompt_val;
 
+    if (cpu->batch)
+    {
+        APEX_cpu_run_batch(cpu);
+        return;
+    }
+
     while (TRUE)
     {
         //printf("sim = %d", sim);
-        if(!sim){
+        if(!cpu->sim){
          if (ENABLE_DEBUG_MESSAGES)
          {
             printf("--------------------------------------------\n");
@@ -1207,18 +1990,20 @@ APEX_cpu_run(APEX_CPU *cpu)
          }
         }
 
-        if (APEX_writeback(cpu))
+        cpu->status = APEX_cpu_cycle(cpu);
+        if (cpu->status == APEX_FAULTED)
+        {
+            print_fault(cpu);
+            printf("APEX_CPU: Simulation Faulted, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            break;
+        }
+        if (cpu->status == APEX_HALTED)
         {
             /* Halt in writeback stage */
             printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
             break;
         }
 
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
-
         
         if(cpu->simulate == 1){
             //sim = 0;
@@ -1236,7 +2021,7 @@ APEX_cpu_run(APEX_CPU *cpu)
             }
         }
         if(cpu->display == 2){
-            sim = 0;
+            cpu->sim = 0;
            print_reg_file(cpu);
            if(cpu->cycles == cpu->clock){
         
@@ -1252,7 +2037,7 @@ APEX_cpu_run(APEX_CPU *cpu)
            }
         }
         if(cpu->fwd == 4){
-            sim = 0;
+            cpu->sim = 0;
             char inpu[10];
             //printf("\n\n entered fwd single\n");
             print_reg_file(cpu);
@@ -1266,8 +2051,8 @@ APEX_cpu_run(APEX_CPU *cpu)
             }
         }
 
-        if(sig == 1){
-            sim = 0;
+        if(cpu->sig == 1){
+            cpu->sim = 0;
             print_reg_file(cpu);
             printf("Press any key to advance CPU Clock or <q> to quit:\n");
             scanf("%c", &user_prompt_val);
@@ -1285,12 +2070,17 @@ APEX_cpu_run(APEX_CPU *cpu)
     }
 
     if(cpu->showmem == 3){
-        printf("Data at location |    M[%d] = %d   |\n",cpu->mem,cpu->data_memory[cpu->mem]);
+        if(APEX_mem_in_range(&cpu->data_memory, cpu->mem)){
+            printf("Data at location |    M[%d] = %d   |\n",cpu->mem,APEX_mem_read(&cpu->data_memory, cpu->mem));
+        }
+        else{
+            fprintf(stderr, "APEX_Error: M[%d] is outside data memory\n", cpu->mem);
+        }
     }
 
     if(cpu->simulate == 1)
     {
-        sim = 1;
+        cpu->sim = 1;
         if(cpu->cycles > cpu->clock){
             simulate(cpu);
             printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
@@ -1306,6 +2096,9 @@ APEX_cpu_run(APEX_CPU *cpu)
 void
 APEX_cpu_stop(APEX_CPU *cpu)
 {
-    free(cpu->code_memory);
+    APEX_program_free(&cpu->program);
+    APEX_cache_destroy(cpu->dcache);
+    APEX_cache_destroy(cpu->icache);
+    APEX_mem_free(&cpu->data_memory);
     free(cpu);
 }
\ No newline at end of file
@@ -9,25 +9,18 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
-#include "apex_macros.h"
+#include <stddef.h>
+#include <stdio.h>
 
-/* Format of an APEX instruction  */
-typedef struct APEX_Instruction
-{
-    char opcode_str[128];
-    int opcode;
-    int rd;
-    int rs1;
-    int rs2;
-    int rs3;
-    int imm;
-} APEX_Instruction;
+#include "apex_cache.h"
+#include "apex_macros.h"
+#include "apex_memory.h"
+#include "apex_program.h"
 
 /* Model of CPU stage latch */
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
     int opcode;
     int rs1;
     int rs2;
@@ -42,6 +35,56 @@ typedef struct CPU_Stage
     int has_insn;
 } CPU_Stage;
 
+/* Per-opcode behaviour, see opcode_table in apex_cpu.c */
+typedef struct APEX_Opcode_Info
+{
+    unsigned char src;             /* SRC_* registers read in decode */
+    unsigned char dest;            /* DEST_* registers written back */
+    unsigned char fu;              /* FU_* class executing the opcode */
+    unsigned char mem;             /* MEM_* data memory access */
+    unsigned char addr;            /* ADDR_* operands of the access address */
+    unsigned char sets_flags;      /* Result updates the zero flag */
+    unsigned char cond;            /* COND_* of BZ/BNZ */
+    unsigned char latency;         /* Execute cycles, 0 = the configured unit latency */
+} APEX_Opcode_Info;
+
+/* Functional unit pool. Only the multiplier and divider latencies are
+ * configurable, ALUs and AGUs take one cycle. */
+typedef struct APEX_FU_Config
+{
+    int count[FU_COUNT];           /* Units per class, caps each wide issue group */
+    int latency[FU_COUNT];         /* Execute cycles per class */
+} APEX_FU_Config;
+
+/* Cycle-accurate performance counters */
+typedef struct APEX_Stats
+{
+    int stall_raw_rs1;             /* Decode waiting on a pending rs1 */
+    int stall_raw_rs2;             /* Decode waiting on a pending rs2 */
+    int stall_raw_rs3;             /* Decode waiting on a pending rs3 */
+    int stall_load_use;            /* Forwarding on: waiting on a load result */
+    int stall_branch_bubble;       /* Fetch cycles lost to fetch_from_next_cycle */
+    int stall_group_dep;           /* Wide decode: slot waiting on an older slot of its group */
+    int stall_fu_latency;          /* Waiting on a multi-cycle MUL/DIV result */
+    int stall_fu_busy;             /* Waiting on a busy functional unit */
+    int stall_dcache;              /* MEM cycles spent on data cache misses */
+    int stall_icache;              /* Fetch cycles spent on instruction cache misses */
+    int fwd_from_execute;          /* Operands forwarded from the EX latch */
+    int fwd_from_writeback;        /* Operands forwarded from the WB latch */
+    int flushes;                   /* Taken branches squashing younger stages */
+    int ffwd_insns;                /* Instructions run by the functional fast-forward */
+    int retired[NUM_OPCODES];      /* Retired instructions per opcode */
+} APEX_Stats;
+
+/* Access outside data or code memory that stopped the simulation */
+typedef struct APEX_Fault
+{
+    int type;                      /* FAULT_NONE, FAULT_LOAD, FAULT_STORE or FAULT_FETCH */
+    int pc;                        /* Faulting instruction, or PC fetched */
+    int cycle;                     /* Cycle it reached MEM, or was fetched */
+    int address;                   /* Word address accessed, or PC fetched */
+} APEX_Fault;
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU
 {
@@ -49,8 +92,7 @@ typedef struct APEX_CPU
     int clock;                     /* Clock cycles elapsed */
     int insn_completed;            /* Instructions retired */
     int regs[REG_FILE_SIZE];       /* Integer register file */
-    int code_memory_size;          /* Number of instruction in the input file */
-    APEX_Instruction *code_memory; /* Code Memory */
+    APEX_Program program;          /* Code Memory */
     int stalled;
     int simulate; 
     int display;
@@ -59,11 +101,19 @@ typedef struct APEX_CPU
     int forward_flag;
     int fwd;
     int mem;
-    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
+    int batch;                     /* Run headless: no stdin, no per-cycle output */
+    APEX_Memory data_memory;       /* Data Memory */
     int single_step;               /* Wait for user input after every cycle */              
     int zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int fetch_from_next_cycle;
     int arr[16];
+    int sim;                       /* Suppress per-stage output when set */
+    int sig;                       /* Default single-step mode */
+    APEX_Stats stats;              /* Performance counters */
+    int stall_reason;              /* TRACE_STALL_* cause of the last decode stall */
+    struct APEX_Trace *trace;      /* Binary trace sink, NULL when not tracing */
+    int status;                    /* APEX_RUNNING until HALT retires or a fault */
+    APEX_Fault fault;
 
     /* Pipeline stages */
     CPU_Stage fetch;
@@ -71,10 +121,63 @@ typedef struct APEX_CPU
     CPU_Stage execute;
     CPU_Stage memory;
     CPU_Stage writeback;
+
+    /* Functional unit pool, see apex_fu.c */
+    APEX_FU_Config fu;
+    int ready_cycle[REG_FILE_SIZE]; /* First decode cycle a pending result can be read */
+    int flag_ready_cycle;          /* Same for the zero flag read by BZ/BNZ */
+    int div_ready_cycle;           /* First decode cycle the divider takes a new DIV */
+    int fu_drain_cycle;            /* Writeback cycle of the last MUL/DIV result */
+
+    /* L1 caches, NULL when accesses take one cycle */
+    APEX_Cache *dcache;
+    APEX_Cache *icache;
+    int mem_stall;                 /* Cycles the MEM stage access has left */
+    int fetch_stall;               /* Cycles the fetch access has left */
+
+    /* Superscalar stage groups, used when width > 1 */
+    int width;                     /* Instructions per stage per cycle */
+    CPU_Stage decode_group[APEX_MAX_WIDTH];
+    CPU_Stage execute_group[APEX_MAX_WIDTH];
+    CPU_Stage memory_group[APEX_MAX_WIDTH];
+    CPU_Stage writeback_group[APEX_MAX_WIDTH];
 } APEX_CPU;
 
-APEX_Instruction *create_code_memory(const char *filename, int *size);
+const char *get_opcode_str(const int opcode);
+const APEX_Opcode_Info *get_opcode_info(const int opcode);
+int APEX_mem_address(const int addr, const int rs1_value, const int rs2_value,
+                     const int imm);
+void print_instruction(FILE *fp, const CPU_Stage *stage);
 APEX_CPU *APEX_cpu_init(const char *filename,const int num, const int cycles, const int forward_flag);
+int APEX_cpu_step(APEX_CPU *cpu);
+int APEX_alu(APEX_CPU *cpu, const int opcode, const int a, const int b);
+int APEX_cpu_set_width(APEX_CPU *cpu, const int width);
+int get_source_regs(const CPU_Stage *stage, int src[3]);
+int writes_rd(const CPU_Stage *stage);
+int sets_zero_flag(const CPU_Stage *stage);
+void APEX_fu_default_config(APEX_FU_Config *cfg);
+int APEX_fu_parse_option(APEX_FU_Config *cfg, const char *name, const char *value);
+int APEX_fu_configure(APEX_CPU *cpu, const APEX_FU_Config *cfg);
+int APEX_fu_class(const int opcode);
+int APEX_fu_hazard(const APEX_CPU *cpu, const CPU_Stage *stage);
+void APEX_fu_issue(APEX_CPU *cpu, const CPU_Stage *stage);
+int APEX_fu_draining(const APEX_CPU *cpu);
+int APEX_cpu_set_code_base(APEX_CPU *cpu, const int pc);
+int APEX_cpu_add_module(APEX_CPU *cpu, const char *filename, const int base);
+int APEX_cpu_set_mem_size(APEX_CPU *cpu, const unsigned int size);
+int APEX_cpu_load_data(APEX_CPU *cpu);
+int APEX_cpu_set_dcache(APEX_CPU *cpu, const APEX_Cache_Config *cfg);
+int APEX_cpu_set_icache(APEX_CPU *cpu, const APEX_Cache_Config *cfg);
+void APEX_cpu_fault(APEX_CPU *cpu, const CPU_Stage *stage, const int type);
+int APEX_fetch_fault(APEX_CPU *cpu, const int drained);
+const char *APEX_status_str(const int status);
+int APEX_memory_latency(APEX_CPU *cpu, const CPU_Stage *stage);
+int APEX_fetch_latency(APEX_CPU *cpu, const int pc, const int index);
+int APEX_cpu_cycle_wide(APEX_CPU *cpu);
+int APEX_cpu_fast_forward(APEX_CPU *cpu, const int until, const int target);
 void APEX_cpu_run(APEX_CPU *cpu);
+int APEX_cpu_save(const APEX_CPU *cpu, const char *filename);
+int APEX_cpu_restore(APEX_CPU *cpu, const char *filename);
+int APEX_cpu_print_stats(const APEX_CPU *cpu, FILE *fp, const char *format);
 void APEX_cpu_stop(APEX_CPU *cpu);
 #endif
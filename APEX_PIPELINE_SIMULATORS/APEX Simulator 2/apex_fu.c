@@ -0,0 +1,226 @@
+/*
+ * apex_fu.c
+ * Functional unit pool of the Execute stage
+ *
+ * Instructions are routed by the opcode_table class of their opcode to one
+ * of four units: integer ALUs (also resolving BZ/BNZ), a pipelined
+ * multiplier, a non-pipelined divider and address-generation units. ALUs
+ * and AGUs take one cycle, the multiplier and divider take their configured
+ * latency.
+ *
+ * Instructions still move through Execute in one cycle, which keeps the
+ * multiplier pipelined, but a MUL or DIV result is only complete after its
+ * latency. Execute records in the scoreboard the first decode cycle each
+ * result (and the zero flag) is available, and when the divider takes its
+ * next DIV. Decode stalls on those cycles on top of the arr[] hazards. With
+ * forwarding a latency L result can be read L - 1 cycles after the usual
+ * forward, without forwarding L - 1 cycles after its writeback. HALT waits
+ * in writeback until the last outstanding result would have been written,
+ * so a unit's latency always shows in the cycle count.
+ *
+ * Unit counts only matter to the superscalar pipeline, which issues no more
+ * instructions of a class per group than there are units.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Stores the source registers of an instruction in src, returns how many */
+int
+get_source_regs(const CPU_Stage *stage, int src[3])
+{
+    const APEX_Opcode_Info *info = get_opcode_info(stage->opcode);
+    int n = 0;
+
+    if (info->src & SRC_RS1)
+    {
+        src[n++] = stage->rs1;
+    }
+    if (info->src & SRC_RS2)
+    {
+        src[n++] = stage->rs2;
+    }
+    if (info->src & SRC_RS3)
+    {
+        src[n++] = stage->rs3;
+    }
+    return n;
+}
+
+int
+writes_rd(const CPU_Stage *stage)
+{
+    return (get_opcode_info(stage->opcode)->dest & DEST_RD) != 0;
+}
+
+/* Instructions whose result sets the zero flag read by BZ/BNZ */
+int
+sets_zero_flag(const CPU_Stage *stage)
+{
+    return get_opcode_info(stage->opcode)->sets_flags;
+}
+
+/* One ALU and one AGU per pipeline slot, a single multiplier and divider,
+ * and single-cycle latencies */
+void
+APEX_fu_default_config(APEX_FU_Config *cfg)
+{
+    int i;
+
+    for (i = 0; i < FU_COUNT; ++i)
+    {
+        cfg->count[i] = APEX_MAX_WIDTH;
+        cfg->latency[i] = 1;
+    }
+    cfg->count[FU_MUL] = 1;
+    cfg->count[FU_DIV] = 1;
+}
+
+/*
+ * Applies a command line or manifest option to cfg. Returns TRUE if name is
+ * a functional unit option, FALSE otherwise. Values are range-checked by
+ * APEX_fu_configure.
+ */
+int
+APEX_fu_parse_option(APEX_FU_Config *cfg, const char *name, const char *value)
+{
+    if (strcmp(name, "alus") == 0)
+    {
+        cfg->count[FU_ALU] = atoi(value);
+    }
+    else if (strcmp(name, "muls") == 0)
+    {
+        cfg->count[FU_MUL] = atoi(value);
+    }
+    else if (strcmp(name, "agus") == 0)
+    {
+        cfg->count[FU_AGU] = atoi(value);
+    }
+    else if (strcmp(name, "mul_latency") == 0)
+    {
+        cfg->latency[FU_MUL] = atoi(value);
+    }
+    else if (strcmp(name, "div_latency") == 0)
+    {
+        cfg->latency[FU_DIV] = atoi(value);
+    }
+    else
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Installs a functional unit configuration and clears the pending result
+ * cycles. Returns 0 on success, -1 if a count is outside 1..APEX_MAX_WIDTH
+ * or a latency outside 1..APEX_MAX_FU_LATENCY.
+ */
+int
+APEX_fu_configure(APEX_CPU *cpu, const APEX_FU_Config *cfg)
+{
+    int i;
+
+    for (i = FU_ALU; i < FU_COUNT; ++i)
+    {
+        if (cfg->count[i] < 1 || cfg->count[i] > APEX_MAX_WIDTH
+            || cfg->latency[i] < 1 || cfg->latency[i] > APEX_MAX_FU_LATENCY)
+        {
+            return -1;
+        }
+    }
+
+    cpu->fu = *cfg;
+    memset(cpu->ready_cycle, 0, sizeof(cpu->ready_cycle));
+    cpu->flag_ready_cycle = 0;
+    cpu->div_ready_cycle = 0;
+    cpu->fu_drain_cycle = 0;
+    return 0;
+}
+
+int
+APEX_fu_class(const int opcode)
+{
+    return get_opcode_info(opcode)->fu;
+}
+
+/*
+ * Returns the TRACE_STALL_* reason stage cannot leave decode this cycle
+ * because of a pending multi-cycle result or a busy divider, or
+ * TRACE_STALL_NONE. A source still held in arr[] is left to the scoreboard
+ * check, so single-cycle units never add a stall of their own.
+ */
+int
+APEX_fu_hazard(const APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    int src[3], n, i, pending = FALSE;
+
+    n = get_source_regs(stage, src);
+    for (i = 0; i < n; ++i)
+    {
+        if (cpu->arr[src[i]] != 0)
+        {
+            return TRACE_STALL_NONE;
+        }
+        if (cpu->clock < cpu->ready_cycle[src[i]])
+        {
+            pending = TRUE;
+        }
+    }
+
+    if (APEX_fu_class(stage->opcode) == FU_DIV
+        && cpu->clock < cpu->div_ready_cycle)
+    {
+        return TRACE_STALL_FU_BUSY;
+    }
+    if (pending)
+    {
+        return TRACE_STALL_FU_LATENCY;
+    }
+
+    if (get_opcode_info(stage->opcode)->cond != COND_NONE
+        && cpu->clock < cpu->flag_ready_cycle)
+    {
+        return TRACE_STALL_FU_LATENCY;
+    }
+
+    return TRACE_STALL_NONE;
+}
+
+/* Records in the scoreboard when the result of an instruction entering
+ * Execute this cycle can be read, and when it would be written back */
+void
+APEX_fu_issue(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    const APEX_Opcode_Info *info = get_opcode_info(stage->opcode);
+    int latency = info->latency ? info->latency : cpu->fu.latency[info->fu];
+
+    if (writes_rd(stage))
+    {
+        cpu->ready_cycle[stage->rd]
+            = cpu->clock + latency + (cpu->forward_flag ? -1 : 1);
+    }
+    if (sets_zero_flag(stage))
+    {
+        cpu->flag_ready_cycle = cpu->clock + latency - 1;
+    }
+    if (info->fu == FU_DIV)
+    {
+        cpu->div_ready_cycle = cpu->clock + latency - 1;
+    }
+    if (cpu->clock + latency + 1 > cpu->fu_drain_cycle)
+    {
+        cpu->fu_drain_cycle = cpu->clock + latency + 1;
+    }
+}
+
+/* Returns TRUE while a MUL or DIV result is still outstanding, which holds
+ * HALT in writeback */
+int
+APEX_fu_draining(const APEX_CPU *cpu)
+{
+    return cpu->clock < cpu->fu_drain_cycle;
+}
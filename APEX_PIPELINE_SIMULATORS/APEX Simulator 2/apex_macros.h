@@ -12,12 +12,36 @@
 #define FALSE 0x0
 #define TRUE 0x1
 
-/* Integers */
+/* Default data memory size in words (integers), see the mem_size option */
 #define DATA_MEMORY_SIZE 4096
 
+/* Largest data memory: 2^30 (1G) words, which is 4 GB of bytes */
+#define APEX_MAX_DATA_MEMORY (1u << 30)
+
+/* Data memory pages of 1024 words, 1024 pages per second-level table, see
+ * apex_memory.h */
+#define MEM_PAGE_SHIFT 10
+#define MEM_PAGE_WORDS (1u << MEM_PAGE_SHIFT)
+#define MEM_TABLE_SHIFT 10
+#define MEM_TABLE_PAGES (1u << MEM_TABLE_SHIFT)
+
+/* PC of the first instruction unless the program says otherwise */
+#define APEX_CODE_BASE 4000
+
+/* Most code segments in a program, see apex_program.h */
+#define APEX_MAX_SEGMENTS 64
+
 /* Size of integer register file */
 #define REG_FILE_SIZE 16
 
+/* Pre-assembled program image: "APEX" magic and format version */
+#define APEX_IMAGE_MAGIC 0x58455041
+#define APEX_IMAGE_VERSION 3
+
+/* CPU state snapshot: "APXS" magic and format version */
+#define APEX_SNAPSHOT_MAGIC 0x53585041
+#define APEX_SNAPSHOT_VERSION 7
+
 /* Numeric OPCODE identifiers for instructions */
 #define OPCODE_ADD 0x0
 #define OPCODE_SUB 0x1
@@ -39,10 +63,117 @@
 #define OPCODE_SUBL 0x11
 #define OPCODE_CMP 0x12
 
-/* Set this flag to 1 to enable debug messages */
+/* Number of opcodes above, sizes per-opcode tables */
+#define NUM_OPCODES 0x13
+
+/* Widest superscalar pipeline, see apex_superscalar.c */
+#define APEX_MAX_WIDTH 8
+
+/* Execute-stage functional unit classes, see apex_fu.c */
+#define FU_NONE 0x0
+#define FU_ALU 0x1
+#define FU_MUL 0x2
+#define FU_DIV 0x3
+#define FU_AGU 0x4
+#define FU_COUNT 0x5
+
+/* Opcode descriptor: source registers read in decode */
+#define SRC_RS1 0x1
+#define SRC_RS2 0x2
+#define SRC_RS3 0x4
+
+/* Opcode descriptor: registers written back */
+#define DEST_RD 0x1
+
+/* Opcode descriptor: data memory access in MEM */
+#define MEM_NONE 0x0
+#define MEM_LOAD 0x1
+#define MEM_STORE 0x2
+
+/* Opcode descriptor: operands summed into the data memory address */
+#define ADDR_NONE 0x0
+#define ADDR_RS1_IMM 0x1
+#define ADDR_RS2_IMM 0x2
+#define ADDR_RS1_RS2 0x3
+
+/* Opcode descriptor: branch conditions on the zero flag */
+#define COND_NONE 0x0
+#define COND_Z 0x1
+#define COND_NZ 0x2
+
+/* Longest configurable multiplier/divider latency, in cycles */
+#define APEX_MAX_FU_LATENCY 64
+
+/* Cache replacement policies, see apex_cache.c */
+#define CACHE_LRU 0x0
+#define CACHE_PLRU 0x1
+#define CACHE_RANDOM 0x2
+
+/* Longest configurable cache hit/miss latency, in cycles */
+#define APEX_MAX_CACHE_LATENCY 1000
+
+/* Why APEX_cpu_step stopped, see cpu->status */
+#define APEX_RUNNING 0x0
+#define APEX_HALTED 0x1
+#define APEX_FAULTED 0x2
+
+/* Memory fault kinds, see APEX_Fault */
+#define FAULT_NONE 0x0
+#define FAULT_LOAD 0x1
+#define FAULT_STORE 0x2
+#define FAULT_FETCH 0x3
+
+/* Exit status of a batch run stopped by a fault */
+#define APEX_EXIT_FAULT 2
+
+/* Branch hints and cold-path marker for the per-cycle code */
+#if defined(__GNUC__)
+#define APEX_LIKELY(x) __builtin_expect(!!(x), 1)
+#define APEX_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#define APEX_COLD __attribute__((cold, noinline))
+#else
+#define APEX_LIKELY(x) (x)
+#define APEX_UNLIKELY(x) (x)
+#define APEX_COLD
+#endif
+
+/* Fast-forward targets for APEX_cpu_fast_forward */
+#define FFWD_PC 0x1
+#define FFWD_INSN 0x2
+
+/* Binary trace file: "APXT" magic and format version */
+#define APEX_TRACE_MAGIC 0x54585041
+#define APEX_TRACE_VERSION 1
+
+/* Pipeline stage of a trace record */
+#define TRACE_STAGE_FETCH 0x0
+#define TRACE_STAGE_DECODE 0x1
+#define TRACE_STAGE_EXECUTE 0x2
+#define TRACE_STAGE_MEMORY 0x3
+#define TRACE_STAGE_WRITEBACK 0x4
+
+/* Why a trace record's stage did not advance this cycle */
+#define TRACE_STALL_NONE 0x0
+#define TRACE_STALL_RAW_RS1 0x1
+#define TRACE_STALL_RAW_RS2 0x2
+#define TRACE_STALL_RAW_RS3 0x3
+#define TRACE_STALL_LOAD_USE 0x4
+#define TRACE_STALL_BRANCH 0x5
+#define TRACE_STALL_GROUP 0x6
+#define TRACE_STALL_FU_LATENCY 0x7
+#define TRACE_STALL_FU_BUSY 0x8
+#define TRACE_STALL_DCACHE 0x9
+#define TRACE_STALL_ICACHE 0xa
+
+/* Set this flag to 1 to enable debug messages, -DENABLE_DEBUG_MESSAGES=0
+ * compiles the per-stage printing out */
+#ifndef ENABLE_DEBUG_MESSAGES
 #define ENABLE_DEBUG_MESSAGES 1
+#endif
 
 /* Set this flag to 1 to enable cycle single-step mode */
+#ifndef ENABLE_SINGLE_STEP
 #define ENABLE_SINGLE_STEP 1
+#endif
 
 #endif
@@ -0,0 +1,342 @@
+/*
+ * apex_memory.c
+ * Sparse, page-backed data memory, see apex_memory.h
+ */
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_memory.h"
+
+/*
+ * Sets up an empty memory of size words. Only the first-level table is
+ * allocated. Returns 0 on success, -1 for a size outside
+ * 1..APEX_MAX_DATA_MEMORY or when out of memory.
+ */
+int
+APEX_mem_init(APEX_Memory *mem, unsigned int size)
+{
+    unsigned int span = MEM_PAGE_WORDS * MEM_TABLE_PAGES;
+
+    memset(mem, 0, sizeof(*mem));
+    if (size < 1 || size > APEX_MAX_DATA_MEMORY)
+    {
+        return -1;
+    }
+
+    mem->num_tables = (size - 1) / span + 1;
+    mem->dir = calloc(mem->num_tables, sizeof(int **));
+    if (!mem->dir)
+    {
+        return -1;
+    }
+    mem->size = size;
+    return 0;
+}
+
+void
+APEX_mem_free(APEX_Memory *mem)
+{
+    unsigned int i, j;
+
+    for (i = 0; i < mem->num_tables && mem->dir; ++i)
+    {
+        if (!mem->dir[i])
+        {
+            continue;
+        }
+        for (j = 0; j < MEM_TABLE_PAGES; ++j)
+        {
+            free(mem->dir[i][j]);
+        }
+        free(mem->dir[i]);
+    }
+    free(mem->dir);
+    memset(mem, 0, sizeof(*mem));
+}
+
+/* Allocates the zero-filled page holding addr, and its table if needed.
+ * Running out of host memory ends the simulation. */
+int *
+APEX_mem_alloc_page(APEX_Memory *mem, unsigned int addr)
+{
+    int ***table = &mem->dir[addr >> (MEM_PAGE_SHIFT + MEM_TABLE_SHIFT)];
+    int **page;
+
+    if (!*table)
+    {
+        *table = calloc(MEM_TABLE_PAGES, sizeof(int *));
+    }
+    if (*table)
+    {
+        page = &(*table)[(addr >> MEM_PAGE_SHIFT) & (MEM_TABLE_PAGES - 1)];
+        *page = calloc(MEM_PAGE_WORDS, sizeof(int));
+        if (*page)
+        {
+            mem->num_pages++;
+            return *page;
+        }
+    }
+
+    fprintf(stderr, "APEX_Error: Out of memory for data memory page at %u\n",
+            addr);
+    exit(1);
+}
+
+/*
+ * Parses a word count with an optional K, M or G suffix (powers of 1024).
+ * Returns 0 on success, -1 if value is not a count within
+ * min..APEX_MAX_DATA_MEMORY.
+ */
+static int
+parse_words(const char *value, const unsigned int min, unsigned int *size)
+{
+    char *end;
+    unsigned long long words;
+
+    if (*value < '0' || *value > '9')
+    {
+        return -1;
+    }
+    words = strtoull(value, &end, 10);
+    if (words > APEX_MAX_DATA_MEMORY)
+    {
+        return -1;
+    }
+
+    switch (*end)
+    {
+        case 'K': words <<= 10; end++; break;
+        case 'M': words <<= 20; end++; break;
+        case 'G': words <<= 30; end++; break;
+    }
+
+    if (end == value || *end != '\0' || words < min
+        || words > APEX_MAX_DATA_MEMORY)
+    {
+        return -1;
+    }
+    *size = (unsigned int)words;
+    return 0;
+}
+
+/* Parses a memory size in words, 1..APEX_MAX_DATA_MEMORY, see parse_words */
+int
+APEX_mem_parse_size(const char *value, unsigned int *size)
+{
+    return parse_words(value, 1, size);
+}
+
+/* Parses a word address, below APEX_MAX_DATA_MEMORY, see parse_words */
+int
+APEX_mem_parse_addr(const char *value, unsigned int *addr)
+{
+    if (parse_words(value, 0, addr) != 0 || *addr == APEX_MAX_DATA_MEMORY)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Copies count words into memory from addr on; all of them must be in
+ * range. Zeros bound for a page never written are skipped rather than
+ * allocated, so a mostly-zero image stays sparse.
+ */
+void
+APEX_mem_copy_in(APEX_Memory *mem, unsigned int addr, const int *words,
+                 size_t count)
+{
+    unsigned int offset;
+    size_t n, i;
+    int *page;
+
+    while (count > 0)
+    {
+        offset = addr & (MEM_PAGE_WORDS - 1);
+        n = MEM_PAGE_WORDS - offset;
+        if (n > count)
+        {
+            n = count;
+        }
+
+        page = APEX_mem_page(mem, addr);
+        for (i = 0; !page && i < n; ++i)
+        {
+            if (words[i] != 0)
+            {
+                page = APEX_mem_alloc_page(mem, addr);
+            }
+        }
+        if (page)
+        {
+            memcpy(page + offset, words, n * sizeof(int));
+        }
+
+        addr += (unsigned int)n;
+        words += n;
+        count -= n;
+    }
+}
+
+/*
+ * Loads a hex image: whitespace separated words of up to 8 hex digits,
+ * stored at consecutive addresses from base. '@<hex>' moves on to address
+ * base + hex. '//' and ';' start comments. Returns 0 on success, -1 after
+ * reporting the error.
+ */
+static int
+load_hex_image(APEX_Memory *mem, const char *filename, unsigned int base)
+{
+    FILE *fp;
+    char *line = NULL, *p, *end;
+    size_t len = 0;
+    unsigned long long addr = base, value;
+    int line_num = 0, ret = 0;
+
+    fp = fopen(filename, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open data memory image %s\n",
+                filename);
+        return -1;
+    }
+
+    while (ret == 0 && getline(&line, &len, fp) != -1)
+    {
+        line_num++;
+        for (p = line; *p; ++p)
+        {
+            if (*p == ';' || (p[0] == '/' && p[1] == '/'))
+            {
+                *p = '\0';
+                break;
+            }
+        }
+
+        for (p = line; ; p = end)
+        {
+            p += strspn(p, " \t\r\n");
+            if (!*p)
+            {
+                break;
+            }
+            if (*p == '@')
+            {
+                value = strtoull(p + 1, &end, 16);
+                if (!isxdigit((unsigned char)p[1])
+                    || value >= APEX_MAX_DATA_MEMORY)
+                {
+                    fprintf(stderr, "APEX_Error: %s:%d: invalid address\n",
+                            filename, line_num);
+                    ret = -1;
+                    break;
+                }
+                addr = base + value;
+            }
+            else
+            {
+                value = strtoull(p, &end, 16);
+                if (!isxdigit((unsigned char)*p)
+                    || end - p > (p[1] == 'x' || p[1] == 'X' ? 10 : 8))
+                {
+                    fprintf(stderr, "APEX_Error: %s:%d: invalid hex word\n",
+                            filename, line_num);
+                    ret = -1;
+                    break;
+                }
+                if (addr >= mem->size)
+                {
+                    fprintf(stderr, "APEX_Error: %s:%d: address %llu is outside data memory of %u words\n",
+                            filename, line_num, addr, mem->size);
+                    ret = -1;
+                    break;
+                }
+                APEX_mem_write(mem, (unsigned int)addr++, (int)(unsigned int)value);
+            }
+
+            if (*end && !strchr(" \t\r\n", *end))
+            {
+                fprintf(stderr, "APEX_Error: %s:%d: invalid hex word\n",
+                        filename, line_num);
+                ret = -1;
+                break;
+            }
+        }
+    }
+
+    free(line);
+    fclose(fp);
+    return ret;
+}
+
+/*
+ * Loads a data memory image into mem from word address base on. A file
+ * whose name ends in '.hex' is a hex image, see load_hex_image. Anything
+ * else is raw 32-bit words in host byte order, mapped and copied page by
+ * page with no parsing. Returns 0 on success, -1 after reporting the error.
+ */
+int
+APEX_mem_load_image(APEX_Memory *mem, const char *filename, unsigned int base)
+{
+    size_t len = strlen(filename);
+    struct stat st;
+    void *words;
+    size_t count;
+    int fd;
+
+    if (len > 4 && strcmp(filename + len - 4, ".hex") == 0)
+    {
+        return load_hex_image(mem, filename, base);
+    }
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open data memory image %s\n",
+                filename);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    count = (size_t)st.st_size / sizeof(int);
+    if ((size_t)st.st_size % sizeof(int) != 0)
+    {
+        fprintf(stderr, "APEX_Error: %s: Size is not a whole number of words\n",
+                filename);
+        close(fd);
+        return -1;
+    }
+    if (base > mem->size || count > mem->size - base)
+    {
+        fprintf(stderr, "APEX_Error: %s: %zu words at %u do not fit in data memory of %u words\n",
+                filename, count, base, mem->size);
+        close(fd);
+        return -1;
+    }
+    if (count == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    words = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (words == MAP_FAILED)
+    {
+        fprintf(stderr, "APEX_Error: Unable to map data memory image %s\n",
+                filename);
+        return -1;
+    }
+    APEX_mem_copy_in(mem, base, words, count);
+    munmap(words, st.st_size);
+    return 0;
+}
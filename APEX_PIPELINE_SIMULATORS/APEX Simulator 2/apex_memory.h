@@ -0,0 +1,83 @@
+/*
+ * apex_memory.h
+ * Sparse, page-backed data memory
+ *
+ * The word-addressed address space is split into MEM_PAGE_WORDS pages,
+ * found through a two-level table. Pages are allocated zero-filled on the
+ * first non-zero store, so a CPU only pays for the memory its program
+ * writes. Reads of a page never written return zero without allocating.
+ *
+ * APEX_mem_read and APEX_mem_write do no bounds checking: callers test the
+ * address with APEX_mem_in_range first. The pipeline does this once per
+ * access and turns a miss into a fault, see APEX_memory_latency.
+ */
+#ifndef _APEX_MEMORY_H_
+#define _APEX_MEMORY_H_
+
+#include <stddef.h>
+
+#include "apex_macros.h"
+
+typedef struct APEX_Memory
+{
+    unsigned int size;             /* Words, 1..APEX_MAX_DATA_MEMORY */
+    unsigned int num_tables;       /* Second-level tables in dir */
+    int ***dir;                    /* dir[table][page] -> page, or NULL */
+    unsigned int num_pages;        /* Pages allocated so far */
+} APEX_Memory;
+
+int APEX_mem_init(APEX_Memory *mem, unsigned int size);
+void APEX_mem_free(APEX_Memory *mem);
+int *APEX_mem_alloc_page(APEX_Memory *mem, unsigned int addr);
+int APEX_mem_parse_size(const char *value, unsigned int *size);
+int APEX_mem_parse_addr(const char *value, unsigned int *addr);
+void APEX_mem_copy_in(APEX_Memory *mem, unsigned int addr, const int *words,
+                      size_t count);
+int APEX_mem_load_image(APEX_Memory *mem, const char *filename,
+                        unsigned int base);
+
+/* TRUE when addr is a word of memory. Callers pass signed addresses
+ * converted to unsigned, so negative ones are out of range too */
+static inline int
+APEX_mem_in_range(const APEX_Memory *mem, unsigned int addr)
+{
+    return APEX_LIKELY(addr < mem->size);
+}
+
+/* The page holding addr, or NULL if it was never written. addr must be
+ * below mem->size */
+static inline int *
+APEX_mem_page(const APEX_Memory *mem, unsigned int addr)
+{
+    int **table = mem->dir[addr >> (MEM_PAGE_SHIFT + MEM_TABLE_SHIFT)];
+
+    return table ? table[(addr >> MEM_PAGE_SHIFT) & (MEM_TABLE_PAGES - 1)]
+                 : NULL;
+}
+
+/* Reads the word at addr, which must be in range */
+static inline int
+APEX_mem_read(const APEX_Memory *mem, unsigned int addr)
+{
+    const int *page = APEX_mem_page(mem, addr);
+
+    return page ? page[addr & (MEM_PAGE_WORDS - 1)] : 0;
+}
+
+/* Writes the word at addr, which must be in range */
+static inline void
+APEX_mem_write(APEX_Memory *mem, unsigned int addr, int value)
+{
+    int *page = APEX_mem_page(mem, addr);
+
+    if (!page)
+    {
+        if (value == 0)
+        {
+            return;
+        }
+        page = APEX_mem_alloc_page(mem, addr);
+    }
+    page[addr & (MEM_PAGE_WORDS - 1)] = value;
+}
+#endif
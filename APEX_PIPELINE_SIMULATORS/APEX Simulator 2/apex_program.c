@@ -0,0 +1,280 @@
+/*
+ * apex_program.c
+ * Program image and PC lookup, see apex_program.h
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "apex_program.h"
+
+void
+APEX_program_init(APEX_Program *prog)
+{
+    memset(prog, 0, sizeof(*prog));
+}
+
+void
+APEX_program_free(APEX_Program *prog)
+{
+    if (prog->image)
+    {
+        munmap(prog->image, prog->image_len);
+    }
+    else
+    {
+        free(prog->code);
+        free(prog->data);
+    }
+    APEX_program_init(prog);
+}
+
+/* PC one past the last instruction of seg */
+static long long
+segment_end(const APEX_Segment *seg)
+{
+    return (long long)seg->base + 4LL * seg->size;
+}
+
+/*
+ * Checks that every segment is word aligned, lies within 0..INT_MAX and
+ * overlaps no other. Returns 0 if so, -1 after reporting the problem.
+ */
+static int
+check_layout(const APEX_Program *prog, const char *filename)
+{
+    const APEX_Segment *a, *b;
+    int i, j;
+
+    for (i = 0; i < prog->num_segments; ++i)
+    {
+        a = &prog->segments[i];
+        if (a->base < 0 || a->base % 4 != 0 || segment_end(a) > INT_MAX)
+        {
+            fprintf(stderr, "APEX_Error: %s: Segment at %d is not a valid code address range\n",
+                    filename, a->base);
+            return -1;
+        }
+
+        for (j = 0; j < i; ++j)
+        {
+            b = &prog->segments[j];
+            if (a->base < segment_end(b) && b->base < segment_end(a))
+            {
+                fprintf(stderr, "APEX_Error: %s: Segments at %d and %d overlap\n",
+                        filename, b->base, a->base);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Loads the program in filename, a pre-assembled image or else assembly
+ * source, into prog, which holds nothing yet. Execution starts at its first
+ * segment. Returns 0 on success, -1 on failure.
+ */
+int
+APEX_program_load(APEX_Program *prog, const char *filename)
+{
+    int ret;
+
+    APEX_program_init(prog);
+    ret = map_code_image(prog, filename);
+    if (ret == -2 || (ret != 0 && assemble_program(prog, filename) != 0))
+    {
+        return -1;
+    }
+
+    prog->entry = prog->segments[0].base;
+    prog->last = 0;
+    if (check_layout(prog, filename) != 0)
+    {
+        APEX_program_free(prog);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Moves every segment by the same distance so execution starts at entry.
+ * Branches are PC-relative, so the program runs unchanged. Returns 0 on
+ * success, -1 if a segment would leave the code address range.
+ */
+int
+APEX_program_relocate(APEX_Program *prog, const int entry)
+{
+    long long delta = (long long)entry - prog->entry;
+    int i;
+
+    if (entry % 4 != 0)
+    {
+        return -1;
+    }
+    for (i = 0; i < prog->num_segments; ++i)
+    {
+        if (prog->segments[i].base + delta < 0
+            || segment_end(&prog->segments[i]) + delta > INT_MAX)
+        {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < prog->num_segments; ++i)
+    {
+        prog->segments[i].base += (int)delta;
+    }
+    prog->entry = entry;
+    return 0;
+}
+
+/*
+ * Links another separately assembled program into prog, relocated so its
+ * first segment starts at base, or right after the highest segment of prog
+ * when base is -1. The entry point stays that of prog. Data addresses are
+ * not moved, and the module's words are preloaded after those of prog.
+ * Returns 0 on success, -1 after reporting an error; prog is unchanged on
+ * failure.
+ */
+int
+APEX_program_add_module(APEX_Program *prog, const char *filename,
+                        const int base)
+{
+    APEX_Program module;
+    APEX_Program merged;
+    long long end = 0;
+    int i;
+
+    if (APEX_program_load(&module, filename) != 0)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < prog->num_segments; ++i)
+    {
+        if (segment_end(&prog->segments[i]) > end)
+        {
+            end = segment_end(&prog->segments[i]);
+        }
+    }
+    if (prog->num_segments + module.num_segments > APEX_MAX_SEGMENTS
+        || APEX_program_relocate(&module, base < 0 ? (int)end : base) != 0)
+    {
+        fprintf(stderr, "APEX_Error: %s: Unable to place module\n", filename);
+        APEX_program_free(&module);
+        return -1;
+    }
+
+    merged = *prog;
+    merged.image = NULL;
+    merged.code = malloc(((size_t)prog->size + module.size)
+                         * sizeof(APEX_Instruction));
+    merged.data = malloc(((size_t)prog->num_data + module.num_data + 1)
+                         * sizeof(APEX_Data_Word));
+    if (!merged.code || !merged.data)
+    {
+        free(merged.code);
+        free(merged.data);
+        APEX_program_free(&module);
+        return -1;
+    }
+    memcpy(merged.code, prog->code, prog->size * sizeof(APEX_Instruction));
+    memcpy(merged.code + prog->size, module.code,
+           module.size * sizeof(APEX_Instruction));
+    for (i = 0; i < module.num_segments; ++i)
+    {
+        merged.segments[merged.num_segments] = module.segments[i];
+        merged.segments[merged.num_segments].first += prog->size;
+        merged.num_segments++;
+    }
+    merged.size += module.size;
+    if (prog->num_data)
+    {
+        memcpy(merged.data, prog->data,
+               prog->num_data * sizeof(APEX_Data_Word));
+    }
+    if (module.num_data)
+    {
+        memcpy(merged.data + prog->num_data, module.data,
+               module.num_data * sizeof(APEX_Data_Word));
+    }
+    merged.num_data += module.num_data;
+    APEX_program_free(&module);
+
+    if (check_layout(&merged, filename) != 0)
+    {
+        free(merged.code);
+        free(merged.data);
+        return -1;
+    }
+
+    APEX_program_free(prog);
+    *prog = merged;
+    return 0;
+}
+
+/* Slow path of APEX_program_index: finds the segment holding pc and makes
+ * it the one checked first */
+int
+APEX_program_find(APEX_Program *prog, const int pc)
+{
+    const APEX_Segment *seg;
+    unsigned int offset;
+    int i;
+
+    for (i = 0; i < prog->num_segments; ++i)
+    {
+        seg = &prog->segments[i];
+        offset = (unsigned int)pc - (unsigned int)seg->base;
+        if (offset < (unsigned int)seg->size * 4 && !(offset & 3))
+        {
+            prog->last = i;
+            return seg->first + (int)(offset >> 2);
+        }
+    }
+    return -1;
+}
+
+/* PC of the instruction at index in code, or -1 if there is none */
+int
+APEX_program_pc(const APEX_Program *prog, const int index)
+{
+    const APEX_Segment *seg;
+    int i;
+
+    for (i = 0; i < prog->num_segments; ++i)
+    {
+        seg = &prog->segments[i];
+        if (index >= seg->first && index < seg->first + seg->size)
+        {
+            return seg->base + 4 * (index - seg->first);
+        }
+    }
+    return -1;
+}
+
+/*
+ * Parses a code address: a non-negative decimal multiple of 4. Returns 0 on
+ * success, -1 otherwise.
+ */
+int
+APEX_parse_code_address(const char *value, int *pc)
+{
+    char *end;
+    long long addr;
+
+    if (*value < '0' || *value > '9')
+    {
+        return -1;
+    }
+    addr = strtoll(value, &end, 10);
+    if (*end != '\0' || addr > INT_MAX || addr % 4 != 0)
+    {
+        return -1;
+    }
+    *pc = (int)addr;
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * apex_program.h
+ * Program image: decoded instructions laid out in code segments
+ *
+ * The instructions of all segments sit in one array, code, in segment
+ * order. A segment maps the PCs base, base + 4, ... onto its slice of it.
+ * An instruction's position in code is its index, which the instruction
+ * cache and the per-PC miss counters use.
+ */
+#ifndef _APEX_PROGRAM_H_
+#define _APEX_PROGRAM_H_
+
+#include <stddef.h>
+
+#include "apex_macros.h"
+
+/* Format of an APEX instruction, pre-decoded once by assemble_program.
+ * The mnemonic is not stored; use get_opcode_str() when displaying. */
+typedef struct APEX_Instruction
+{
+    int opcode;
+    int rd;
+    int rs1;
+    int rs2;
+    int rs3;
+    int imm;
+} APEX_Instruction;
+
+/* A word of data memory the program preloads, see .word */
+typedef struct APEX_Data_Word
+{
+    unsigned int addr;
+    int value;
+} APEX_Data_Word;
+
+/* Header of a pre-assembled program image. It is followed directly by
+ * num_segments APEX_Image_Segment entries, num_data APEX_Data_Word entries
+ * and num_records APEX_Instruction records, all in host byte order. */
+typedef struct APEX_Image_Header
+{
+    unsigned int magic;            /* APEX_IMAGE_MAGIC */
+    unsigned int version;          /* APEX_IMAGE_VERSION */
+    unsigned int record_size;      /* sizeof(APEX_Instruction) */
+    unsigned int num_records;
+    unsigned int num_segments;
+    unsigned int num_data;
+} APEX_Image_Header;
+
+typedef struct APEX_Image_Segment
+{
+    int base;
+    int size;
+} APEX_Image_Segment;
+
+typedef struct APEX_Segment
+{
+    int base;                      /* PC of the first instruction */
+    int size;                      /* Instructions */
+    int first;                     /* Index of the first instruction in code */
+} APEX_Segment;
+
+typedef struct APEX_Program
+{
+    APEX_Instruction *code;        /* Instructions of all segments */
+    int size;                      /* Instructions in code */
+    int entry;                     /* PC execution starts at */
+    int num_segments;
+    APEX_Segment segments[APEX_MAX_SEGMENTS];
+    int last;                      /* Segment of the last lookup */
+    APEX_Data_Word *data;          /* Data memory preload, in source order */
+    int num_data;
+    void *image;                   /* mmap'ed image backing code and data, if any */
+    size_t image_len;
+} APEX_Program;
+
+void APEX_program_init(APEX_Program *prog);
+void APEX_program_free(APEX_Program *prog);
+int APEX_program_load(APEX_Program *prog, const char *filename);
+int APEX_program_add_module(APEX_Program *prog, const char *filename,
+                            const int base);
+int APEX_program_relocate(APEX_Program *prog, const int entry);
+int APEX_program_find(APEX_Program *prog, const int pc);
+int APEX_program_pc(const APEX_Program *prog, const int index);
+int APEX_parse_code_address(const char *value, int *pc);
+
+/* Assembler and image file support, see file_parser.c */
+int assemble_program(APEX_Program *prog, const char *filename);
+int write_code_image(const char *filename, const APEX_Program *prog);
+int map_code_image(APEX_Program *prog, const char *filename);
+
+/*
+ * Index in code of the instruction at pc, or -1 when pc is outside every
+ * segment or not word aligned. Sequential fetch stays in the segment of the
+ * last lookup, which one unsigned compare checks; leaving it costs a scan
+ * of at most APEX_MAX_SEGMENTS segments.
+ */
+static inline int
+APEX_program_index(APEX_Program *prog, const int pc)
+{
+    const APEX_Segment *seg = &prog->segments[prog->last];
+    unsigned int offset = (unsigned int)pc - (unsigned int)seg->base;
+
+    if (APEX_LIKELY(offset < (unsigned int)seg->size * 4 && !(offset & 3)))
+    {
+        return seg->first + (int)(offset >> 2);
+    }
+    return APEX_program_find(prog, pc);
+}
+
+/* Index one past the segment of the last successful lookup, where
+ * sequential fetch has to look the PC up again */
+static inline int
+APEX_program_segment_end(const APEX_Program *prog)
+{
+    const APEX_Segment *seg = &prog->segments[prog->last];
+
+    return seg->first + seg->size;
+}
+#endif
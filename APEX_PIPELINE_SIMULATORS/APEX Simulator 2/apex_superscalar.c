@@ -0,0 +1,697 @@
+/*
+ * apex_superscalar.c
+ * N-wide in-order superscalar variant of the APEX pipeline, used when
+ * cpu->width > 1. Every stage holds a group of up to width instruction
+ * slots, and groups move through Fetch -> Decode -> Execute -> Memory ->
+ * Writeback together. Opcode semantics, forwarding and the scoreboard
+ * (arr) follow the scalar stages in apex_cpu.c.
+ *
+ * Decode issues the slots of its group in program order and stops at the
+ * first slot that cannot go:
+ *
+ *   - a source register is still held by the scoreboard
+ *   - a source register, or the zero flag of a branch, is produced by an
+ *     older slot issuing in the same cycle (no forwarding within a group)
+ *   - an older slot of this cycle's group is a branch, so no wrong-path
+ *     instruction ever reaches Execute
+ *   - every functional unit of the slot's class (apex_fu.c) is taken by
+ *     an older slot of this cycle's group
+ *   - a multi-cycle result it reads is not ready, or the divider is busy
+ *
+ * Slots left behind move to the front of the decode group and fetch fills
+ * the free slots behind them.
+ *
+ * A memory group stays in MEM for the longest data cache latency among
+ * its loads and stores; the groups behind it wait in Execute and Decode.
+ * With an instruction cache a fetch group ends at the end of a cache line.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+#include "apex_trace.h"
+
+/* Slot contents that never forward, match or retire */
+static const CPU_Stage empty_slot = {.opcode = OPCODE_NOP, .rd = -1};
+
+/*
+ * Selects the pipeline width. Width 1 keeps the scalar pipeline. Returns 0
+ * on success and -1 for a width outside 1..APEX_MAX_WIDTH.
+ */
+int
+APEX_cpu_set_width(APEX_CPU *cpu, const int width)
+{
+    int i;
+
+    if (width < 1 || width > APEX_MAX_WIDTH)
+    {
+        return -1;
+    }
+
+    cpu->width = width;
+    for (i = 0; i < APEX_MAX_WIDTH; ++i)
+    {
+        cpu->decode_group[i] = empty_slot;
+        cpu->execute_group[i] = empty_slot;
+        cpu->memory_group[i] = empty_slot;
+        cpu->writeback_group[i] = empty_slot;
+    }
+    return 0;
+}
+
+static int
+is_load(const CPU_Stage *stage)
+{
+    return get_opcode_info(stage->opcode)->mem == MEM_LOAD;
+}
+
+static int
+is_branch(const CPU_Stage *stage)
+{
+    return get_opcode_info(stage->opcode)->cond != COND_NONE;
+}
+
+static int
+group_empty(const CPU_Stage *group, const int width)
+{
+    int i;
+
+    for (i = 0; i < width; ++i)
+    {
+        if (group[i].has_insn)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Moves a whole group one stage on, leaving the source slots readable */
+static void
+advance_group(CPU_Stage *to, CPU_Stage *from, const int width)
+{
+    int i;
+
+    for (i = 0; i < width; ++i)
+    {
+        to[i] = from[i];
+        from[i].has_insn = FALSE;
+    }
+}
+
+static void
+trace_group_stalled(APEX_CPU *cpu, const int stage, const CPU_Stage *group,
+                    const int stall)
+{
+    int i;
+
+    if (!cpu->trace)
+    {
+        return;
+    }
+
+    for (i = 0; i < cpu->width; ++i)
+    {
+        if (group[i].has_insn)
+        {
+            APEX_trace_stage(cpu->trace, cpu->clock, stage, &group[i], stall);
+        }
+    }
+}
+
+static void
+trace_group(APEX_CPU *cpu, const int stage, const CPU_Stage *group)
+{
+    trace_group_stalled(cpu, stage, group, TRACE_STALL_NONE);
+}
+
+/*
+ * Reads a source register for decode. With forwarding the writeback group
+ * and then the execute group override the register file, the youngest
+ * producer winning. A load in the execute group has no result yet and
+ * hides any older producer of the same group; the scoreboard keeps the
+ * reader in decode until the load leaves MEM.
+ */
+static int
+read_source(APEX_CPU *cpu, const int reg)
+{
+    int i, value = cpu->regs[reg], wb_hit = -1, ex_hit = -1;
+
+    if (!cpu->forward_flag)
+    {
+        return value;
+    }
+
+    for (i = 0; i < cpu->width; ++i)
+    {
+        if (writes_rd(&cpu->writeback_group[i])
+            && cpu->writeback_group[i].rd == reg)
+        {
+            wb_hit = i;
+        }
+        if (writes_rd(&cpu->execute_group[i])
+            && cpu->execute_group[i].rd == reg)
+        {
+            ex_hit = is_load(&cpu->execute_group[i]) ? -1 : i;
+        }
+    }
+
+    /* Only count forwards from slots still in flight: execute has moved
+     * its group on to MEM by now, and a stale writeback slot has already
+     * updated the register file */
+    if (ex_hit >= 0)
+    {
+        if (cpu->execute_group[ex_hit].has_insn
+            || (cpu->memory_group[ex_hit].has_insn
+                && cpu->memory_group[ex_hit].pc
+                       == cpu->execute_group[ex_hit].pc))
+        {
+            cpu->stats.fwd_from_execute++;
+        }
+        return cpu->execute_group[ex_hit].result_buffer;
+    }
+    if (wb_hit >= 0)
+    {
+        if (cpu->writeback_group[wb_hit].has_insn)
+        {
+            cpu->stats.fwd_from_writeback++;
+        }
+        return cpu->writeback_group[wb_hit].result_buffer;
+    }
+    return value;
+}
+
+static int *
+source_value(CPU_Stage *stage, const int n)
+{
+    return n == 0 ? &stage->rs1_value : n == 1 ? &stage->rs2_value
+                                               : &stage->rs3_value;
+}
+
+/*
+ * Returns the TRACE_STALL_* reason slot cannot issue behind the slots
+ * already issued this cycle, or TRACE_STALL_NONE.
+ */
+static int
+issue_hazard(const APEX_CPU *cpu, const CPU_Stage *slot,
+             const CPU_Stage *issue, const int issued)
+{
+    int src[3], n, i, j, fu, busy = 0;
+
+    fu = APEX_fu_class(slot->opcode);
+    n = get_source_regs(slot, src);
+    for (i = 0; i < issued; ++i)
+    {
+        const CPU_Stage *older = &issue[i];
+
+        if (is_branch(older))
+        {
+            return TRACE_STALL_GROUP;
+        }
+        if (is_branch(slot) && sets_zero_flag(older))
+        {
+            return TRACE_STALL_GROUP;
+        }
+        for (j = 0; j < n && writes_rd(older); ++j)
+        {
+            if (src[j] == older->rd)
+            {
+                return TRACE_STALL_GROUP;
+            }
+        }
+        if (fu != FU_NONE && APEX_fu_class(older->opcode) == fu)
+        {
+            busy++;
+        }
+    }
+
+    if (fu != FU_NONE && busy >= cpu->fu.count[fu])
+    {
+        return TRACE_STALL_FU_BUSY;
+    }
+
+    for (j = 0; j < n; ++j)
+    {
+        if (cpu->arr[src[j]] != 0)
+        {
+            if (cpu->forward_flag)
+            {
+                return TRACE_STALL_LOAD_USE;
+            }
+            return TRACE_STALL_RAW_RS1 + j;
+        }
+    }
+
+    return APEX_fu_hazard(cpu, slot);
+}
+
+static void
+count_stall(APEX_CPU *cpu, const int reason)
+{
+    switch (reason)
+    {
+        case TRACE_STALL_RAW_RS1: cpu->stats.stall_raw_rs1++; break;
+        case TRACE_STALL_RAW_RS2: cpu->stats.stall_raw_rs2++; break;
+        case TRACE_STALL_RAW_RS3: cpu->stats.stall_raw_rs3++; break;
+        case TRACE_STALL_LOAD_USE: cpu->stats.stall_load_use++; break;
+        case TRACE_STALL_GROUP: cpu->stats.stall_group_dep++; break;
+        case TRACE_STALL_FU_LATENCY: cpu->stats.stall_fu_latency++; break;
+        case TRACE_STALL_FU_BUSY: cpu->stats.stall_fu_busy++; break;
+    }
+}
+
+/* Returns TRUE when fetch faulted */
+static int
+APEX_fetch_wide(APEX_CPU *cpu)
+{
+    const APEX_Instruction *current_ins;
+    CPU_Stage *slot;
+    int n, index, end, line_size = 0;
+
+    if (!cpu->fetch.has_insn)
+    {
+        return FALSE;
+    }
+
+    /* This fetches new branch target instruction from next cycle */
+    if (cpu->fetch_from_next_cycle == TRUE)
+    {
+        cpu->fetch_from_next_cycle = FALSE;
+        cpu->fetch_stall = 0;
+        cpu->stats.stall_branch_bubble++;
+        if (cpu->trace)
+        {
+            APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_FETCH,
+                             &cpu->fetch, TRACE_STALL_BRANCH);
+        }
+        return FALSE;
+    }
+
+    /* Fill the decode slots behind those still waiting to issue */
+    for (n = 0; n < cpu->width && cpu->decode_group[n].has_insn; ++n)
+        ;
+    if (n == cpu->width)
+    {
+        return FALSE;
+    }
+
+    index = APEX_program_index(&cpu->program, cpu->pc);
+    if (APEX_UNLIKELY(index < 0))
+    {
+        return APEX_fetch_fault(cpu,
+                                n == 0
+                                && group_empty(cpu->execute_group, cpu->width)
+                                && group_empty(cpu->memory_group, cpu->width)
+                                && group_empty(cpu->writeback_group, cpu->width));
+    }
+    end = APEX_program_segment_end(&cpu->program);
+
+    /* A fetch group reads one instruction cache line, whose miss holds
+     * the whole group */
+    if (cpu->icache)
+    {
+        if (cpu->fetch_stall == 0)
+        {
+            cpu->fetch_stall = APEX_fetch_latency(cpu, cpu->pc, index);
+        }
+        if (--cpu->fetch_stall > 0)
+        {
+            cpu->stats.stall_icache++;
+            if (cpu->trace)
+            {
+                APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_FETCH,
+                                 &cpu->fetch, TRACE_STALL_ICACHE);
+            }
+            return FALSE;
+        }
+        line_size = APEX_cache_config(cpu->icache)->line_size;
+    }
+
+    for (; n < cpu->width && cpu->fetch.has_insn; ++n)
+    {
+        slot = &cpu->decode_group[n];
+        current_ins = &cpu->program.code[index];
+
+        *slot = empty_slot;
+        slot->pc = cpu->pc;
+        slot->opcode = current_ins->opcode;
+        slot->rd = current_ins->rd;
+        slot->rs1 = current_ins->rs1;
+        slot->rs2 = current_ins->rs2;
+        slot->rs3 = current_ins->rs3;
+        slot->imm = current_ins->imm;
+        slot->has_insn = TRUE;
+        cpu->pc += 4;
+
+        if (cpu->trace)
+        {
+            APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_FETCH, slot,
+                             TRACE_STALL_NONE);
+        }
+
+        /* Stop fetching new instructions if HALT is fetched */
+        if (slot->opcode == OPCODE_HALT)
+        {
+            cpu->fetch.has_insn = FALSE;
+        }
+
+        if (line_size && ((unsigned int)cpu->pc / 4) % line_size == 0)
+        {
+            break;
+        }
+
+        /* The group ends where the segment does */
+        if (++index == end)
+        {
+            break;
+        }
+    }
+    return FALSE;
+}
+
+static void
+APEX_decode_wide(APEX_CPU *cpu)
+{
+    CPU_Stage issue[APEX_MAX_WIDTH];
+    CPU_Stage *slot;
+    int src[3], n, i, j, issued = 0, reason = TRACE_STALL_NONE;
+
+    if (group_empty(cpu->decode_group, cpu->width))
+    {
+        return;
+    }
+
+    /* Execute is held behind a data cache miss */
+    if (!group_empty(cpu->execute_group, cpu->width))
+    {
+        if (cpu->trace)
+        {
+            for (j = 0; j < cpu->width && cpu->decode_group[j].has_insn; ++j)
+            {
+                APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_DECODE,
+                                 &cpu->decode_group[j], TRACE_STALL_DCACHE);
+            }
+        }
+        return;
+    }
+
+    for (i = 0; i < cpu->width && cpu->decode_group[i].has_insn; ++i)
+    {
+        slot = &cpu->decode_group[i];
+        reason = issue_hazard(cpu, slot, issue, issued);
+        if (reason != TRACE_STALL_NONE)
+        {
+            break;
+        }
+
+        /* Read operands from register file based on the instruction type */
+        n = get_source_regs(slot, src);
+        for (j = 0; j < n; ++j)
+        {
+            *source_value(slot, j) = read_source(cpu, src[j]);
+        }
+
+        /* Without forwarding every result is held until writeback, with
+         * forwarding only load results are, until MEM */
+        if (writes_rd(slot) && (!cpu->forward_flag || is_load(slot)))
+        {
+            cpu->arr[slot->rd]++;
+        }
+
+        issue[issued++] = *slot;
+    }
+
+    if (reason != TRACE_STALL_NONE)
+    {
+        count_stall(cpu, reason);
+    }
+
+    /* The execute group keeps the previous group for forwarding until a
+     * new one issues */
+    if (issued)
+    {
+        for (j = 0; j < cpu->width; ++j)
+        {
+            cpu->execute_group[j] = j < issued ? issue[j] : empty_slot;
+        }
+
+        /* Slots left behind move to the front */
+        for (j = 0; j + issued < cpu->width; ++j)
+        {
+            cpu->decode_group[j] = cpu->decode_group[j + issued];
+        }
+        for (; j < cpu->width; ++j)
+        {
+            cpu->decode_group[j] = empty_slot;
+        }
+    }
+
+    if (cpu->trace)
+    {
+        trace_group(cpu, TRACE_STAGE_DECODE, cpu->execute_group);
+        for (j = 0; j < cpu->width && cpu->decode_group[j].has_insn; ++j)
+        {
+            APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_DECODE,
+                             &cpu->decode_group[j], reason);
+        }
+    }
+}
+
+static void
+APEX_execute_wide(APEX_CPU *cpu)
+{
+    const APEX_Opcode_Info *info;
+    CPU_Stage *slot;
+    int i, j;
+
+    if (group_empty(cpu->execute_group, cpu->width))
+    {
+        return;
+    }
+
+    /* MEM is still busy with a data cache miss */
+    if (!group_empty(cpu->memory_group, cpu->width))
+    {
+        trace_group_stalled(cpu, TRACE_STAGE_EXECUTE, cpu->execute_group,
+                            TRACE_STALL_DCACHE);
+        return;
+    }
+
+    for (i = 0; i < cpu->width; ++i)
+    {
+        slot = &cpu->execute_group[i];
+        if (!slot->has_insn)
+        {
+            continue;
+        }
+
+        APEX_fu_issue(cpu, slot);
+
+        /* Execute logic based on instruction type */
+        info = get_opcode_info(slot->opcode);
+        if (info->mem != MEM_NONE)
+        {
+            slot->memory_address = APEX_mem_address(info->addr, slot->rs1_value,
+                                                    slot->rs2_value, slot->imm);
+        }
+        else if (info->cond != COND_NONE)
+        {
+            if ((info->cond == COND_Z) == (cpu->zero_flag == TRUE))
+            {
+                /* Branches end their issue group, so only the decode
+                 * group and fetch hold wrong-path instructions */
+                cpu->pc = slot->pc + slot->imm;
+                cpu->fetch_from_next_cycle = TRUE;
+                for (j = 0; j < cpu->width; ++j)
+                {
+                    cpu->decode_group[j] = empty_slot;
+                }
+                cpu->stats.flushes++;
+                cpu->fetch.has_insn = TRUE;
+            }
+        }
+        else if (info->dest & DEST_RD)
+        {
+            /* MOVC reads no register, ADDL/SUBL take imm for rs2 */
+            slot->result_buffer = !info->src ? slot->imm
+                : APEX_alu(cpu, slot->opcode, slot->rs1_value,
+                           (info->src & SRC_RS2) ? slot->rs2_value : slot->imm);
+        }
+        else if (info->sets_flags)
+        {
+            /* CMP */
+            cpu->zero_flag = (slot->rs1_value == slot->rs2_value)
+                                 ? TRUE : FALSE;
+        }
+    }
+
+    if (cpu->trace)
+    {
+        trace_group(cpu, TRACE_STAGE_EXECUTE, cpu->execute_group);
+    }
+
+    /* Copy data from execute group to memory group */
+    advance_group(cpu->memory_group, cpu->execute_group, cpu->width);
+}
+
+/* Returns TRUE when an access faulted. The oldest faulting slot is
+ * reported and the whole group stays in MEM */
+static int
+APEX_memory_wide(APEX_CPU *cpu)
+{
+    const APEX_Opcode_Info *info;
+    CPU_Stage *slot;
+    int i, latency;
+
+    if (group_empty(cpu->memory_group, cpu->width))
+    {
+        return FALSE;
+    }
+
+    /* The slots access the cache in parallel, the slowest one decides */
+    if (cpu->mem_stall == 0)
+    {
+        for (i = 0; i < cpu->width; ++i)
+        {
+            if (cpu->memory_group[i].has_insn)
+            {
+                latency = APEX_memory_latency(cpu, &cpu->memory_group[i]);
+                if (APEX_UNLIKELY(latency == 0))
+                {
+                    cpu->mem_stall = 0;
+                    return TRUE;
+                }
+                if (latency > cpu->mem_stall)
+                {
+                    cpu->mem_stall = latency;
+                }
+            }
+        }
+    }
+    if (--cpu->mem_stall > 0)
+    {
+        cpu->stats.stall_dcache++;
+        trace_group_stalled(cpu, TRACE_STAGE_MEMORY, cpu->memory_group,
+                            TRACE_STALL_DCACHE);
+        return FALSE;
+    }
+
+    for (i = 0; i < cpu->width; ++i)
+    {
+        slot = &cpu->memory_group[i];
+        if (!slot->has_insn)
+        {
+            continue;
+        }
+
+        info = get_opcode_info(slot->opcode);
+        if (info->mem == MEM_LOAD)
+        {
+            slot->result_buffer = APEX_mem_read(&cpu->data_memory,
+                                                slot->memory_address);
+            if (cpu->forward_flag)
+            {
+                cpu->arr[slot->rd]--;
+            }
+        }
+        else if (info->mem == MEM_STORE)
+        {
+            /* STR stores rs3, STORE stores rs1 */
+            APEX_mem_write(&cpu->data_memory, slot->memory_address,
+                           (info->src & SRC_RS3) ? slot->rs3_value
+                                                 : slot->rs1_value);
+        }
+    }
+
+    if (cpu->trace)
+    {
+        trace_group(cpu, TRACE_STAGE_MEMORY, cpu->memory_group);
+    }
+
+    /* Copy data from memory group to writeback group */
+    advance_group(cpu->writeback_group, cpu->memory_group, cpu->width);
+    return FALSE;
+}
+
+/* Returns TRUE when HALT retires */
+static int
+APEX_writeback_wide(APEX_CPU *cpu)
+{
+    CPU_Stage *slot;
+    int i;
+
+    for (i = 0; i < cpu->width; ++i)
+    {
+        slot = &cpu->writeback_group[i];
+        if (!slot->has_insn)
+        {
+            continue;
+        }
+
+        /* HALT retires once the last multi-cycle result is written */
+        if (slot->opcode == OPCODE_HALT && APEX_fu_draining(cpu))
+        {
+            cpu->stats.stall_fu_latency++;
+            if (cpu->trace)
+            {
+                APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_WRITEBACK,
+                                 slot, TRACE_STALL_FU_LATENCY);
+            }
+            return FALSE;
+        }
+
+        if (writes_rd(slot))
+        {
+            cpu->regs[slot->rd] = slot->result_buffer;
+            if (!cpu->forward_flag)
+            {
+                cpu->arr[slot->rd]--;
+            }
+        }
+
+        cpu->insn_completed++;
+        cpu->stats.retired[slot->opcode]++;
+        slot->has_insn = FALSE;
+
+        if (cpu->trace)
+        {
+            APEX_trace_stage(cpu->trace, cpu->clock, TRACE_STAGE_WRITEBACK,
+                             slot, TRACE_STALL_NONE);
+        }
+
+        if (slot->opcode == OPCODE_HALT)
+        {
+            /* Stop the APEX simulator */
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * Runs every stage of the superscalar pipeline once, in reverse order.
+ * Returns the same status as APEX_cpu_cycle.
+ */
+int
+APEX_cpu_cycle_wide(APEX_CPU *cpu)
+{
+    if (APEX_writeback_wide(cpu))
+    {
+        return APEX_HALTED;
+    }
+
+    if (APEX_memory_wide(cpu))
+    {
+        return APEX_FAULTED;
+    }
+    APEX_execute_wide(cpu);
+    APEX_decode_wide(cpu);
+    if (APEX_fetch_wide(cpu))
+    {
+        return APEX_FAULTED;
+    }
+    return APEX_RUNNING;
+}
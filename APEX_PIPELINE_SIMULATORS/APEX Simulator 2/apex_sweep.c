@@ -0,0 +1,493 @@
+/*
+ * apex_sweep.c
+ * Parameter-sweep driver: runs a manifest of (program, config) jobs on a
+ * fixed-size pool of worker threads, one APEX_CPU per job, and writes one
+ * CSV result row per job.
+ *
+ * Manifest format, one job per line ('#' starts a comment):
+ *
+ *   <input_file> [fwd y|n] [cycles <N>] [width <N>] [mem_size <words>]
+ *                [code_base <pc>] [dmem <file>[@<addr>]]
+ *                [alus <N>] [muls <N>] [agus <N>] [mul_latency <N>]
+ *                [div_latency <N>]
+ *                [dcache <words>] [dcache_assoc <N>] [dcache_line <words>]
+ *                [dcache_repl lru|plru|random] [dcache_write wb|wt]
+ *                [dcache_hit <N>] [dcache_miss <N>] [dcache_prefetch y|n]
+ *                [icache <insns>] [icache_...], as for dcache
+ *
+ * Jobs are dealt round-robin onto per-worker deques. A worker pops from the
+ * bottom of its own deque and, once empty, steals from the top of the other
+ * workers' deques, so long and short programs balance across the pool.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+
+/* Mode number understood by APEX_cpu_init for headless runs */
+#define SWEEP_CPU_MODE 5
+
+typedef struct Sweep_Job
+{
+    char program[256];
+    int forward_flag;
+    int cycles;                    /* Cycle budget, 0 = run to HALT */
+    int width;                     /* Pipeline width, see APEX_cpu_set_width */
+    unsigned int mem_size;         /* Data memory words, see APEX_cpu_set_mem_size */
+    int code_base;                 /* Entry PC, -1 = as assembled */
+    char dmem[256];                /* Data memory image, "" = none */
+    unsigned int dmem_addr;        /* Word it is loaded at */
+    APEX_FU_Config fu;             /* Functional units, see APEX_fu_configure */
+    APEX_Cache_Config dcache;      /* Data cache, see APEX_cpu_set_dcache */
+    APEX_Cache_Config icache;      /* Instruction cache, see APEX_cpu_set_icache */
+    int parse_error;               /* Manifest line did not parse, job is not run */
+
+    /* Results */
+    int loaded;
+    int status;                    /* cpu->status at the end of the run */
+    APEX_Fault fault;
+    int clock;
+    int insn_completed;
+    int zero_flag;
+    int dcache_misses;
+    int icache_misses;
+} Sweep_Job;
+
+typedef struct Sweep_Deque
+{
+    pthread_mutex_t lock;
+    int *jobs;                     /* Job indices */
+    int top;                       /* Steal end */
+    int bottom;                    /* Owner end, one past the last job */
+} Sweep_Deque;
+
+typedef struct Sweep_Pool
+{
+    Sweep_Job *jobs;
+    Sweep_Deque *deques;
+    int num_workers;
+} Sweep_Pool;
+
+typedef struct Sweep_Worker
+{
+    Sweep_Pool *pool;
+    int id;
+} Sweep_Worker;
+
+static int
+deque_pop_bottom(Sweep_Deque *dq)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top)
+    {
+        job = dq->jobs[--dq->bottom];
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return job;
+}
+
+static int
+deque_steal_top(Sweep_Deque *dq)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top)
+    {
+        job = dq->jobs[dq->top++];
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return job;
+}
+
+static void
+run_job(Sweep_Job *job)
+{
+    APEX_CPU *cpu;
+
+    if (job->parse_error)
+    {
+        return;
+    }
+
+    cpu = APEX_cpu_init(job->program, SWEEP_CPU_MODE, job->cycles,
+                        job->forward_flag);
+    if (!cpu)
+    {
+        return;
+    }
+    if ((job->code_base >= 0 && APEX_cpu_set_code_base(cpu, job->code_base) != 0)
+        || APEX_cpu_set_width(cpu, job->width) != 0
+        || APEX_cpu_set_mem_size(cpu, job->mem_size) != 0
+        || APEX_cpu_load_data(cpu) != 0
+        || (job->dmem[0]
+            && APEX_mem_load_image(&cpu->data_memory, job->dmem,
+                                   job->dmem_addr) != 0)
+        || APEX_fu_configure(cpu, &job->fu) != 0
+        || APEX_cpu_set_dcache(cpu, &job->dcache) != 0
+        || APEX_cpu_set_icache(cpu, &job->icache) != 0)
+    {
+        APEX_cpu_stop(cpu);
+        return;
+    }
+
+    job->loaded = TRUE;
+    while (TRUE)
+    {
+        if (APEX_cpu_step(cpu))
+        {
+            break;
+        }
+
+        if (job->cycles > 0 && cpu->clock >= job->cycles)
+        {
+            break;
+        }
+    }
+
+    job->status = cpu->status;
+    job->fault = cpu->fault;
+    job->clock = cpu->clock;
+    job->insn_completed = cpu->insn_completed;
+    job->zero_flag = cpu->zero_flag;
+    if (cpu->dcache)
+    {
+        job->dcache_misses = APEX_cache_stats(cpu->dcache)->misses;
+    }
+    if (cpu->icache)
+    {
+        job->icache_misses = APEX_cache_stats(cpu->icache)->misses;
+    }
+    APEX_cpu_stop(cpu);
+}
+
+static void *
+worker_main(void *arg)
+{
+    Sweep_Worker *worker = arg;
+    Sweep_Pool *pool = worker->pool;
+    int i, job;
+
+    while (TRUE)
+    {
+        job = deque_pop_bottom(&pool->deques[worker->id]);
+
+        /* Own deque is empty, try to steal from the others */
+        for (i = 1; job < 0 && i < pool->num_workers; ++i)
+        {
+            job = deque_steal_top(
+                &pool->deques[(worker->id + i) % pool->num_workers]);
+        }
+
+        /* No work left anywhere; jobs are never re-queued so we are done */
+        if (job < 0)
+        {
+            break;
+        }
+
+        run_job(&pool->jobs[job]);
+    }
+
+    return NULL;
+}
+
+/*
+ * Parses one manifest line into a job. Returns FALSE for blank and comment
+ * lines. A line that does not parse still makes a job, flagged with
+ * parse_error so its row reports it.
+ */
+static int
+parse_manifest_line(char *line, Sweep_Job *job, const char *manifest,
+                    int line_num)
+{
+    char *saveptr;
+    char *token;
+    char *at;
+
+    token = strchr(line, '#');
+    if (token)
+    {
+        *token = '\0';
+    }
+
+    token = strtok_r(line, " \t\r\n", &saveptr);
+    if (!token)
+    {
+        return FALSE;
+    }
+
+    memset(job, 0, sizeof(*job));
+    snprintf(job->program, sizeof(job->program), "%s", token);
+    job->width = 1;
+    job->mem_size = DATA_MEMORY_SIZE;
+    job->code_base = -1;
+    APEX_fu_default_config(&job->fu);
+    APEX_cache_default_config(&job->dcache);
+    APEX_cache_default_config(&job->icache);
+
+    while ((token = strtok_r(NULL, " \t\r\n", &saveptr)) != NULL)
+    {
+        char *value = strtok_r(NULL, " \t\r\n", &saveptr);
+
+        if (!value)
+        {
+            fprintf(stderr, "APEX_Sweep: %s:%d: missing value for '%s'\n",
+                    manifest, line_num, token);
+            job->parse_error = TRUE;
+            break;
+        }
+
+        if (strcmp(token, "fwd") == 0)
+        {
+            job->forward_flag = (strcmp(value, "y") == 0);
+        }
+        else if (strcmp(token, "cycles") == 0)
+        {
+            job->cycles = atoi(value);
+        }
+        else if (strcmp(token, "width") == 0)
+        {
+            job->width = atoi(value);
+        }
+        else if (strcmp(token, "mem_size") == 0)
+        {
+            if (APEX_mem_parse_size(value, &job->mem_size) != 0)
+            {
+                fprintf(stderr, "APEX_Sweep: %s:%d: invalid mem_size '%s'\n",
+                        manifest, line_num, value);
+                job->parse_error = TRUE;
+            }
+        }
+        else if (strcmp(token, "code_base") == 0)
+        {
+            if (APEX_parse_code_address(value, &job->code_base) != 0)
+            {
+                fprintf(stderr, "APEX_Sweep: %s:%d: invalid code_base '%s'\n",
+                        manifest, line_num, value);
+                job->parse_error = TRUE;
+            }
+        }
+        else if (strcmp(token, "dmem") == 0)
+        {
+            snprintf(job->dmem, sizeof(job->dmem), "%s", value);
+            at = strrchr(job->dmem, '@');
+            if (at)
+            {
+                *at = '\0';
+                if (APEX_mem_parse_addr(at + 1, &job->dmem_addr) != 0)
+                {
+                    fprintf(stderr, "APEX_Sweep: %s:%d: invalid dmem address '%s'\n",
+                            manifest, line_num, at + 1);
+                    job->parse_error = TRUE;
+                }
+            }
+        }
+        else if (!APEX_fu_parse_option(&job->fu, token, value)
+                 && !APEX_cache_parse_option(&job->dcache, "dcache", token,
+                                             value)
+                 && !APEX_cache_parse_option(&job->icache, "icache", token,
+                                             value))
+        {
+            fprintf(stderr, "APEX_Sweep: %s:%d: unknown option '%s'\n",
+                    manifest, line_num, token);
+            job->parse_error = TRUE;
+        }
+    }
+
+    return TRUE;
+}
+
+static Sweep_Job *
+read_manifest(const char *manifest, int *num_jobs)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    int line_num = 0, capacity = 16;
+    Sweep_Job *jobs;
+
+    *num_jobs = 0;
+    fp = fopen(manifest, "r");
+    if (!fp)
+    {
+        return NULL;
+    }
+
+    jobs = malloc(capacity * sizeof(Sweep_Job));
+    while (jobs && getline(&line, &len, fp) != -1)
+    {
+        line_num++;
+        if (*num_jobs == capacity)
+        {
+            Sweep_Job *grown = realloc(jobs, 2 * capacity * sizeof(Sweep_Job));
+
+            if (!grown)
+            {
+                free(jobs);
+                jobs = NULL;
+                break;
+            }
+            jobs = grown;
+            capacity *= 2;
+        }
+
+        if (parse_manifest_line(line, &jobs[*num_jobs], manifest, line_num))
+        {
+            (*num_jobs)++;
+        }
+    }
+
+    free(line);
+    fclose(fp);
+    return jobs;
+}
+
+static void
+write_results(FILE *out, const Sweep_Job *jobs, int num_jobs)
+{
+    char dcache[64], icache[64], fault[32];
+    int i;
+
+    fprintf(out, "job,program,fwd,width,mem_size,alus,muls,agus,mul_latency,div_latency,"
+            "dcache,icache,budget,status,cycles,instructions,zero_flag,"
+            "dcache_misses,icache_misses,fault_pc,fault_address\n");
+    for (i = 0; i < num_jobs; ++i)
+    {
+        const Sweep_Job *job = &jobs[i];
+
+        APEX_cache_format(&job->dcache, dcache, sizeof(dcache));
+        APEX_cache_format(&job->icache, icache, sizeof(icache));
+        if (job->status == APEX_FAULTED)
+        {
+            snprintf(fault, sizeof(fault), "%d,%d", job->fault.pc,
+                     job->fault.address);
+        }
+        else
+        {
+            snprintf(fault, sizeof(fault), ",");
+        }
+        fprintf(out, "%d,%s,%s,%d,%u,%d,%d,%d,%d,%d,%s,%s,%d,%s,%d,%d,%d,%d,%d,%s\n", i,
+                job->program, job->forward_flag ? "y" : "n", job->width,
+                job->mem_size,
+                job->fu.count[FU_ALU], job->fu.count[FU_MUL],
+                job->fu.count[FU_AGU], job->fu.latency[FU_MUL],
+                job->fu.latency[FU_DIV], dcache, icache, job->cycles,
+                job->parse_error ? "parse_error"
+                    : (!job->loaded ? "load_error" : APEX_status_str(job->status)),
+                job->clock, job->insn_completed, job->zero_flag,
+                job->dcache_misses, job->icache_misses, fault);
+    }
+}
+
+int
+main(int argc, char const *argv[])
+{
+    int i, num_jobs, num_workers;
+    Sweep_Job *jobs;
+    Sweep_Pool pool;
+    Sweep_Worker *workers;
+    pthread_t *threads;
+    FILE *out = stdout;
+
+    if (argc < 2)
+    {
+        fprintf(stderr,
+                "APEX_Help: Usage %s <manifest> [threads] [output.csv]\n",
+                argv[0]);
+        exit(1);
+    }
+
+    jobs = read_manifest(argv[1], &num_jobs);
+    if (!jobs)
+    {
+        fprintf(stderr, "APEX_Error: Unable to read manifest %s\n", argv[1]);
+        exit(1);
+    }
+
+    num_workers = (argc > 2) ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_workers < 1)
+    {
+        num_workers = 1;
+    }
+    if (num_jobs > 0 && num_workers > num_jobs)
+    {
+        num_workers = num_jobs;
+    }
+
+    if (argc > 3)
+    {
+        out = fopen(argv[3], "w");
+        if (!out)
+        {
+            fprintf(stderr, "APEX_Error: Unable to open %s\n", argv[3]);
+            exit(1);
+        }
+    }
+
+    pool.jobs = jobs;
+    pool.num_workers = num_workers;
+    pool.deques = calloc(num_workers, sizeof(Sweep_Deque));
+    workers = calloc(num_workers, sizeof(Sweep_Worker));
+    threads = calloc(num_workers, sizeof(pthread_t));
+    if (!pool.deques || !workers || !threads)
+    {
+        fprintf(stderr, "APEX_Error: Out of memory\n");
+        exit(1);
+    }
+
+    /* Deal jobs round-robin so every worker starts with a share */
+    for (i = 0; i < num_workers; ++i)
+    {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        pool.deques[i].jobs = malloc((num_jobs / num_workers + 1) * sizeof(int));
+        if (!pool.deques[i].jobs)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < num_jobs; ++i)
+    {
+        Sweep_Deque *dq = &pool.deques[i % num_workers];
+
+        dq->jobs[dq->bottom++] = i;
+    }
+
+    for (i = 0; i < num_workers; ++i)
+    {
+        workers[i].pool = &pool;
+        workers[i].id = i;
+        if (pthread_create(&threads[i], NULL, worker_main, &workers[i]) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to start worker %d\n", i);
+            exit(1);
+        }
+    }
+
+    for (i = 0; i < num_workers; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    write_results(out, jobs, num_jobs);
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    for (i = 0; i < num_workers; ++i)
+    {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+        free(pool.deques[i].jobs);
+    }
+    free(pool.deques);
+    free(workers);
+    free(threads);
+    free(jobs);
+    return 0;
+}
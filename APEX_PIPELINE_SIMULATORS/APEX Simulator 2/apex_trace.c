@@ -0,0 +1,178 @@
+/*
+ * apex_trace.c
+ * Binary pipeline trace writer.
+ *
+ * The simulator thread appends records to a single-producer/single-consumer
+ * ring buffer; a background thread drains it to the trace file. head is only
+ * written by the producer and tail only by the writer, so the ring needs no
+ * lock, just acquire/release ordering on the two indices. When the ring is
+ * full the producer yields until the writer catches up, so no record is
+ * ever dropped.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "apex_trace.h"
+
+/* Ring capacity in records, a power of two */
+#define TRACE_RING_SIZE (1 << 16)
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+struct APEX_Trace
+{
+    APEX_Trace_Record ring[TRACE_RING_SIZE];
+    atomic_uint head;              /* Next slot to fill, producer owned */
+    atomic_uint tail;              /* Next slot to drain, writer owned */
+    atomic_int done;               /* Set by APEX_trace_close */
+    int error;                     /* Write failure seen by the writer */
+    FILE *fp;
+    pthread_t writer;
+};
+
+/* Writes out everything currently in the ring. Returns FALSE if it was empty */
+static int
+trace_drain(APEX_Trace *trace)
+{
+    unsigned int tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&trace->head, memory_order_acquire);
+    unsigned int start, count;
+
+    if (head == tail)
+    {
+        return FALSE;
+    }
+
+    while (tail != head)
+    {
+        /* Contiguous chunk up to the wrap point */
+        start = tail & TRACE_RING_MASK;
+        count = head - tail;
+        if (count > TRACE_RING_SIZE - start)
+        {
+            count = TRACE_RING_SIZE - start;
+        }
+
+        if (fwrite(&trace->ring[start], sizeof(APEX_Trace_Record), count,
+                   trace->fp) != count)
+        {
+            trace->error = TRUE;
+        }
+
+        tail += count;
+        atomic_store_explicit(&trace->tail, tail, memory_order_release);
+    }
+
+    return TRUE;
+}
+
+static void *
+trace_writer_main(void *arg)
+{
+    APEX_Trace *trace = arg;
+    const struct timespec idle = {0, 200000};
+
+    while (!atomic_load_explicit(&trace->done, memory_order_acquire))
+    {
+        if (!trace_drain(trace))
+        {
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    /* Producer has stopped, pick up whatever it appended last */
+    trace_drain(trace);
+    return NULL;
+}
+
+/*
+ * Creates filename, writes the trace header and starts the writer thread.
+ * Returns NULL on failure.
+ */
+APEX_Trace *
+APEX_trace_open(const char *filename)
+{
+    APEX_Trace *trace;
+    APEX_Trace_Header header;
+
+    trace = calloc(1, sizeof(APEX_Trace));
+    if (!trace)
+    {
+        return NULL;
+    }
+
+    trace->fp = fopen(filename, "wb");
+    if (!trace->fp)
+    {
+        free(trace);
+        return NULL;
+    }
+
+    header.magic = APEX_TRACE_MAGIC;
+    header.version = APEX_TRACE_VERSION;
+    header.record_size = sizeof(APEX_Trace_Record);
+    header.reserved = 0;
+
+    if (fwrite(&header, sizeof(header), 1, trace->fp) != 1
+        || pthread_create(&trace->writer, NULL, trace_writer_main, trace) != 0)
+    {
+        fclose(trace->fp);
+        free(trace);
+        return NULL;
+    }
+
+    return trace;
+}
+
+/*
+ * Appends the contents of a stage latch. Called from the simulator thread
+ * only.
+ */
+void
+APEX_trace_stage(APEX_Trace *trace, int cycle, int stage,
+                 const CPU_Stage *latch, int stall)
+{
+    unsigned int head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    APEX_Trace_Record *rec;
+
+    /* Ring full, wait for the writer */
+    while (head - atomic_load_explicit(&trace->tail, memory_order_acquire)
+           == TRACE_RING_SIZE)
+    {
+        sched_yield();
+    }
+
+    rec = &trace->ring[head & TRACE_RING_MASK];
+    rec->cycle = cycle;
+    rec->stage = stage;
+    rec->stall = stall;
+    rec->pc = latch->pc;
+    rec->opcode = latch->opcode;
+    rec->rd = latch->rd;
+    rec->rs1 = latch->rs1;
+    rec->rs2 = latch->rs2;
+    rec->rs3 = latch->rs3;
+    rec->imm = latch->imm;
+
+    atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+}
+
+/*
+ * Flushes all pending records, stops the writer and closes the file.
+ * Returns 0 on success, -1 if any write failed.
+ */
+int
+APEX_trace_close(APEX_Trace *trace)
+{
+    int ret;
+
+    atomic_store_explicit(&trace->done, TRUE, memory_order_release);
+    pthread_join(trace->writer, NULL);
+
+    ret = (fclose(trace->fp) != 0 || trace->error) ? -1 : 0;
+    free(trace);
+    return ret;
+}
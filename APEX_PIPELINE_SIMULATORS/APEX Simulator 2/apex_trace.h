@@ -0,0 +1,42 @@
+/*
+ * apex_trace.h
+ * Binary pipeline trace: fixed-size stage records written by the simulator
+ * and rendered as text by apex_trace_dump
+ */
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+
+#include "apex_cpu.h"
+
+/* Header at the start of a trace file, followed by APEX_Trace_Record
+ * records in host byte order until end of file */
+typedef struct APEX_Trace_Header
+{
+    unsigned int magic;            /* APEX_TRACE_MAGIC */
+    unsigned int version;          /* APEX_TRACE_VERSION */
+    unsigned int record_size;      /* sizeof(APEX_Trace_Record) */
+    unsigned int reserved;
+} APEX_Trace_Header;
+
+/* One stage latch in one cycle */
+typedef struct APEX_Trace_Record
+{
+    int cycle;
+    short stage;                   /* TRACE_STAGE_* */
+    short stall;                   /* TRACE_STALL_* */
+    int pc;
+    int opcode;
+    int rd;
+    int rs1;
+    int rs2;
+    int rs3;
+    int imm;
+} APEX_Trace_Record;
+
+typedef struct APEX_Trace APEX_Trace;
+
+APEX_Trace *APEX_trace_open(const char *filename);
+void APEX_trace_stage(APEX_Trace *trace, int cycle, int stage,
+                      const CPU_Stage *latch, int stall);
+int APEX_trace_close(APEX_Trace *trace);
+#endif
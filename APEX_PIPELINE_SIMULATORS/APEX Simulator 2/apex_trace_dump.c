@@ -0,0 +1,134 @@
+/*
+ * apex_trace_dump.c
+ * Renders a binary trace written by 'apex_sim ... batch ... trace <file>'
+ * in the same text format as the simulator's per-cycle display, with the
+ * stall cause appended to stalled stages.
+ *
+ * Usage: apex_trace_dump <trace_file> [first_cycle [last_cycle]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "apex_trace.h"
+
+static const char *stage_names[] = {
+    [TRACE_STAGE_FETCH] = "Fetch",
+    [TRACE_STAGE_DECODE] = "Decode/RF",
+    [TRACE_STAGE_EXECUTE] = "Execute",
+    [TRACE_STAGE_MEMORY] = "Memory",
+    [TRACE_STAGE_WRITEBACK] = "Writeback",
+};
+
+static const char *stall_names[] = {
+    [TRACE_STALL_NONE] = "",
+    [TRACE_STALL_RAW_RS1] = "raw rs1",
+    [TRACE_STALL_RAW_RS2] = "raw rs2",
+    [TRACE_STALL_RAW_RS3] = "raw rs3",
+    [TRACE_STALL_LOAD_USE] = "load-use",
+    [TRACE_STALL_BRANCH] = "branch bubble",
+    [TRACE_STALL_GROUP] = "group dependency",
+    [TRACE_STALL_FU_LATENCY] = "functional unit latency",
+    [TRACE_STALL_FU_BUSY] = "functional unit busy",
+    [TRACE_STALL_DCACHE] = "data cache miss",
+    [TRACE_STALL_ICACHE] = "instruction cache miss",
+};
+
+static void
+print_record(const APEX_Trace_Record *rec)
+{
+    CPU_Stage stage = {0};
+
+    printf("%-15s: pc(%d) ",
+           (rec->stage >= 0 && rec->stage <= TRACE_STAGE_WRITEBACK)
+               ? stage_names[rec->stage] : "???",
+           rec->pc);
+
+    if (rec->stall == TRACE_STALL_BRANCH)
+    {
+        /* Fetch skipped the cycle, its latch holds no new instruction */
+        printf("[stall: %s]\n", stall_names[rec->stall]);
+        return;
+    }
+
+    stage.pc = rec->pc;
+    stage.opcode = rec->opcode;
+    stage.rd = rec->rd;
+    stage.rs1 = rec->rs1;
+    stage.rs2 = rec->rs2;
+    stage.rs3 = rec->rs3;
+    stage.imm = rec->imm;
+    print_instruction(stdout, &stage);
+
+    if (rec->stall > TRACE_STALL_NONE && rec->stall <= TRACE_STALL_ICACHE)
+    {
+        printf("[stall: %s]", stall_names[rec->stall]);
+    }
+    printf("\n");
+}
+
+int
+main(int argc, char const *argv[])
+{
+    FILE *fp;
+    APEX_Trace_Header header;
+    APEX_Trace_Record rec;
+    int first = 0, last = -1, cycle = -1;
+
+    if (argc < 2)
+    {
+        fprintf(stderr,
+                "APEX_Help: Usage %s <trace_file> [first_cycle [last_cycle]]\n",
+                argv[0]);
+        exit(1);
+    }
+
+    if (argc > 2)
+    {
+        first = atoi(argv[2]);
+    }
+    if (argc > 3)
+    {
+        last = atoi(argv[3]);
+    }
+
+    fp = fopen(argv[1], "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open %s\n", argv[1]);
+        exit(1);
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1
+        || header.magic != APEX_TRACE_MAGIC
+        || header.version != APEX_TRACE_VERSION
+        || header.record_size != sizeof(APEX_Trace_Record))
+    {
+        fprintf(stderr, "APEX_Error: %s is not a valid trace\n", argv[1]);
+        fclose(fp);
+        exit(1);
+    }
+
+    while (fread(&rec, sizeof(rec), 1, fp) == 1)
+    {
+        if (rec.cycle < first)
+        {
+            continue;
+        }
+        if (last >= 0 && rec.cycle > last)
+        {
+            break;
+        }
+
+        if (rec.cycle != cycle)
+        {
+            cycle = rec.cycle;
+            printf("--------------------------------------------\n");
+            printf("Clock Cycle #: %d\n", cycle);
+            printf("--------------------------------------------\n");
+        }
+        print_record(&rec);
+    }
+
+    fclose(fp);
+    return 0;
+}
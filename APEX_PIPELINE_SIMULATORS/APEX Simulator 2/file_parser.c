@@ -7,190 +7,609 @@
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
  * State University of New York at Binghamton
  */
-#include <assert.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
 
+/* Mnemonics indexed by numeric opcode, used only when displaying */
+static const char *opcode_str_table[] = {
+    [OPCODE_ADD] = "ADD",
+    [OPCODE_SUB] = "SUB",
+    [OPCODE_MUL] = "MUL",
+    [OPCODE_DIV] = "DIV",
+    [OPCODE_AND] = "AND",
+    [OPCODE_OR] = "OR",
+    [OPCODE_XOR] = "EXOR",
+    [OPCODE_MOVC] = "MOVC",
+    [OPCODE_LOAD] = "LOAD",
+    [OPCODE_STORE] = "STORE",
+    [OPCODE_BZ] = "BZ",
+    [OPCODE_BNZ] = "BNZ",
+    [OPCODE_HALT] = "HALT",
+    [OPCODE_NOP] = "NOP",
+    [OPCODE_LDR] = "LDR",
+    [OPCODE_STR] = "STR",
+    [OPCODE_ADDL] = "ADDL",
+    [OPCODE_SUBL] = "SUBL",
+    [OPCODE_CMP] = "CMP",
+};
+
 /*
- * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
+ * Returns the mnemonic of a numeric opcode
  */
-static int
-get_num_from_string(const char *buffer)
+const char *
+get_opcode_str(const int opcode)
 {
-    char str[16];
-    int i, j = 0;
-
-    for (i = 1; buffer[i] != '\0'; ++i)
+    if (opcode < 0
+        || opcode >= (int)(sizeof(opcode_str_table) / sizeof(opcode_str_table[0]))
+        || !opcode_str_table[opcode])
     {
-        str[j] = buffer[i];
-        j++;
+        return "???";
     }
-    str[j] = '\0';
 
-    return atoi(str);
+    return opcode_str_table[opcode];
+}
+
+/* Maximum number of comma separated operands of any instruction */
+#define MAX_OPERANDS 3
+
+/* A token of the input line, located by its offset for error reporting */
+typedef struct Parse_Token
+{
+    const char *str;
+    int len;
+    int col;                       /* 1-based column in the source line */
+} Parse_Token;
+
+/* Reports a parse error as file:line:column on stderr */
+static void
+parse_error(const char *filename, int line_num, int col, const char *msg,
+            const Parse_Token *tok)
+{
+    if (tok)
+    {
+        fprintf(stderr, "APEX_Error: %s:%d:%d: %s '%.*s'\n", filename,
+                line_num, col, msg, tok->len, tok->str);
+    }
+    else
+    {
+        fprintf(stderr, "APEX_Error: %s:%d:%d: %s\n", filename, line_num, col,
+                msg);
+    }
 }
 
 /*
- * This function sets the numeric opcode to an instruction based on string value
+ * Resolves a mnemonic to its numeric opcode with a switch on length and
+ * first character, so each lookup costs at most one or two memcmp calls.
+ * Returns -1 for unknown mnemonics.
  *
  * Note : you can edit this function to add new instructions
  */
 static int
-set_opcode_str(const char *opcode_str)
+set_opcode_str(const char *s, int len)
 {
+#define MATCH(str, op) \
+    if (memcmp(s, str, len) == 0) return op
 
-    if (strcmp(opcode_str, "ADD") == 0)
+    switch (len)
     {
-        return OPCODE_ADD;
-    }
+        case 2:
+            switch (s[0])
+            {
+                case 'B': MATCH("BZ", OPCODE_BZ); break;
+                case 'O': MATCH("OR", OPCODE_OR); break;
+            }
+            break;
 
-    if (strcmp(opcode_str, "SUB") == 0)
-    {
-        return OPCODE_SUB;
-    }
+        case 3:
+            switch (s[0])
+            {
+                case 'A':
+                    MATCH("ADD", OPCODE_ADD);
+                    MATCH("AND", OPCODE_AND);
+                    break;
+                case 'B': MATCH("BNZ", OPCODE_BNZ); break;
+                case 'C': MATCH("CMP", OPCODE_CMP); break;
+                case 'D': MATCH("DIV", OPCODE_DIV); break;
+                case 'L': MATCH("LDR", OPCODE_LDR); break;
+                case 'M': MATCH("MUL", OPCODE_MUL); break;
+                case 'N': MATCH("NOP", OPCODE_NOP); break;
+                case 'S':
+                    MATCH("SUB", OPCODE_SUB);
+                    MATCH("STR", OPCODE_STR);
+                    break;
+            }
+            break;
 
-    if (strcmp(opcode_str, "MUL") == 0)
-    {
-        return OPCODE_MUL;
+        case 4:
+            switch (s[0])
+            {
+                case 'A': MATCH("ADDL", OPCODE_ADDL); break;
+                case 'E': MATCH("EXOR", OPCODE_XOR); break;
+                case 'H': MATCH("HALT", OPCODE_HALT); break;
+                case 'L': MATCH("LOAD", OPCODE_LOAD); break;
+                case 'M': MATCH("MOVC", OPCODE_MOVC); break;
+                case 'S': MATCH("SUBL", OPCODE_SUBL); break;
+            }
+            break;
+
+        case 5:
+            if (s[0] == 'S')
+            {
+                MATCH("STORE", OPCODE_STORE);
+            }
+            break;
     }
+#undef MATCH
 
-    if (strcmp(opcode_str, "DIV") == 0)
+    return -1;
+}
+
+/*
+ * Parses a register ('R<n>') or literal ('#<n>') operand. Returns 0 on
+ * success and -1 if the prefix or number is malformed.
+ */
+static int
+get_num_from_token(const Parse_Token *tok, char prefix, int *value)
+{
+    long num = 0;
+    int i = 1, negative = FALSE;
+
+    if (tok->len < 2 || (tok->str[0] != prefix && tok->str[0] != prefix + 32))
     {
-        return OPCODE_DIV;
+        return -1;
     }
 
-    if (strcmp(opcode_str, "AND") == 0)
+    if (tok->str[i] == '-' || tok->str[i] == '+')
     {
-        return OPCODE_AND;
+        negative = (tok->str[i] == '-');
+        i++;
     }
 
-    if (strcmp(opcode_str, "OR") == 0)
+    if (i == tok->len)
     {
-        return OPCODE_OR;
+        return -1;
     }
 
-    if (strcmp(opcode_str, "EXOR") == 0)
+    for (; i < tok->len; ++i)
     {
-        return OPCODE_XOR;
+        if (tok->str[i] < '0' || tok->str[i] > '9' || num > 0x7fffffffL)
+        {
+            return -1;
+        }
+        num = num * 10 + (tok->str[i] - '0');
     }
 
-    if (strcmp(opcode_str, "MOVC") == 0)
+    *value = negative ? (int)-num : (int)num;
+    return 0;
+}
+
+/* Advances past blanks and returns the new position */
+static const char *
+skip_blanks(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
     {
-        return OPCODE_MOVC;
+        p++;
     }
+    return p;
+}
+
+/*
+ * Takes the comma separated operand starting at p, trimmed of blanks, into
+ * tok. Returns the start of the next operand, or NULL if it was the last.
+ */
+static const char *
+next_operand(const char *p, const char *line, Parse_Token *tok)
+{
+    const char *end = p;
 
-    if (strcmp(opcode_str, "LOAD") == 0)
+    while (*end && *end != ',')
     {
-        return OPCODE_LOAD;
+        end++;
     }
 
-    if (strcmp(opcode_str, "STORE") == 0)
+    tok->str = p;
+    tok->col = (int)(p - line) + 1;
+    tok->len = (int)(end - p);
+    while (tok->len > 0 && strchr(" \t\r\n", p[tok->len - 1]))
     {
-        return OPCODE_STORE;
+        tok->len--;
     }
 
-    if (strcmp(opcode_str, "BZ") == 0)
+    return *end == ',' ? skip_blanks(end + 1) : NULL;
+}
+
+/*
+ * Splits the statement at start, within line, into its mnemonic and up to
+ * MAX_OPERANDS comma separated operands without modifying or copying it.
+ * Returns the operand count, or -1 if there are too many operands.
+ */
+static int
+tokenize_line(const char *line, const char *start, Parse_Token *opcode,
+              Parse_Token *operands)
+{
+    const char *p = skip_blanks(start);
+    int num_operands = 0;
+
+    opcode->str = p;
+    opcode->col = (int)(p - line) + 1;
+    while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
     {
-        return OPCODE_BZ;
+        p++;
     }
+    opcode->len = (int)(p - opcode->str);
 
-    if (strcmp(opcode_str, "BNZ") == 0)
+    p = skip_blanks(p);
+    while (p && *p)
     {
-        return OPCODE_BNZ;
+        if (num_operands == MAX_OPERANDS)
+        {
+            operands[0].str = p;
+            operands[0].len = (int)strcspn(p, "\r\n");
+            operands[0].col = (int)(p - line) + 1;
+            return -1;
+        }
+        p = next_operand(p, line, &operands[num_operands++]);
     }
 
-    if (strcmp(opcode_str, "HALT") == 0)
+    return num_operands;
+}
+
+/* A label or .equ constant. name points into the source text, or is NULL
+ * for a free slot */
+typedef struct Asm_Symbol
+{
+    const char *name;
+    int len;
+    int value;
+} Asm_Symbol;
+
+/* Kinds of Asm_Statement */
+#define STMT_INSN 0x0
+#define STMT_WORD 0x1
+
+/*
+ * An instruction, or one value of a .word, found by the first pass at a
+ * known address. The second pass decodes these once every symbol is
+ * defined, so operands may refer to labels further down.
+ */
+typedef struct Asm_Statement
+{
+    int kind;
+    int line_num;
+    int addr;                      /* PC, or data word address */
+    int num_operands;              /* -1 if there were too many */
+    Parse_Token opcode;            /* Mnemonic, or the .word value */
+    Parse_Token operands[MAX_OPERANDS];
+} Asm_Statement;
+
+/* State of one assemble_program run */
+typedef struct Assembler
+{
+    const char *filename;
+    int line_num;                  /* Line being assembled, for errors */
+    Asm_Symbol *symbols;           /* Open addressing, at most half full */
+    unsigned int symbol_mask;      /* Table size - 1, a power of two */
+    unsigned int num_symbols;
+    Asm_Statement *stmts;
+    int num_stmts;
+    int stmt_capacity;
+    int in_data;                   /* TRUE after .data, until .text or .org */
+    int data_addr;                 /* Address of the next .word value */
+} Assembler;
+
+static int
+is_symbol_start(const char c)
+{
+    return c == '_' || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+static int
+is_symbol_char(const char c)
+{
+    return is_symbol_start(c) || (c >= '0' && c <= '9');
+}
+
+/* TRUE when tok is exactly str */
+static int
+token_is(const Parse_Token *tok, const char *str)
+{
+    return tok->len == (int)strlen(str) && memcmp(tok->str, str, tok->len) == 0;
+}
+
+/* Slot of the symbol called name in table, or the free slot it goes in */
+static Asm_Symbol *
+symbol_slot(Asm_Symbol *table, const unsigned int mask, const char *name,
+            const int len)
+{
+    unsigned int hash = 2166136261u, i;
+    int k;
+
+    for (k = 0; k < len; ++k)
     {
-        return OPCODE_HALT;
+        hash = (hash ^ (unsigned char)name[k]) * 16777619u;
     }
 
-    
-    if (strcmp(opcode_str, "NOP") == 0)
+    for (i = hash & mask; table[i].name; i = (i + 1) & mask)
     {
-        return OPCODE_NOP;
+        if (table[i].len == len && memcmp(table[i].name, name, len) == 0)
+        {
+            break;
+        }
     }
+    return &table[i];
+}
 
+/* Defines the symbol name. Returns 0 on success, -1 after reporting a
+ * duplicate */
+static int
+define_symbol(Assembler *as, const Parse_Token *name, const int value)
+{
+    Asm_Symbol *slot, *grown;
+    unsigned int i, mask;
 
-    if (strcmp(opcode_str, "LDR") == 0)
+    if (2 * (as->num_symbols + 1) > as->symbol_mask + 1)
     {
-        return OPCODE_LDR;
+        mask = 2 * as->symbol_mask + 1;
+        grown = calloc(mask + 1, sizeof(Asm_Symbol));
+        if (!grown)
+        {
+            parse_error(as->filename, as->line_num, name->col,
+                        "out of memory for symbol", name);
+            return -1;
+        }
+        for (i = 0; i <= as->symbol_mask; ++i)
+        {
+            if (as->symbols[i].name)
+            {
+                *symbol_slot(grown, mask, as->symbols[i].name,
+                             as->symbols[i].len) = as->symbols[i];
+            }
+        }
+        free(as->symbols);
+        as->symbols = grown;
+        as->symbol_mask = mask;
     }
 
-    if (strcmp(opcode_str, "STR") == 0)
+    slot = symbol_slot(as->symbols, as->symbol_mask, name->str, name->len);
+    if (slot->name)
     {
-        return OPCODE_STR;
+        parse_error(as->filename, as->line_num, name->col, "duplicate symbol",
+                    name);
+        return -1;
     }
+    slot->name = name->str;
+    slot->len = name->len;
+    slot->value = value;
+    as->num_symbols++;
+    return 0;
+}
+
+/* Value of c as a digit in base, or -1 */
+static int
+digit_value(const char c, const int base)
+{
+    int digit = -1;
 
-    if (strcmp(opcode_str, "ADDL") == 0)
+    if (c >= '0' && c <= '9')
     {
-        return OPCODE_ADDL;
+        digit = c - '0';
     }
-
-    if (strcmp(opcode_str, "SUBL") == 0)
+    else if (c >= 'a' && c <= 'f')
     {
-        return OPCODE_SUBL;
+        digit = c - 'a' + 10;
     }
-
-    if (strcmp(opcode_str, "CMP") == 0)
+    else if (c >= 'A' && c <= 'F')
     {
-        return OPCODE_CMP;
+        digit = c - 'A' + 10;
     }
-
-    assert(0 && "Invalid opcode");
-    return 0;
+    return digit < base ? digit : -1;
 }
 
-static void
-split_opcode_from_insn_string(char *buffer, char tokens[2][128])
+/*
+ * Evaluates tok, less its first skip characters, as terms joined by '+' and
+ * '-'. A term is a decimal or 0x hexadecimal number or a symbol, with an
+ * optional sign. Values from -2^31 to 2^32 - 1 are accepted, the upper half
+ * wrapping to negative. Returns 0 on success, or -1 after reporting msg
+ * for a malformed expression or naming an undefined symbol.
+ */
+static int
+eval_expr(Assembler *as, const Parse_Token *tok, const int skip, int *value,
+          const char *msg)
 {
-    int token_num = 0;
+    const char *p = tok->str + skip, *end = tok->str + tok->len, *start;
+    const Asm_Symbol *sym;
+    Parse_Token name;
+    long long total = 0, term;
+    int base, digit, negative;
 
-    char *token = strtok(buffer, " ");
-
-    while (token != NULL)
+    while (TRUE)
     {
-        strcpy(tokens[token_num], token);
-        token_num++;
-        token = strtok(NULL, " ");
+        while (p < end && (*p == ' ' || *p == '\t'))
+        {
+            p++;
+        }
+        negative = (p < end && *p == '-');
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            p++;
+        }
+
+        if (p < end && *p >= '0' && *p <= '9')
+        {
+            base = 10;
+            if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+            {
+                base = 16;
+                p += 2;
+            }
+            start = p;
+            term = 0;
+            while (p < end && (digit = digit_value(*p, base)) >= 0
+                   && term <= 0xffffffffLL)
+            {
+                term = term * base + digit;
+                p++;
+            }
+            if (p == start)
+            {
+                break;
+            }
+        }
+        else if (p < end && is_symbol_start(*p))
+        {
+            start = p;
+            while (p < end && is_symbol_char(*p))
+            {
+                p++;
+            }
+            sym = symbol_slot(as->symbols, as->symbol_mask, start,
+                              (int)(p - start));
+            if (!sym->name)
+            {
+                name.str = start;
+                name.len = (int)(p - start);
+                name.col = tok->col + (int)(start - tok->str);
+                parse_error(as->filename, as->line_num, name.col,
+                            "undefined symbol", &name);
+                return -1;
+            }
+            term = sym->value;
+        }
+        else
+        {
+            break;
+        }
+
+        total += negative ? -term : term;
+        if (total < -0x80000000LL || total > 0xffffffffLL)
+        {
+            break;
+        }
+
+        while (p < end && (*p == ' ' || *p == '\t'))
+        {
+            p++;
+        }
+        if (p == end)
+        {
+            *value = (int)(unsigned int)total;
+            return 0;
+        }
+        if (*p != '+' && *p != '-')
+        {
+            break;
+        }
     }
+
+    parse_error(as->filename, as->line_num, tok->col, msg, tok);
+    return -1;
 }
 
 /*
- * This function is related to parsing input file
+ * This function is related to parsing input file. Decodes the instruction
+ * st into ins, returning 0 on success or -1 after reporting the error. A
+ * literal is '#' and an expression; a branch may instead name its target,
+ * e.g. 'BNZ loop', and gets the offset to it from its own PC.
  *
  * Note : you can edit this function to add new instructions
  */
-static void
-create_APEX_instruction(APEX_Instruction *ins, char *buffer)
+static int
+create_APEX_instruction(Assembler *as, const Asm_Statement *st,
+                        APEX_Instruction *ins)
 {
-    int i, token_num = 0;
-    char tokens[6][128];
-    char top_level_tokens[2][128];
+    /* Operand syntax per opcode: 'R' register, '#' literal */
+    static const char *const formats[] = {
+        [OPCODE_ADD] = "RRR",  [OPCODE_SUB] = "RRR",  [OPCODE_MUL] = "RRR",
+        [OPCODE_DIV] = "RRR",  [OPCODE_AND] = "RRR",  [OPCODE_OR] = "RRR",
+        [OPCODE_XOR] = "RRR",  [OPCODE_MOVC] = "R#",  [OPCODE_LOAD] = "RR#",
+        [OPCODE_STORE] = "RR#", [OPCODE_BZ] = "#",    [OPCODE_BNZ] = "#",
+        [OPCODE_HALT] = "",    [OPCODE_NOP] = "",     [OPCODE_LDR] = "RRR",
+        [OPCODE_STR] = "RRR",  [OPCODE_ADDL] = "RR#", [OPCODE_SUBL] = "RR#",
+        [OPCODE_CMP] = "RR",
+    };
+    const Parse_Token *opcode = &st->opcode, *operands = st->operands;
+    const char *filename = as->filename;
+    int line_num = st->line_num;
+    int values[MAX_OPERANDS];
+    int i, num_operands = st->num_operands, expected, target;
+    const char *format;
 
-    for (i = 0; i < 2; ++i)
+    ins->opcode = set_opcode_str(opcode->str, opcode->len);
+    if (ins->opcode < 0)
     {
-        strcpy(top_level_tokens[i], "");
+        parse_error(filename, line_num, opcode->col, "invalid opcode", opcode);
+        return -1;
     }
 
-    split_opcode_from_insn_string(buffer, top_level_tokens);
-
-    char *token = strtok(top_level_tokens[1], ",");
+    if (num_operands < 0)
+    {
+        parse_error(filename, line_num, operands[0].col, "too many operands",
+                    &operands[0]);
+        return -1;
+    }
 
-    while (token != NULL)
+    format = formats[ins->opcode];
+    expected = (int)strlen(format);
+    if (num_operands != expected)
     {
-        strcpy(tokens[token_num], token);
-        token_num++;
-        token = strtok(NULL, ",");
+        fprintf(stderr,
+                "APEX_Error: %s:%d:%d: %s expects %d operand(s), got %d\n",
+                filename, line_num, opcode->col, get_opcode_str(ins->opcode),
+                expected, num_operands);
+        return -1;
     }
 
-    strcpy(ins->opcode_str, top_level_tokens[0]);
-    ins->opcode = set_opcode_str(ins->opcode_str);
+    for (i = 0; i < num_operands; ++i)
+    {
+        if (format[i] == 'R')
+        {
+            if (get_num_from_token(&operands[i], 'R', &values[i]) < 0)
+            {
+                parse_error(filename, line_num, operands[i].col,
+                            "invalid register operand", &operands[i]);
+                return -1;
+            }
+        }
+        else if (operands[i].len > 0 && operands[i].str[0] == '#')
+        {
+            if (eval_expr(as, &operands[i], 1, &values[i],
+                          "invalid literal operand") < 0)
+            {
+                return -1;
+            }
+        }
+        else if (ins->opcode == OPCODE_BZ || ins->opcode == OPCODE_BNZ)
+        {
+            if (eval_expr(as, &operands[i], 0, &target,
+                          "invalid branch target") < 0)
+            {
+                return -1;
+            }
+            values[i] = (int)((unsigned int)target - (unsigned int)st->addr);
+        }
+        else
+        {
+            parse_error(filename, line_num, operands[i].col,
+                        "invalid literal operand", &operands[i]);
+            return -1;
+        }
+
+        if (format[i] == 'R' && (values[i] < 0 || values[i] >= REG_FILE_SIZE))
+        {
+            parse_error(filename, line_num, operands[i].col,
+                        "register out of range", &operands[i]);
+            return -1;
+        }
+    }
 
     switch (ins->opcode)
     {
@@ -201,66 +620,53 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
         case OPCODE_AND:
         case OPCODE_OR:
         case OPCODE_XOR:
+        case OPCODE_LDR:
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
+            ins->rd = values[0];
+            ins->rs1 = values[1];
+            ins->rs2 = values[2];
             break;
         }
 
         case OPCODE_ADDL:
         case OPCODE_SUBL:
+        case OPCODE_LOAD:
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
+            ins->rd = values[0];
+            ins->rs1 = values[1];
+            ins->imm = values[2];
             break;
         }
 
         case OPCODE_STR:
         {
-            ins->rs3 = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
+            ins->rs3 = values[0];
+            ins->rs1 = values[1];
+            ins->rs2 = values[2];
             ins->rd  = -1;
             break;
         }
 
-        case OPCODE_LDR:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
-            break;
-        }
-
         case OPCODE_MOVC:
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->imm = get_num_from_string(tokens[1]);
-            break;
-        }
-
-        case OPCODE_LOAD:
-        {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
+            ins->rd = values[0];
+            ins->imm = values[1];
             break;
         }
 
         case OPCODE_CMP:
         {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
+            ins->rs1 = values[0];
+            ins->rs2 = values[1];
             ins->rd  = -1;
+            break;
         }
 
         case OPCODE_STORE:
         {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
+            ins->rs1 = values[0];
+            ins->rs2 = values[1];
+            ins->imm = values[2];
             ins->rd  = -1;
             break;
         }
@@ -268,40 +674,316 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
         case OPCODE_BZ:
         case OPCODE_BNZ:
         {
-            ins->imm = get_num_from_string(tokens[0]);
+            ins->imm = values[0];
             ins->rd  = -1;
             break;
         }
-        
+
         case OPCODE_NOP:
         {
             ins->rd  = -1;
             break;
         }
     }
-    /* Fill in rest of the instructions accordingly */
+
+    return 0;
+}
+
+/* Address the next instruction, or .word value in a data section, goes to */
+static long long
+location(const Assembler *as, const APEX_Program *prog)
+{
+    const APEX_Segment *seg = &prog->segments[prog->num_segments - 1];
+
+    if (as->in_data)
+    {
+        return as->data_addr;
+    }
+    return (long long)seg->base + 4LL * seg->size;
+}
+
+/* Adds a statement of kind at the current location for the second pass.
+ * Returns it, or NULL after reporting the error. */
+static Asm_Statement *
+add_statement(Assembler *as, const APEX_Program *prog, const int kind,
+              const Parse_Token *tok)
+{
+    Asm_Statement *st;
+    long long addr = location(as, prog);
+
+    if (addr > (kind == STMT_INSN ? 0x7ffffffcLL : APEX_MAX_DATA_MEMORY - 1LL))
+    {
+        parse_error(as->filename, as->line_num, tok->col,
+                    kind == STMT_INSN ? "code address out of range"
+                                      : "data address out of range", NULL);
+        return NULL;
+    }
+
+    if (as->num_stmts == as->stmt_capacity)
+    {
+        st = realloc(as->stmts, 2 * as->stmt_capacity * sizeof(Asm_Statement));
+        if (!st)
+        {
+            parse_error(as->filename, as->line_num, tok->col,
+                        "out of memory", NULL);
+            return NULL;
+        }
+        as->stmts = st;
+        as->stmt_capacity *= 2;
+    }
+
+    st = &as->stmts[as->num_stmts++];
+    st->kind = kind;
+    st->line_num = as->line_num;
+    st->addr = (int)addr;
+    return st;
 }
 
 /*
- * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
+ * Starts a new code segment at pc for a '.org <pc>' line. Code before the
+ * first one starts at APEX_CODE_BASE. Returns 0 on success or -1 after
+ * reporting the error.
  */
-APEX_Instruction *
-create_code_memory(const char *filename, int *size)
+static int
+set_origin(Assembler *as, APEX_Program *prog, const Parse_Token *directive,
+           const int pc)
 {
-    FILE *fp;
-    ssize_t nread;
-    size_t len = 0;
-    char *line = NULL;
-    int code_memory_size = 0;
-    int current_instruction = 0;
-    APEX_Instruction *code_memory;
+    APEX_Segment *seg = &prog->segments[prog->num_segments - 1];
 
-    if (!filename)
+    /* An empty segment is just moved */
+    if (seg->size > 0)
     {
-        return NULL;
+        if (prog->num_segments == APEX_MAX_SEGMENTS)
+        {
+            parse_error(as->filename, as->line_num, directive->col,
+                        "too many segments", NULL);
+            return -1;
+        }
+        seg++;
+        prog->num_segments++;
+        seg->first = prog->size;
+        seg->size = 0;
     }
+    seg->base = pc;
+    as->in_data = FALSE;
+    return 0;
+}
+
+/*
+ * Handles the directive at start, within line:
+ *   .org <pc>            start a code segment at pc
+ *   .data [<addr>]       put the following .word values at addr, or after
+ *                        the previous ones (initially 0)
+ *   .text                go back to code after the last instruction
+ *   .word <v>[, <v>...]  preload consecutive data memory words
+ *   .equ <name>, <v>     define a constant
+ * Their operands can only use symbols defined above. Returns 0 on success
+ * or -1 after reporting the error.
+ */
+static int
+assemble_directive(Assembler *as, APEX_Program *prog, const char *line,
+                   const char *start)
+{
+    Parse_Token directive, operands[MAX_OPERANDS], value;
+    const char *p;
+    int num_operands, addr;
+
+    num_operands = tokenize_line(line, start, &directive, operands);
+    if (token_is(&directive, ".word"))
+    {
+        if (!as->in_data)
+        {
+            parse_error(as->filename, as->line_num, directive.col,
+                        ".word outside a .data section", NULL);
+            return -1;
+        }
+        p = skip_blanks(directive.str + directive.len);
+        if (!*p)
+        {
+            parse_error(as->filename, as->line_num, directive.col,
+                        ".word expects values", NULL);
+            return -1;
+        }
+        while (p)
+        {
+            p = next_operand(p, line, &value);
+            if (!add_statement(as, prog, STMT_WORD, &value))
+            {
+                return -1;
+            }
+            as->stmts[as->num_stmts - 1].opcode = value;
+            as->data_addr++;
+            prog->num_data++;
+        }
+        return 0;
+    }
+
+    if (token_is(&directive, ".org") && num_operands == 1)
+    {
+        if (eval_expr(as, &operands[0], 0, &addr, "invalid code address") < 0)
+        {
+            return -1;
+        }
+        if (addr < 0 || addr % 4 != 0)
+        {
+            parse_error(as->filename, as->line_num, operands[0].col,
+                        "invalid code address", &operands[0]);
+            return -1;
+        }
+        return set_origin(as, prog, &directive, addr);
+    }
+
+    if (token_is(&directive, ".data") && num_operands <= 1
+        && num_operands >= 0)
+    {
+        if (num_operands == 1)
+        {
+            if (eval_expr(as, &operands[0], 0, &addr,
+                          "invalid data address") < 0)
+            {
+                return -1;
+            }
+            if ((unsigned int)addr >= APEX_MAX_DATA_MEMORY)
+            {
+                parse_error(as->filename, as->line_num, operands[0].col,
+                            "invalid data address", &operands[0]);
+                return -1;
+            }
+            as->data_addr = addr;
+        }
+        as->in_data = TRUE;
+        return 0;
+    }
+
+    if (token_is(&directive, ".text") && num_operands == 0)
+    {
+        as->in_data = FALSE;
+        return 0;
+    }
+
+    if (token_is(&directive, ".equ") && num_operands == 2)
+    {
+        p = operands[0].str;
+        while (p < operands[0].str + operands[0].len && is_symbol_char(*p))
+        {
+            p++;
+        }
+        if (!is_symbol_start(operands[0].str[0])
+            || p != operands[0].str + operands[0].len)
+        {
+            parse_error(as->filename, as->line_num, operands[0].col,
+                        "invalid symbol name", &operands[0]);
+            return -1;
+        }
+        if (eval_expr(as, &operands[1], 0, &addr, "invalid value") < 0)
+        {
+            return -1;
+        }
+        return define_symbol(as, &operands[0], addr);
+    }
+
+    if (token_is(&directive, ".org") || token_is(&directive, ".data")
+        || token_is(&directive, ".text") || token_is(&directive, ".equ"))
+    {
+        parse_error(as->filename, as->line_num, directive.col,
+                    "wrong number of operands for", &directive);
+        return -1;
+    }
+    parse_error(as->filename, as->line_num, directive.col,
+                "unknown directive", &directive);
+    return -1;
+}
+
+/*
+ * First pass over one source line: strips a ';' or '//' comment, defines a
+ * leading 'name:' label as the address of what follows, then handles a
+ * directive or records an instruction. Blank lines are skipped. Returns 0
+ * on success or -1 after reporting the error.
+ */
+static int
+assemble_line(Assembler *as, APEX_Program *prog, char *line)
+{
+    Parse_Token label;
+    Asm_Statement *st;
+    char *p;
+    long long addr;
+
+    for (p = line; *p; ++p)
+    {
+        if (*p == ';' || (p[0] == '/' && p[1] == '/'))
+        {
+            *p = '\0';
+            break;
+        }
+    }
+
+    p = (char *)skip_blanks(line);
+    if (is_symbol_start(*p))
+    {
+        label.str = p;
+        label.col = (int)(p - line) + 1;
+        while (is_symbol_char(*p))
+        {
+            p++;
+        }
+        label.len = (int)(p - label.str);
+        if (*p == ':')
+        {
+            addr = location(as, prog);
+            if (addr > 0x7fffffffLL)
+            {
+                parse_error(as->filename, as->line_num, label.col,
+                            "code address out of range", NULL);
+                return -1;
+            }
+            if (define_symbol(as, &label, (int)addr) < 0)
+            {
+                return -1;
+            }
+            p = (char *)skip_blanks(p + 1);
+        }
+        else
+        {
+            p = (char *)label.str;
+        }
+    }
+
+    if (*p == '\0')
+    {
+        return 0;
+    }
+    if (*p == '.')
+    {
+        return assemble_directive(as, prog, line, p);
+    }
+    if (as->in_data)
+    {
+        parse_error(as->filename, as->line_num, (int)(p - line) + 1,
+                    "instruction in a .data section", NULL);
+        return -1;
+    }
+
+    label.str = p;
+    label.len = 0;
+    label.col = (int)(p - line) + 1;
+    st = add_statement(as, prog, STMT_INSN, &label);
+    if (!st)
+    {
+        return -1;
+    }
+    st->num_operands = tokenize_line(line, p, &st->opcode, st->operands);
+    prog->size++;
+    prog->segments[prog->num_segments - 1].size++;
+    return 0;
+}
+
+/* Reads all of filename into a NUL-terminated buffer, or returns NULL */
+static char *
+read_source(const char *filename)
+{
+    FILE *fp;
+    char *text = NULL, *grown;
+    size_t len = 0, capacity = 0, n;
 
     fp = fopen(filename, "r");
     if (!fp)
@@ -309,32 +991,330 @@ create_code_memory(const char *filename, int *size)
         return NULL;
     }
 
-    while ((nread = getline(&line, &len, fp)) != -1)
+    do
+    {
+        if (capacity - len < 4096)
+        {
+            capacity = capacity ? 2 * capacity : 65536;
+            grown = realloc(text, capacity + 1);
+            if (!grown)
+            {
+                free(text);
+                fclose(fp);
+                return NULL;
+            }
+            text = grown;
+        }
+        n = fread(text + len, 1, capacity - len, fp);
+        len += n;
+    } while (n > 0);
+
+    if (ferror(fp))
     {
-        code_memory_size++;
+        free(text);
+        text = NULL;
     }
-    *size = code_memory_size;
-    if (!code_memory_size)
+    else
     {
-        fclose(fp);
-        return NULL;
+        text[len] = '\0';
+    }
+    fclose(fp);
+    return text;
+}
+
+/*
+ * This function is related to parsing input file. The file is read into
+ * memory once. The first pass records every instruction and .word value
+ * with its address and defines the symbols; the second decodes them into
+ * prog, which holds nothing yet. Returns 0 on success, or -1 after
+ * reporting the first error.
+ */
+int
+assemble_program(APEX_Program *prog, const char *filename)
+{
+    Assembler as;
+    Asm_Statement *st;
+    char *text, *line, *end;
+    int i, num_code = 0, num_data = 0, ret = 0;
+
+    if (!filename)
+    {
+        return -1;
+    }
+
+    text = read_source(filename);
+    if (!text)
+    {
+        return -1;
+    }
+
+    memset(&as, 0, sizeof(as));
+    as.filename = filename;
+    as.symbol_mask = 63;
+    as.symbols = calloc(as.symbol_mask + 1, sizeof(Asm_Symbol));
+    as.stmt_capacity = 64;
+    as.stmts = malloc(as.stmt_capacity * sizeof(Asm_Statement));
+
+    prog->num_segments = 1;
+    prog->segments[0].base = APEX_CODE_BASE;
+    prog->segments[0].size = 0;
+    prog->segments[0].first = 0;
+
+    ret = (as.symbols && as.stmts) ? 0 : -1;
+    for (line = text; ret == 0 && *line; line = end)
+    {
+        end = line + strcspn(line, "\n");
+        if (*end)
+        {
+            *end++ = '\0';
+        }
+        as.line_num++;
+        ret = assemble_line(&as, prog, line);
+    }
+
+    /* Drop a trailing '.org' with no code after it */
+    if (prog->num_segments > 1
+        && prog->segments[prog->num_segments - 1].size == 0)
+    {
+        prog->num_segments--;
+    }
+
+    if (ret == 0 && !prog->size)
+    {
+        fprintf(stderr, "APEX_Error: %s: No instructions\n", filename);
+        ret = -1;
+    }
+
+    if (ret == 0)
+    {
+        prog->code = calloc(prog->size, sizeof(APEX_Instruction));
+        prog->data = malloc((prog->num_data + 1) * sizeof(APEX_Data_Word));
+        ret = (prog->code && prog->data) ? 0 : -1;
+    }
+
+    for (i = 0; ret == 0 && i < as.num_stmts; ++i)
+    {
+        st = &as.stmts[i];
+        as.line_num = st->line_num;
+        if (st->kind == STMT_INSN)
+        {
+            ret = create_APEX_instruction(&as, st, &prog->code[num_code++]);
+        }
+        else
+        {
+            prog->data[num_data].addr = (unsigned int)st->addr;
+            ret = eval_expr(&as, &st->opcode, 0,
+                            &prog->data[num_data++].value, "invalid value");
+        }
+    }
+
+    free(as.symbols);
+    free(as.stmts);
+    free(text);
+    if (ret != 0)
+    {
+        APEX_program_free(prog);
+    }
+    return ret;
+}
+
+/*
+ * Writes a program out as a pre-assembled image which can later be loaded
+ * with map_code_image. Returns 0 on success, -1 on failure.
+ */
+int
+write_code_image(const char *filename, const APEX_Program *prog)
+{
+    FILE *fp;
+    APEX_Image_Header header;
+    APEX_Image_Segment seg;
+    int i;
+
+    fp = fopen(filename, "wb");
+    if (!fp)
+    {
+        return -1;
     }
 
-    code_memory = calloc(code_memory_size, sizeof(APEX_Instruction));
-    if (!code_memory)
+    header.magic = APEX_IMAGE_MAGIC;
+    header.version = APEX_IMAGE_VERSION;
+    header.record_size = sizeof(APEX_Instruction);
+    header.num_records = prog->size;
+    header.num_segments = prog->num_segments;
+    header.num_data = prog->num_data;
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1)
     {
         fclose(fp);
-        return NULL;
+        return -1;
+    }
+    for (i = 0; i < prog->num_segments; ++i)
+    {
+        seg.base = prog->segments[i].base;
+        seg.size = prog->segments[i].size;
+        if (fwrite(&seg, sizeof(seg), 1, fp) != 1)
+        {
+            fclose(fp);
+            return -1;
+        }
+    }
+    if (fwrite(prog->data, sizeof(APEX_Data_Word), prog->num_data, fp)
+        != (size_t)prog->num_data
+        || fwrite(prog->code, sizeof(APEX_Instruction), prog->size, fp)
+        != (size_t)prog->size)
+    {
+        fclose(fp);
+        return -1;
     }
 
-    rewind(fp);
-    while ((nread = getline(&line, &len, fp)) != -1)
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+/* TRUE when reg is a register number, or -1 for none */
+static int
+valid_register(const int reg)
+{
+    return reg >= -1 && reg < REG_FILE_SIZE;
+}
+
+/* TRUE when a mapped image record holds a known opcode and registers */
+static int
+valid_record(const APEX_Instruction *ins)
+{
+    return ins->opcode >= 0 && ins->opcode < NUM_OPCODES
+           && valid_register(ins->rd) && valid_register(ins->rs1)
+           && valid_register(ins->rs2) && valid_register(ins->rs3);
+}
+
+/*
+ * Maps a pre-assembled program image into prog, which holds nothing yet.
+ * The code and data point straight into the read-only mapping, so nothing
+ * is parsed or copied; APEX_program_free releases it. Returns -1 if the
+ * file does not start with the image magic, in which case the caller may
+ * fall back to assemble_program, or -2 after reporting an image of another
+ * version, with a bad layout, or whose records do not decode, as
+ * create_APEX_instruction would reject them.
+ */
+int
+map_code_image(APEX_Program *prog, const char *filename)
+{
+    int fd, i, total = 0;
+    struct stat st;
+    void *base;
+    const APEX_Image_Header *header;
+    const APEX_Image_Segment *seg;
+    const APEX_Data_Word *data;
+    const APEX_Instruction *code;
+    size_t expected;
+
+    if (!filename)
     {
-        create_APEX_instruction(&code_memory[current_instruction], line);
-        current_instruction++;
+        return -1;
     }
 
-    free(line);
-    fclose(fp);
-    return code_memory;
-}
\ No newline at end of file
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(APEX_Image_Header))
+    {
+        close(fd);
+        return -1;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    header = base;
+    if (header->magic != APEX_IMAGE_MAGIC)
+    {
+        munmap(base, st.st_size);
+        return -1;
+    }
+
+    /* From here on the file is an image, never source to assemble */
+    if (header->version != APEX_IMAGE_VERSION)
+    {
+        fprintf(stderr, "APEX_Error: %s: Unsupported image version %u (expected %d)\n",
+                filename, header->version, APEX_IMAGE_VERSION);
+        munmap(base, st.st_size);
+        return -2;
+    }
+
+    seg = (const APEX_Image_Segment *)(header + 1);
+    expected = sizeof(*header)
+               + (size_t)header->num_segments * sizeof(*seg)
+               + (size_t)header->num_data * sizeof(*data)
+               + (size_t)header->num_records * sizeof(APEX_Instruction);
+    if (header->record_size != sizeof(APEX_Instruction)
+        || header->num_records == 0 || header->num_records > 0x7fffffffu
+        || header->num_segments == 0
+        || header->num_segments > APEX_MAX_SEGMENTS
+        || header->num_data > 0x7fffffffu
+        || (size_t)st.st_size != expected)
+    {
+        fprintf(stderr, "APEX_Error: %s: Invalid image layout\n", filename);
+        munmap(base, st.st_size);
+        return -2;
+    }
+
+    for (i = 0; i < (int)header->num_segments; ++i)
+    {
+        if (seg[i].size <= 0 || seg[i].size > (int)header->num_records - total)
+        {
+            fprintf(stderr, "APEX_Error: %s: Invalid image segment %d\n",
+                    filename, i);
+            munmap(base, st.st_size);
+            return -2;
+        }
+        prog->segments[i].base = seg[i].base;
+        prog->segments[i].size = seg[i].size;
+        prog->segments[i].first = total;
+        total += seg[i].size;
+    }
+    if (total != (int)header->num_records)
+    {
+        fprintf(stderr, "APEX_Error: %s: Invalid image layout\n", filename);
+        munmap(base, st.st_size);
+        return -2;
+    }
+
+    data = (const APEX_Data_Word *)(seg + header->num_segments);
+    for (i = 0; i < (int)header->num_data; ++i)
+    {
+        if (data[i].addr >= APEX_MAX_DATA_MEMORY)
+        {
+            fprintf(stderr, "APEX_Error: %s: Invalid image data word %d\n",
+                    filename, i);
+            munmap(base, st.st_size);
+            return -2;
+        }
+    }
+
+    code = (const APEX_Instruction *)(data + header->num_data);
+    for (i = 0; i < (int)header->num_records; ++i)
+    {
+        if (!valid_record(&code[i]))
+        {
+            fprintf(stderr, "APEX_Error: %s: Invalid instruction record %d in image\n",
+                    filename, i);
+            munmap(base, st.st_size);
+            return -2;
+        }
+    }
+
+    prog->num_segments = header->num_segments;
+    prog->size = header->num_records;
+    prog->data = (APEX_Data_Word *)data;
+    prog->num_data = header->num_data;
+    prog->code = (APEX_Instruction *)code;
+    prog->image = base;
+    prog->image_len = st.st_size;
+    return 0;
+}
@@ -10,32 +10,40 @@
 #include <string.h>
 
 #include "apex_cpu.h"
+#include "apex_trace.h"
 
 int 
 main(int argc, char const *argv[])
 {
-    int cmd = 0, cycle = 0,forward_flag=0; 
-    const char* scmd;
+    int i, cmd = 0, cycle = 0,forward_flag=0; 
+    const char* scmd = "";
+    const char* stats_format = NULL;
+    int ffwd_until = 0, ffwd_target = 0;
+    const char* save_file = NULL;
+    const char* restore_file = NULL;
+    const char* trace_file = NULL;
+    int width = 1;
+    unsigned int mem_size = DATA_MEMORY_SIZE;
+    int code_base = -1;
+    char dmem_file[256] = "";
+    unsigned int dmem_addr = 0;
+    char module_file[APEX_MAX_SEGMENTS][256];
+    int module_base[APEX_MAX_SEGMENTS];
+    int num_modules = 0;
+    APEX_FU_Config fu;
+    APEX_Cache_Config dcache, icache;
     APEX_CPU *cpu;
-    printf(" argc  %d   ",argc);
+    int status;
     //int cmd = 0;
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
-    if(argc != 6)
+    if(argc < 2)
     {
-        if(argc != 5)
-        {
-            if (argc != 4)
-            {   
-                if(argc != 3){
-                    
-                    if(argc !=2){
-                    fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
-                    exit(1);
-                    }
-                }
-            }
-        }
+        fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
+        exit(1);
     }
+    APEX_fu_default_config(&fu);
+    APEX_cache_default_config(&dcache);
+    APEX_cache_default_config(&icache);
 
     if(argc > 2){
         scmd = argv[2];
@@ -82,6 +90,125 @@ main(int argc, char const *argv[])
            }
 
     }
+    else if(strcmp(scmd,"batch") == 0){
+        cmd = 5;
+        if(argc > 3){
+            cycle = atoi(argv[3]);
+        }
+        /* Remaining arguments are <option> <value> pairs */
+        for(i = 4; i + 1 < argc; i += 2){
+            if(strcmp(argv[i], "fwd") == 0){
+                forward_flag = (strcmp(argv[i + 1], "y") == 0);
+            }
+            else if(strcmp(argv[i], "stats") == 0){
+                stats_format = argv[i + 1];
+            }
+            else if(strcmp(argv[i], "ffwd") == 0){
+                /* ffwd pc:<pc> | insn:<count> */
+                const char *target = strchr(argv[i + 1], ':');
+
+                if(target && strncmp(argv[i + 1], "pc:", 3) == 0){
+                    ffwd_until = FFWD_PC;
+                }
+                else if(target && strncmp(argv[i + 1], "insn:", 5) == 0){
+                    ffwd_until = FFWD_INSN;
+                }
+                else{
+                    fprintf(stderr, "APEX_Error: Invalid fast-forward target %s\n", argv[i + 1]);
+                    exit(1);
+                }
+                ffwd_target = atoi(target + 1);
+            }
+            else if(strcmp(argv[i], "save") == 0){
+                save_file = argv[i + 1];
+            }
+            else if(strcmp(argv[i], "restore") == 0){
+                restore_file = argv[i + 1];
+            }
+            else if(strcmp(argv[i], "trace") == 0){
+                trace_file = argv[i + 1];
+            }
+            else if(strcmp(argv[i], "width") == 0){
+                width = atoi(argv[i + 1]);
+            }
+            else if(strcmp(argv[i], "mem_size") == 0){
+                if(APEX_mem_parse_size(argv[i + 1], &mem_size) != 0){
+                    fprintf(stderr, "APEX_Error: Data memory size must be 1 to %u words (1G, 4 GB of bytes)\n",
+                            APEX_MAX_DATA_MEMORY);
+                    exit(1);
+                }
+            }
+            else if(strcmp(argv[i], "code_base") == 0){
+                if(APEX_parse_code_address(argv[i + 1], &code_base) != 0){
+                    fprintf(stderr, "APEX_Error: Invalid code address %s\n", argv[i + 1]);
+                    exit(1);
+                }
+            }
+            else if(strcmp(argv[i], "dmem") == 0){
+                /* dmem <file>[@<addr>] */
+                char *at;
+
+                snprintf(dmem_file, sizeof(dmem_file), "%s", argv[i + 1]);
+                dmem_addr = 0;
+                at = strrchr(dmem_file, '@');
+                if(at){
+                    *at = '\0';
+                    if(APEX_mem_parse_addr(at + 1, &dmem_addr) != 0){
+                        fprintf(stderr, "APEX_Error: Invalid data address %s\n", at + 1);
+                        exit(1);
+                    }
+                }
+            }
+            else if(strcmp(argv[i], "module") == 0){
+                /* module <file>[@<pc>] */
+                char *at;
+
+                if(num_modules == APEX_MAX_SEGMENTS){
+                    fprintf(stderr, "APEX_Error: At most %d modules\n", APEX_MAX_SEGMENTS);
+                    exit(1);
+                }
+                snprintf(module_file[num_modules], sizeof(module_file[0]), "%s", argv[i + 1]);
+                module_base[num_modules] = -1;
+                at = strrchr(module_file[num_modules], '@');
+                if(at){
+                    *at = '\0';
+                    if(APEX_parse_code_address(at + 1, &module_base[num_modules]) != 0){
+                        fprintf(stderr, "APEX_Error: Invalid code address %s\n", at + 1);
+                        exit(1);
+                    }
+                }
+                num_modules++;
+            }
+            else if(!APEX_fu_parse_option(&fu, argv[i], argv[i + 1])
+                    && !APEX_cache_parse_option(&dcache, "dcache", argv[i], argv[i + 1])
+                    && !APEX_cache_parse_option(&icache, "icache", argv[i], argv[i + 1])){
+                fprintf(stderr, "APEX_Error: Unknown batch option %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        if(ffwd_until && restore_file){
+            /* A restored pipeline is already running */
+            fprintf(stderr, "APEX_Error: ffwd cannot be combined with restore\n");
+            exit(1);
+        }
+    }
+    else if(strcmp(scmd,"assemble") == 0){
+        APEX_Program prog;
+
+        if(argc < 4){
+            fprintf(stderr, "APEX_Help: Usage %s <input_file> assemble <image_file>\n", argv[0]);
+            exit(1);
+        }
+        APEX_program_init(&prog);
+        if(assemble_program(&prog, argv[1]) != 0 || write_code_image(argv[3], &prog) != 0){
+            fprintf(stderr, "APEX_Error: Unable to assemble %s into %s\n", argv[1], argv[3]);
+            exit(1);
+        }
+        fprintf(stderr, "APEX_CPU: Wrote %d instructions in %d segments and %d data words to %s\n",
+                prog.size, prog.num_segments, prog.num_data, argv[3]);
+        APEX_program_free(&prog);
+        return 0;
+    }
    // printf("\narg3 = %d\n", atoi(argv[3]));
     cpu = APEX_cpu_init(argv[1],cmd,cycle,forward_flag);
     if (!cpu)
@@ -90,7 +217,109 @@ main(int argc, char const *argv[])
         exit(1);
     }
 
+    if(code_base >= 0 && APEX_cpu_set_code_base(cpu, code_base) != 0){
+        fprintf(stderr, "APEX_Error: Program does not fit at code address %d\n", code_base);
+        exit(1);
+    }
+
+    for(i = 0; i < num_modules; i++){
+        if(APEX_cpu_add_module(cpu, module_file[i], module_base[i]) != 0){
+            exit(1);
+        }
+    }
+
+    if(APEX_cpu_set_width(cpu, width) != 0){
+        fprintf(stderr, "APEX_Error: Width must be 1 to %d\n", APEX_MAX_WIDTH);
+        exit(1);
+    }
+
+    if(APEX_fu_configure(cpu, &fu) != 0){
+        fprintf(stderr, "APEX_Error: Unit counts must be 1 to %d and latencies 1 to %d\n",
+                APEX_MAX_WIDTH, APEX_MAX_FU_LATENCY);
+        exit(1);
+    }
+
+    if(APEX_cpu_set_mem_size(cpu, mem_size) != 0){
+        fprintf(stderr, "APEX_Error: Unable to allocate %u words of data memory\n", mem_size);
+        exit(1);
+    }
+
+    if(APEX_cpu_load_data(cpu) != 0){
+        exit(1);
+    }
+
+    if(dmem_file[0] && APEX_mem_load_image(&cpu->data_memory, dmem_file, dmem_addr) != 0){
+        exit(1);
+    }
+
+    if(APEX_cpu_set_dcache(cpu, &dcache) != 0){
+        fprintf(stderr, "APEX_Error: Invalid data cache configuration\n");
+        exit(1);
+    }
+
+    if(APEX_cpu_set_icache(cpu, &icache) != 0){
+        fprintf(stderr, "APEX_Error: Invalid instruction cache configuration\n");
+        exit(1);
+    }
+
+    if(restore_file && APEX_cpu_restore(cpu, restore_file) != 0){
+        exit(1);
+    }
+
+    if(trace_file){
+        cpu->trace = APEX_trace_open(trace_file);
+        if(!cpu->trace){
+            fprintf(stderr, "APEX_Error: Unable to open trace %s\n", trace_file);
+            exit(1);
+        }
+    }
+
+    if(ffwd_until){
+        int ffwd = APEX_cpu_fast_forward(cpu, ffwd_until, ffwd_target);
+
+        if(ffwd == -2){
+            exit(1);
+        }
+        if(ffwd == -1){
+            fprintf(stderr, "APEX_Error: Fast-forward left code memory at pc %d\n", cpu->pc);
+            exit(1);
+        }
+        if(ffwd == 2 && cpu->cycles <= 0){
+            fprintf(stderr, "APEX_Error: Fast-forward target not reached in %d cycles\n", cpu->clock);
+            exit(1);
+        }
+    }
+
     APEX_cpu_run(cpu);
+    if(cpu->trace && APEX_trace_close(cpu->trace) != 0){
+        fprintf(stderr, "APEX_Error: Unable to write trace %s\n", trace_file);
+    }
+    cpu->trace = NULL;
+    if(save_file && APEX_cpu_save(cpu, save_file) != 0){
+        fprintf(stderr, "APEX_Error: Unable to write snapshot %s\n", save_file);
+        exit(1);
+    }
+    if(stats_format){
+        /* "json"/"csv" go to stdout, anything else is a file whose extension
+         * picks the format */
+        FILE *stats_fp = stdout;
+        const char *ext = strrchr(stats_format, '.');
+
+        if(strcmp(stats_format, "json") != 0 && strcmp(stats_format, "csv") != 0){
+            stats_fp = fopen(stats_format, "w");
+            if(!stats_fp){
+                fprintf(stderr, "APEX_Error: Unable to open %s\n", stats_format);
+                exit(1);
+            }
+            stats_format = (ext && strcmp(ext, ".csv") == 0) ? "csv" : "json";
+        }
+        APEX_cpu_print_stats(cpu, stats_fp, stats_format);
+        if(stats_fp != stdout){
+            fclose(stats_fp);
+        }
+    }
+    /* A fault is reported in the exit status for scripts */
+    status = (cpu->status == APEX_FAULTED) ? APEX_EXIT_FAULT : 0;
     APEX_cpu_stop(cpu);
-    return 0;
+    return status;
 }
\ No newline at end of file
@@ -0,0 +1,234 @@
+/*
+ * apex_workload.c
+ * Generates synthetic APEX programs for the simulator benchmarks.
+ *
+ * Only the instructions every simulator core accepts are emitted (ADD, SUB,
+ * MUL, AND, OR, MOVC, LOAD, STORE, BZ, BNZ, ADDL, SUBL, HALT) and only
+ * registers R0-R15 are used, so one workload runs unchanged on Simulator 1
+ * Part_1/Part_2 and Simulator 2. With -p loads and stores are LOADP/STOREP,
+ * which only Simulator 1 accepts.
+ *
+ * Program shape:
+ *
+ *   preamble      MOVC the loop counter, memory pointer and chain registers
+ *   loop body     <ops> instructions made of dependency chains, loads
+ *                 consumed by the next instruction, stores and short
+ *                 forward branches
+ *   loop tail     advance the memory pointer, SUBL the counter, BNZ back
+ *   HALT
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Default data memory of the simulators, DATA_MEMORY_SIZE */
+#define WORKLOAD_DATA_MEMORY_SIZE 4096
+
+/* Largest load/store offset added to the memory pointer */
+#define WORKLOAD_MAX_OFFSET 16
+
+/* Register roles */
+#define REG_COUNTER 1
+#define REG_POINTER 2
+#define REG_ONE 3
+#define REG_MASK 4
+#define REG_CHAIN_FIRST 5
+#define REG_CHAIN_COUNT 8          /* R5-R12 */
+#define REG_BRANCH_TMP 13
+#define REG_BRANCH_COUNT 14
+
+typedef struct Workload_Params
+{
+    int trips;                     /* Loop trip count */
+    int ops;                       /* Loop body instructions, excluding branches */
+    int chain;                     /* Dependency chain length */
+    int load_pct;                  /* Body instructions that are load-use pairs */
+    int store_pct;                 /* Body instructions that are stores */
+    int branch_every;              /* Forward branch every N body ops, 0 = none */
+    int footprint;                 /* Data memory words touched */
+    int memory;                    /* Data memory words of the target simulator */
+    int post_increment;            /* LOADP/STOREP instead of LOAD/STORE */
+    unsigned int seed;
+} Workload_Params;
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr,
+            "APEX_Help: Usage %s [-n trips] [-o ops] [-c chain] [-l load%%]\n"
+            "           [-w store%%] [-b branch_every] [-m footprint] [-a memory]\n"
+            "           [-s seed] [-p]\n",
+            prog);
+    exit(1);
+}
+
+/* Simple LCG so a seed gives the same program on every host */
+static int
+workload_rand(unsigned int *state, int range)
+{
+    *state = *state * 1103515245u + 12345u;
+    return (int)((*state >> 16) % (unsigned int)range);
+}
+
+static int
+chain_reg(int n)
+{
+    return REG_CHAIN_FIRST + n % REG_CHAIN_COUNT;
+}
+
+/*
+ * Emits one ALU instruction writing rd. If src is a register it is the
+ * producer this instruction depends on, otherwise the instruction only reads
+ * constants.
+ */
+static void
+emit_alu(FILE *out, unsigned int *state, int rd, int src)
+{
+    static const char *ops[] = {"ADD", "SUB", "AND", "OR", "MUL"};
+    int a = src >= 0 ? src : REG_ONE;
+
+    switch (workload_rand(state, 7))
+    {
+        case 5:
+            fprintf(out, "ADDL R%d,R%d,#%d\n", rd, a, 1 + workload_rand(state, 7));
+            break;
+
+        case 6:
+            fprintf(out, "SUBL R%d,R%d,#%d\n", rd, a, 1 + workload_rand(state, 7));
+            break;
+
+        default:
+            /* MUL by R3 (= 1) so values stay bounded */
+            fprintf(out, "%s R%d,R%d,R%d\n", ops[workload_rand(state, 5)], rd,
+                    a, REG_ONE);
+            break;
+    }
+}
+
+static void
+generate(FILE *out, const Workload_Params *p)
+{
+    unsigned int state = p->seed;
+    int i, emitted = 0, link = 0, prev = -1, dest = 0;
+
+    /* Preamble */
+    fprintf(out, "MOVC R%d,#%d\n", REG_COUNTER, p->trips);
+    fprintf(out, "MOVC R%d,#0\n", REG_POINTER);
+    fprintf(out, "MOVC R%d,#1\n", REG_ONE);
+    fprintf(out, "MOVC R%d,#%d\n", REG_MASK, p->footprint - 1);
+    for (i = 0; i < REG_CHAIN_COUNT; ++i)
+    {
+        fprintf(out, "MOVC R%d,#%d\n", chain_reg(i), i + 2);
+    }
+    fprintf(out, "MOVC R%d,#0\n", REG_BRANCH_COUNT);
+
+    /* Loop body */
+    for (i = 0; i < p->ops; ++i)
+    {
+        int roll = workload_rand(&state, 100);
+        int rd = chain_reg(dest++);
+
+        if (p->branch_every > 0 && i > 0 && i % p->branch_every == 0)
+        {
+            /* Taken on even trips: skips the ADDL */
+            fprintf(out, "AND R%d,R%d,R%d\n", REG_BRANCH_TMP, REG_COUNTER,
+                    REG_ONE);
+            fprintf(out, "BZ #8\n");
+            fprintf(out, "ADDL R%d,R%d,#1\n", REG_BRANCH_COUNT, REG_BRANCH_COUNT);
+            emitted += 3;
+        }
+
+        /* Chain links depend on the previous link, chain heads do not */
+        if (link == 0)
+        {
+            prev = -1;
+        }
+
+        if (roll < p->load_pct)
+        {
+            fprintf(out, "%s R%d,R%d,#%d\n", p->post_increment ? "LOADP" : "LOAD",
+                    rd, REG_POINTER, workload_rand(&state, WORKLOAD_MAX_OFFSET));
+        }
+        else if (roll < p->load_pct + p->store_pct)
+        {
+            fprintf(out, "%s R%d,R%d,#%d\n", p->post_increment ? "STOREP" : "STORE",
+                    prev >= 0 ? prev : REG_ONE, REG_POINTER,
+                    workload_rand(&state, WORKLOAD_MAX_OFFSET));
+            rd = prev;
+        }
+        else
+        {
+            emit_alu(out, &state, rd, prev);
+        }
+        emitted++;
+
+        prev = rd;
+        link = (link + 1) % p->chain;
+    }
+
+    /* Loop tail: walk the footprint with an odd stride, then count down */
+    fprintf(out, "ADDL R%d,R%d,#17\n", REG_POINTER, REG_POINTER);
+    fprintf(out, "AND R%d,R%d,R%d\n", REG_POINTER, REG_POINTER, REG_MASK);
+    fprintf(out, "SUBL R%d,R%d,#1\n", REG_COUNTER, REG_COUNTER);
+    emitted += 3;
+    fprintf(out, "BNZ #%d\n", -4 * emitted);
+    /* No newline: the Simulator 1 parser only accepts a bare HALT */
+    fprintf(out, "HALT");
+}
+
+int
+main(int argc, char *argv[])
+{
+    Workload_Params p = {
+        .trips = 1000,
+        .ops = 32,
+        .chain = 4,
+        .load_pct = 10,
+        .store_pct = 10,
+        .branch_every = 0,
+        .footprint = 1024,
+        .memory = WORKLOAD_DATA_MEMORY_SIZE,
+        .seed = 1,
+        .post_increment = 0,
+    };
+    int opt, words, reach;
+
+    while ((opt = getopt(argc, argv, "n:o:c:l:w:b:m:a:s:p")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': p.trips = atoi(optarg); break;
+            case 'o': p.ops = atoi(optarg); break;
+            case 'c': p.chain = atoi(optarg); break;
+            case 'l': p.load_pct = atoi(optarg); break;
+            case 'w': p.store_pct = atoi(optarg); break;
+            case 'b': p.branch_every = atoi(optarg); break;
+            case 'm': p.footprint = atoi(optarg); break;
+            case 'a': p.memory = atoi(optarg); break;
+            case 's': p.seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'p': p.post_increment = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if (p.trips < 1 || p.ops < 1 || p.chain < 1 || p.load_pct < 0
+        || p.store_pct < 0 || p.load_pct + p.store_pct > 100
+        || p.branch_every < 0 || p.footprint < 1 || p.memory < 1)
+    {
+        usage(argv[0]);
+    }
+
+    /* The pointer is masked, so round the footprint down to a power of two
+     * that leaves room for the largest offset and, with -p, for every body
+     * instruction advancing the pointer by 4 before the mask */
+    reach = WORKLOAD_MAX_OFFSET + (p.post_increment ? 4 * p.ops : 0);
+    for (words = 1; words * 2 <= p.footprint
+                    && words * 2 + reach <= p.memory;
+         words *= 2)
+        ;
+    p.footprint = words;
+
+    generate(stdout, &p);
+    return 0;
+}
@@ -0,0 +1,148 @@
+#!/bin/bash
+#
+# run_bench.sh
+# Builds every simulator core out of tree, generates the standard workloads
+# and reports simulated cycles and instructions per host second.
+#
+# Usage: run_bench.sh [results.csv]
+#
+# Environment:
+#   BENCH_CFLAGS   compiler flags for all cores (default: -O2)
+#   BENCH_SCALE    multiplies every workload's trip count (default: 1)
+#   BENCH_REPEAT   runs per (core, workload), best time is kept (default: 3)
+#   BENCH_BUILD    build directory (default: ./build)
+#   BENCH_CORES    cores to run (default: "sim1_part1 sim1_part2 sim1_part2_bp
+#                  sim1_part2_ooo sim2 sim2_nofwd")
+#   BENCH_OOO      sizes for sim1_part2_ooo, e.g. "prf 32 rob 32" (default: none)
+#   BENCH_BP       predictor options for sim1_part2_bp (default: "bp gshare")
+#
+set -e
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+SIM_DIR=$(cd "$BENCH_DIR/.." && pwd)
+BUILD=${BENCH_BUILD:-$BENCH_DIR/build}
+CC=${CC:-gcc}
+CFLAGS=${BENCH_CFLAGS:--O2}
+SCALE=${BENCH_SCALE:-1}
+REPEAT=${BENCH_REPEAT:-3}
+CORES=${BENCH_CORES:-sim1_part1 sim1_part2 sim1_part2_bp sim1_part2_ooo sim2 sim2_nofwd}
+OOO=${BENCH_OOO:-}
+BP=${BENCH_BP:-bp gshare}
+CSV=$1
+
+# name | apex_workload arguments (trip count is scaled separately). The -p
+# (LOADP/STOREP) workloads only run on the Simulator 1 cores
+WORKLOADS="
+alu_ilp      | -n 100000 -o 32 -c 1 -l 0 -w 0
+alu_chain    | -n 100000 -o 32 -c 16 -l 0 -w 0
+load_use     | -n 100000 -o 32 -c 4 -l 40 -w 10
+branchy      | -n 100000 -o 32 -c 2 -l 10 -w 10 -b 3
+mem_sweep    | -n 100000 -o 32 -c 4 -l 30 -w 30 -m 4096
+ptr_load     | -n 100000 -o 32 -c 4 -l 40 -w 10 -p
+ptr_sweep    | -n 100000 -o 32 -c 4 -l 30 -w 30 -m 4096 -p
+"
+
+mkdir -p "$BUILD/workloads"
+
+# Cores are built from copies so no objects land in the source tree
+build_cores()
+{
+    local part
+
+    rm -rf "$BUILD/sim2_src"
+    cp -r "$SIM_DIR/APEX Simulator 2" "$BUILD/sim2_src"
+    # The source tree carries prebuilt objects, always rebuild them
+    make -s -C "$BUILD/sim2_src" clean
+    make -s -C "$BUILD/sim2_src" CFLAGS="$CFLAGS -DVERSION=2.0" LDFLAGS="$CFLAGS" \
+        progs >/dev/null
+    cp "$BUILD/sim2_src/apex_sim" "$BUILD/apex_sim2"
+
+    for part in 1 2; do
+        $CC $CFLAGS -DVERSION=2.0 -o "$BUILD/apex_sim1_part$part" \
+            "$SIM_DIR/APEX Simulator 1/Part_$part/"*.c -lpthread
+    done
+
+    $CC $CFLAGS -Wall -o "$BUILD/apex_workload" "$BENCH_DIR/apex_workload.c"
+}
+
+# Prints "<cycles> <instructions>" for one run of a core on a workload
+run_core()
+{
+    local core=$1 prog=$2
+
+    case $core in
+        sim1_part1|sim1_part2)
+            "$BUILD/apex_$core" "$prog" Simulate 2000000000 </dev/null 2>/dev/null \
+                | sed -n 's/.*cycles = \([0-9]*\) instructions = \([0-9]*\).*/\1 \2/p' \
+                | head -1
+            ;;
+        sim1_part2_bp)
+            "$BUILD/apex_sim1_part2" "$prog" Simulate 2000000000 $BP </dev/null 2>/dev/null \
+                | sed -n 's/.*cycles = \([0-9]*\) instructions = \([0-9]*\).*/\1 \2/p' \
+                | head -1
+            ;;
+        sim1_part2_ooo)
+            "$BUILD/apex_sim1_part2" "$prog" OoO 2000000000 $OOO </dev/null 2>/dev/null \
+                | sed -n 's/.*cycles = \([0-9]*\) instructions = \([0-9]*\).*/\1 \2/p' \
+                | head -1
+            ;;
+        sim2)
+            "$BUILD/apex_sim2" "$prog" batch 0 fwd y 2>/dev/null \
+                | sed -n 's/.*cycles = \([0-9]*\) instructions = \([0-9]*\).*/\1 \2/p'
+            ;;
+        sim2_nofwd)
+            "$BUILD/apex_sim2" "$prog" batch 0 fwd n 2>/dev/null \
+                | sed -n 's/.*cycles = \([0-9]*\) instructions = \([0-9]*\).*/\1 \2/p'
+            ;;
+        *)
+            echo "APEX_Error: Unknown core $core" >&2
+            exit 1
+            ;;
+    esac
+}
+
+build_cores
+
+printf "%-15s %-10s %10s %10s %9s %12s %12s\n" \
+       core workload cycles insns seconds cycles/s insns/s
+[ -n "$CSV" ] && echo "core,workload,cycles,instructions,seconds,cycles_per_sec,insns_per_sec" > "$CSV"
+
+echo "$WORKLOADS" | while IFS='|' read -r name args; do
+    name=$(echo $name)
+    [ -z "$name" ] && continue
+
+    trips=$(printf '%s\n' "$args" | sed -n 's/.*-n \([0-9]*\).*/\1/p')
+    args=$(printf '%s\n' "$args" | sed "s/-n [0-9]*/-n $((trips * SCALE))/")
+    prog="$BUILD/workloads/$name.asm"
+    "$BUILD/apex_workload" $args > "$prog"
+
+    for core in $CORES; do
+        case "$core:$args" in
+            sim2*-p*) continue ;;
+        esac
+
+        best=
+        for ((i = 0; i < REPEAT; ++i)); do
+            start=$(date +%s%N)
+            result=$(run_core $core "$prog")
+            end=$(date +%s%N)
+            ns=$((end - start))
+            if [ -z "$best" ] || [ $ns -lt $best ]; then
+                best=$ns
+            fi
+        done
+
+        set -- $result
+        if [ $# -ne 2 ]; then
+            printf "%-15s %-10s %10s\n" $core $name "failed"
+            continue
+        fi
+
+        awk -v core=$core -v name=$name -v c=$1 -v n=$2 -v ns=$best -v csv="$CSV" 'BEGIN {
+            s = ns / 1e9
+            printf "%-15s %-10s %10d %10d %9.3f %12.0f %12.0f\n", core, name, c, n, s, c / s, n / s
+            if (csv != "")
+                printf "%s,%s,%d,%d,%.6f,%.0f,%.0f\n", core, name, c, n, s, c / s, n / s >> csv
+        }'
+    done
+done